@@ -0,0 +1,46 @@
+/***********************************************************************
+flameShader - Shader vertex to place and color the instances of the flame shape.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Magic Sand; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#version 150
+
+// these are for the programmable pipeline system and are passed in
+// by default from OpenFrameworks
+uniform mat4 modelViewProjectionMatrix;
+
+in vec4 position;
+in vec4 instance; // Per flame: projector coordinate, angle in degrees and intensity
+
+out vec4 flameColor;
+
+void main()
+{
+    vec2 shape = position.xy;
+
+    /* Rotate the flame shape by the agent angle and move it to the agent location: */
+    float angle = radians(instance.z);
+    vec2 pos = vec2(cos(angle)*shape.x - sin(angle)*shape.y, sin(angle)*shape.x + cos(angle)*shape.y) + instance.xy;
+
+    /* Orange fading to black with the intensity: */
+    float intensityFactor = instance.w <= 0.0 ? 0.0 : instance.w * 0.33;
+    flameColor = vec4(intensityFactor, 0.25 * intensityFactor, 0.0, 1.0);
+
+    gl_Position = modelViewProjectionMatrix * vec4(pos, 0.0, 1.0);
+}
@@ -0,0 +1,165 @@
+/***********************************************************************
+BurnedAreaMap.cpp - bitmap of the burned pixels of the sandbox
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "BurnedAreaMap.h"
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+namespace
+{
+    int popcount(uint64_t word)
+    {
+#if defined(__GNUC__)
+        return __builtin_popcountll(word);
+#elif defined(_MSC_VER) && defined(_M_X64)
+        return static_cast<int>(__popcnt64(word));
+#else
+        int count = 0;
+        for (; word; word &= word-1)
+            count++;
+        return count;
+#endif
+    }
+
+    // Bits [begin, end[ of a word, 0 <= begin < end <= 64
+    uint64_t bitRange(int begin, int end)
+    {
+        uint64_t high = end >= 64 ? ~uint64_t(0) : (uint64_t(1) << end)-1;
+        return high & ~((uint64_t(1) << begin)-1);
+    }
+}
+
+BurnedAreaMap::BurnedAreaMap()
+:minX(0),
+minY(0),
+width(0),
+height(0),
+wordsPerRow(0),
+tileRows(0),
+burnedCount(0),
+perimeter(0)
+{
+}
+
+/**
+ * @fn	void BurnedAreaMap::reset(ofRectangle skinectROI)
+ *
+ * @brief	Sizes the map to the ROI and clears it.
+ *
+ * @param	skinectROI	The kinect ROI.
+ */
+
+void BurnedAreaMap::reset(ofRectangle skinectROI){
+    minX = static_cast<int>(skinectROI.getMinX());
+    minY = static_cast<int>(skinectROI.getMinY());
+    width = std::max(static_cast<int>(skinectROI.getMaxX())-minX, 0);
+    height = std::max(static_cast<int>(skinectROI.getMaxY())-minY, 0);
+    wordsPerRow = (width+63)/64;
+    tileRows = (height+tileSize-1)/tileSize;
+    bits.resize(static_cast<size_t>(wordsPerRow)*height);
+    tileCounts.resize(static_cast<size_t>(wordsPerRow)*tileRows);
+    clear();
+}
+
+/**
+ * @fn	void BurnedAreaMap::clear()
+ *
+ * @brief	Marks all pixels as unburned.
+ *
+ */
+
+void BurnedAreaMap::clear(){
+    std::fill(bits.begin(), bits.end(), 0);
+    std::fill(tileCounts.begin(), tileCounts.end(), 0);
+    burnedCount = 0;
+    perimeter = 0;
+}
+
+/**
+ * @fn	bool BurnedAreaMap::burn(int x, int y)
+ *
+ * @brief	Marks a pixel as burned and updates the statistics.
+ *
+ * @param	x	The kinect x coordinate.
+ * @param	y	The kinect y coordinate.
+ *
+ * @return	False if the pixel was already burned or is outside the ROI.
+ */
+
+bool BurnedAreaMap::burn(int x, int y){
+    int bx = x-minX;
+    int by = y-minY;
+    if (static_cast<unsigned int>(bx) >= static_cast<unsigned int>(width) || static_cast<unsigned int>(by) >= static_cast<unsigned int>(height))
+        return false;
+    uint64_t& word = bits[by*wordsPerRow+(bx>>6)];
+    uint64_t mask = uint64_t(1) << (bx&63);
+    if (word & mask)
+        return false;
+    word |= mask;
+    tileCounts[(by/tileSize)*wordsPerRow+(bx>>6)]++;
+    burnedCount++;
+    // Each burned neighbour turns a perimeter edge into an inner one, the other edges become perimeter
+    int burnedNeighbours = isBurnedInside(bx-1, by)+isBurnedInside(bx+1, by)+isBurnedInside(bx, by-1)+isBurnedInside(bx, by+1);
+    perimeter += 4-2*burnedNeighbours;
+    return true;
+}
+
+/**
+ * @fn	int BurnedAreaMap::countBurned(ofRectangle region) const
+ *
+ * @brief	Counts the burned pixels of a region.
+ *
+ * @param	region	The region in kinect pixel coordinates.
+ *
+ * @return	The number of burned pixels.
+ */
+
+int BurnedAreaMap::countBurned(ofRectangle region) const{
+    int x0 = std::max(static_cast<int>(region.getMinX())-minX, 0);
+    int y0 = std::max(static_cast<int>(region.getMinY())-minY, 0);
+    int x1 = std::min(static_cast<int>(region.getMaxX())-minX, width);
+    int y1 = std::min(static_cast<int>(region.getMaxY())-minY, height);
+    if (x0 >= x1 || y0 >= y1)
+        return 0;
+    int count = 0;
+    for (int ty = y0/tileSize; ty <= (y1-1)/tileSize; ty++){
+        int rowBegin = std::max(ty*tileSize, y0);
+        int rowEnd = std::min((ty+1)*tileSize, y1);
+        for (int tx = x0 >> 6; tx <= (x1-1) >> 6; tx++){
+            int tileCount = tileCounts[ty*wordsPerRow+tx];
+            if (tileCount == 0)
+                continue;
+            int bitBegin = std::max(tx*64, x0)-tx*64;
+            int bitEnd = std::min(tx*64+64, x1)-tx*64;
+            bool fullTile = bitBegin == 0 && (bitEnd == 64 || tx*64+bitEnd == width) && rowBegin == ty*tileSize && (rowEnd == (ty+1)*tileSize || rowEnd == height);
+            if (fullTile){
+                count += tileCount;
+                continue;
+            }
+            uint64_t mask = bitRange(bitBegin, bitEnd);
+            for (int by = rowBegin; by < rowEnd; by++)
+                count += popcount(bits[by*wordsPerRow+tx] & mask);
+        }
+    }
+    return count;
+}
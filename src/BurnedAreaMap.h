@@ -0,0 +1,73 @@
+/***********************************************************************
+BurnedAreaMap.h - bitmap of the burned pixels of the sandbox
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#pragma once
+#include "ofMain.h"
+#include <stdint.h>
+
+// One bit per kinect pixel of the ROI, rows of 64 bit words. Tiles of
+// 64x64 pixels (one word wide) keep their number of burned pixels so that
+// region counts can skip the unburned tiles. The burned pixel count and
+// the perimeter (edges between burned and unburned pixels, the outside of
+// the ROI counting as unburned) are updated at each burn().
+class BurnedAreaMap {
+public:
+    BurnedAreaMap();
+
+    void reset(ofRectangle skinectROI); // Size the map to the ROI and clear it
+    void clear();
+
+    bool isBurned(int x, int y) const { // x, y in kinect pixel coordinate, pixels outside the ROI count as burned
+        int bx = x-minX;
+        int by = y-minY;
+        if (static_cast<unsigned int>(bx) >= static_cast<unsigned int>(width) || static_cast<unsigned int>(by) >= static_cast<unsigned int>(height))
+            return true;
+        return (bits[by*wordsPerRow+(bx>>6)] >> (bx&63)) & 1;
+    }
+    bool burn(int x, int y); // Return false if the pixel was already burned or is outside the ROI
+
+    int getBurnedCount() const {
+        return burnedCount;
+    }
+    int getPerimeter() const {
+        return perimeter;
+    }
+    float getBurnedFraction() const {
+        return width*height > 0 ? static_cast<float>(burnedCount)/(width*height) : 0;
+    }
+    int countBurned(ofRectangle region) const; // Burned pixels in a region of kinect pixels
+
+private:
+    static const int tileSize = 64;
+
+    bool isBurnedInside(int bx, int by) const { // Map coordinates, false outside the map
+        if (static_cast<unsigned int>(bx) >= static_cast<unsigned int>(width) || static_cast<unsigned int>(by) >= static_cast<unsigned int>(height))
+            return false;
+        return (bits[by*wordsPerRow+(bx>>6)] >> (bx&63)) & 1;
+    }
+
+    int minX, minY, width, height;
+    int wordsPerRow, tileRows;
+    std::vector<uint64_t> bits;
+    std::vector<uint16_t> tileCounts; // Burned pixels per tile, tile (tx, ty) at ty*wordsPerRow+tx
+    int burnedCount;
+    int perimeter;
+};
@@ -0,0 +1,379 @@
+/***********************************************************************
+FireAgents.cpp - fire agents moving in the sandbox
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "FireAgents.h"
+
+namespace
+{
+    ofVec2f angleToVector(float angle)
+    {
+        float radian = ofDegToRad(angle);
+        return ofVec2f(cos(radian), sin(radian));
+    }
+
+    // Swap-and-pop: move the last element to index i and drop the last slot
+    template <typename T>
+    void removeAt(vector<T>& v, size_t i)
+    {
+        v[i] = v.back();
+        v.pop_back();
+    }
+}
+
+FireAgents::FireAgents(std::shared_ptr<KinectProjector> const& k)
+:kinectProjector(k),
+nextId(0),
+minborderDist(50),
+wanderR(50),
+change(1),
+maxVelocityChange(1),
+maxRotation(360),
+topSpeed(1),
+velocityIncreaseStep(2),
+minVelocity(2),
+initialIntensity(3)
+{
+    reserve(4096);
+}
+
+/**
+ * @fn	void FireAgents::setSeed(uint32_t sseed)
+ *
+ * @brief	Sets the seed of the agent random numbers, applies to the next draws.
+ *
+ * @param	sseed	The seed.
+ */
+
+void FireAgents::setSeed(uint32_t sseed){
+    rng.setSeed(sseed);
+}
+
+/**
+ * @fn	void FireAgents::setBorders(ofRectangle sborders)
+ *
+ * @brief	Sets the area the agents move in, they stop when getting close to its borders.
+ *
+ * @param	sborders	The borders in kinect coordinates.
+ */
+
+void FireAgents::setBorders(ofRectangle sborders){
+    borders = sborders;
+    internalBorders = borders;
+    if (borders.width > 0 && borders.height > 0)
+        internalBorders.scaleFromCenter((borders.width-minborderDist)/borders.width, (borders.height-minborderDist)/borders.height);
+}
+
+/**
+ * @fn	void FireAgents::reserve(size_t capacity)
+ *
+ * @brief	Preallocates the agent arrays.
+ *
+ * @param	capacity	The number of agents.
+ */
+
+void FireAgents::reserve(size_t capacity){
+    x.reserve(capacity);
+    y.reserve(capacity);
+    vx.reserve(capacity);
+    vy.reserve(capacity);
+    angle.reserve(capacity);
+    projX.reserve(capacity);
+    projY.reserve(capacity);
+    intensity.reserve(capacity);
+    alive.reserve(capacity);
+    id.reserve(capacity);
+}
+
+/**
+ * @fn	void FireAgents::add(ofVec2f location, float sangle)
+ *
+ * @brief	Adds a standing agent.
+ *
+ * @param	location	The location in kinect coordinates.
+ * @param	sangle  	The starting direction in degrees.
+ */
+
+void FireAgents::add(ofVec2f location, float sangle){
+    x.push_back(location.x);
+    y.push_back(location.y);
+    vx.push_back(0);
+    vy.push_back(0);
+    angle.push_back(sangle);
+    projX.push_back(0);
+    projY.push_back(0);
+    intensity.push_back(initialIntensity);
+    alive.push_back(1);
+    id.push_back(nextId++);
+}
+
+/**
+ * @fn	void FireAgents::remove(size_t i)
+ *
+ * @brief	Removes an agent in constant time, the last agent takes its index.
+ *
+ * @param	i	The agent index.
+ */
+
+void FireAgents::remove(size_t i){
+    removeAt(x, i);
+    removeAt(y, i);
+    removeAt(vx, i);
+    removeAt(vy, i);
+    removeAt(angle, i);
+    removeAt(projX, i);
+    removeAt(projY, i);
+    removeAt(intensity, i);
+    removeAt(alive, i);
+    removeAt(id, i);
+}
+
+void FireAgents::clear(){
+    x.clear();
+    y.clear();
+    vx.clear();
+    vy.clear();
+    angle.clear();
+    projX.clear();
+    projY.clear();
+    intensity.clear();
+    alive.clear();
+    id.clear();
+    nextId = 0;
+}
+
+/**
+ * @fn	void FireAgents::update(float windSpeed, float windDirection, uint32_t step)
+ *
+ * @brief	Applies the behaviours to all agents and moves them. The agents are
+ * 			split in blocks of agentsPerTask updated on the worker pool of the kinect projector, an agent
+ * 			only writes its own slots and reads the elevation and projector maps.
+ *
+ * @param	windSpeed	 	The wind speed.
+ * @param	windDirection	The wind direction.
+ * @param	step		 	The model timestep, counter of the random numbers.
+ */
+
+void FireAgents::update(float windSpeed, float windDirection, uint32_t step){
+    size_t numAgents = size();
+    int numTasks = static_cast<int>((numAgents+agentsPerTask-1)/agentsPerTask);
+    kinectProjector->getWorkerPool().run(numTasks, [this, numAgents, windSpeed, windDirection, step](int task) {
+        size_t end = min(numAgents, (task+1)*agentsPerTask);
+        for (size_t i = task*agentsPerTask; i < end; i++){
+            ofVec2f velocityChange = applyBehaviours(i, windSpeed, windDirection, step);
+            move(i, velocityChange);
+        }
+    });
+}
+
+/**
+ * @fn	ofVec2f FireAgents::applyBehaviours(size_t i, float windSpeed, float windDirection, uint32_t step)
+ *
+ * @brief	Combines the wander, hill and wind effects for one agent. An agent
+ * 			about to reach the water or the borders decelerates, and stops once
+ * 			it is slow enough.
+ *
+ * @param	i			 	The agent index.
+ * @param	windSpeed	 	The wind speed.
+ * @param	windDirection	The wind direction.
+ * @param	step		 	The model timestep.
+ *
+ * @return	The velocity change.
+ */
+
+ofVec2f FireAgents::applyBehaviours(size_t i, float windSpeed, float windDirection, uint32_t step){
+    ofVec2f location(x[i], y[i]);
+    ofVec2f velocity(vx[i], vy[i]);
+
+    // Beach detection: look for water in the next 10 steps
+    bool beach = false;
+    float beachDist = 0;
+    ofVec2f futureLocation = location;
+    for (int lookahead = 1; lookahead < 10 && !beach; lookahead++){
+        if (kinectProjector->elevationAtKinectCoord(futureLocation.x, futureLocation.y) < 0){
+            beach = true;
+            beachDist = lookahead;
+        }
+        futureLocation += velocity;
+    }
+
+    // Border detection: predict the location 10 steps ahead
+    bool border = !internalBorders.inside(location + velocity*10);
+
+    // Wander effect, introduces some randomness in the direction changes
+    float wandertheta = rng.uniform(Philox::DOMAIN_AGENTS, id[i], step, DRAW_WANDER, -change, change);
+    ofVec2f wanderF = angleToVector(angle[i]+ofRadToDeg(wandertheta))*topSpeed;
+    wanderF.limit(maxVelocityChange);
+
+    // Hill effect: turn back downhill, accelerate uphill, nothing on a plane.
+    // The terrain gradient along the velocity tells whether the agent climbs
+    ofVec2f hillF(0);
+    float rise = 0;
+    const TerrainAnalysis& terrainAnalysis = kinectProjector->getTerrainAnalysis();
+    int ix = static_cast<int>(location.x);
+    int iy = static_cast<int>(location.y);
+    if (terrainAnalysis.isInside(ix, iy))
+        rise = terrainAnalysis.getGradient(ix, iy).dot(velocity);
+    ofVec2f front = angleToVector(angle[i]);
+    if (rise < 0){
+        hillF = -front;
+        hillF.limit(maxVelocityChange);
+    } else if (rise > 0){
+        hillF = front*3;
+    }
+
+    // Wind effect, the wind force is truncated to an int as in the original agents
+    int windForce = windSpeed > 1 ? 1 : 0;
+    ofVec2f windF = angleToVector(windDirection)*windForce;
+    windF.limit(maxVelocityChange);
+
+    hillF *= 3;
+    windF *= 0.6;
+
+    ofVec2f oldDir = front*velocityIncreaseStep;
+    ofVec2f newDir = wanderF+hillF+windF;
+
+    if (beach){
+        oldDir.scale(velocityIncreaseStep/beachDist);
+    }
+    if (!beach && !border){
+        return newDir+oldDir; // Just accelerate
+    }
+    // We need to decelerate and then change direction
+    if (velocity.lengthSquared() > minVelocity*minVelocity){ // We are not stopped yet
+        return -oldDir-newDir;
+    }
+    // Stops the agent
+    vx[i] = 0;
+    vy[i] = 0;
+    alive[i] = 0;
+    return ofVec2f(0);
+}
+
+/**
+ * @fn	void FireAgents::move(size_t i, ofVec2f velocityChange)
+ *
+ * @brief	Moves one agent and turns it toward its velocity.
+ *
+ * @param	i			  	The agent index.
+ * @param	velocityChange	The velocity change.
+ */
+
+void FireAgents::move(size_t i, ofVec2f velocityChange){
+    ofVec2f projectorCoord = kinectProjector->kinectCoordToProjCoord(x[i], y[i]);
+    projX[i] = projectorCoord.x;
+    projY[i] = projectorCoord.y;
+
+    ofVec2f velocity(vx[i]+velocityChange.x, vy[i]+velocityChange.y);
+    velocity.limit(topSpeed);
+    vx[i] = velocity.x;
+    vy[i] = velocity.y;
+    x[i] += velocity.x;
+    y[i] += velocity.y;
+
+    float desiredAngle = ofRadToDeg(atan2(velocity.y, velocity.x));
+    float angleChange = desiredAngle - angle[i];
+    angleChange += (angleChange > 180) ? -360 : (angleChange < -180) ? 360 : 0; // To take into account that the difference between -180 and 180 is 0 and not 360
+    angleChange *= velocity.length();
+    angleChange /= topSpeed;
+    angleChange = max(min(angleChange, maxRotation), -maxRotation);
+    angle[i] += angleChange;
+}
+
+/**
+ * @fn	void FireAgents::draw(FlameRenderer& flames)
+ *
+ * @brief	Adds the flames of the agents, the stopped ones lose intensity at each draw.
+ *
+ * @param	flames	The flame batch.
+ */
+
+void FireAgents::draw(FlameRenderer& flames){
+    for (size_t i = 0; i < size(); i++){
+        if (!alive[i]){
+            intensity[i]--;
+        }
+        flames.add(ofVec2f(projX[i], projY[i]), angle[i], intensity[i]);
+    }
+}
+
+//==============================================================
+// Embers
+//==============================================================
+
+FireEmbers::FireEmbers(){
+    reserve(4*4096);
+}
+
+void FireEmbers::reserve(size_t capacity){
+    projX.reserve(capacity);
+    projY.reserve(capacity);
+    angle.reserve(capacity);
+    intensity.reserve(capacity);
+}
+
+/**
+ * @fn	void FireEmbers::add(ofVec2f projectorCoord, float sangle, int sintensity)
+ *
+ * @brief	Leaves an ember where an agent was drawn.
+ *
+ * @param	projectorCoord	The projector coordinate.
+ * @param	sangle		  	The direction in degrees.
+ * @param	sintensity	  	The intensity of the agent.
+ */
+
+void FireEmbers::add(ofVec2f projectorCoord, float sangle, int sintensity){
+    projX.push_back(projectorCoord.x);
+    projY.push_back(projectorCoord.y);
+    angle.push_back(sangle);
+    intensity.push_back(sintensity);
+}
+
+void FireEmbers::clear(){
+    projX.clear();
+    projY.clear();
+    angle.clear();
+    intensity.clear();
+}
+
+/**
+ * @fn	void FireEmbers::draw(FlameRenderer& flames)
+ *
+ * @brief	Adds the flames of the embers with a decreasing intensity and
+ * 			removes the extinct ones after their last, black, flame.
+ *
+ * @param	flames	The flame batch.
+ */
+
+void FireEmbers::draw(FlameRenderer& flames){
+    size_t i = 0;
+    while (i < size()){
+        intensity[i]--;
+        flames.add(ofVec2f(projX[i], projY[i]), angle[i], intensity[i]);
+        if (intensity[i] <= 0){
+            removeAt(projX, i);
+            removeAt(projY, i);
+            removeAt(angle, i);
+            removeAt(intensity, i);
+        } else {
+            i++;
+        }
+    }
+}
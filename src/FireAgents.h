@@ -0,0 +1,134 @@
+/***********************************************************************
+FireAgents.h - fire agents moving in the sandbox
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#pragma once
+#include "ofMain.h"
+
+#include "KinectProjector/KinectProjector.h"
+#include "Random.h"
+#include "FlameRenderer.h"
+
+// All the fire agents in structure of arrays: agent i is the i-th element
+// of every array. Removing an agent moves the last one in its place, so
+// indices are only stable until the next remove().
+// The random numbers of an agent are a function of the seed, its id (the
+// order of the add() calls since the last clear()), the model timestep and
+// a draw index, so that the parallel update gives the same result for a
+// seed whatever the number of threads.
+class FireAgents {
+public:
+    enum Draw
+    {
+        DRAW_WANDER, // Wander angle of the behaviour update
+        DRAW_SPREAD // Spread of the fire, drawn by the model
+    };
+
+    FireAgents(std::shared_ptr<KinectProjector> const& k);
+
+    void setSeed(uint32_t sseed);
+    uint32_t getSeed() const {
+        return rng.getSeed();
+    }
+
+    void setBorders(ofRectangle sborders); // Agents stop before leaving the borders
+    void reserve(size_t capacity);
+
+    size_t size() const {
+        return x.size();
+    }
+    void add(ofVec2f location, float sangle);
+    void remove(size_t i);
+    void clear();
+
+    uint32_t random(size_t i, uint32_t step, Draw draw, uint32_t bound) const { // In [0, bound[
+        return rng.below(Philox::DOMAIN_AGENTS, id[i], step, draw, bound);
+    }
+
+    ofVec2f getLocation(size_t i) const {
+        return ofVec2f(x[i], y[i]);
+    }
+    ofVec2f getProjectorCoord(size_t i) const {
+        return ofVec2f(projX[i], projY[i]);
+    }
+    float getAngle(size_t i) const {
+        return angle[i];
+    }
+    int getIntensity(size_t i) const {
+        return intensity[i];
+    }
+    bool isAlive(size_t i) const {
+        return alive[i] != 0;
+    }
+
+    void update(float windSpeed, float windDirection, uint32_t step); // Apply the behaviours and move all agents in parallel
+    void draw(FlameRenderer& flames); // Add the flames of the agents, the agents which stopped fade out
+
+private:
+    ofVec2f applyBehaviours(size_t i, float windSpeed, float windDirection, uint32_t step); // Return the velocity change
+    void move(size_t i, ofVec2f velocityChange);
+
+    std::shared_ptr<KinectProjector> kinectProjector;
+    ofRectangle borders, internalBorders;
+
+    static const size_t agentsPerTask = 256;
+    Philox rng;
+    uint32_t nextId; // Id of the next agent
+
+    // Agent arrays
+    vector<float> x, y; // Location in kinect coordinates
+    vector<float> vx, vy; // Velocity
+    vector<float> angle; // Direction of the drawing in degrees
+    vector<float> projX, projY; // Projector coordinates of the location before the last move
+    vector<int> intensity;
+    vector<unsigned char> alive;
+    vector<uint32_t> id; // Random stream of the agent
+
+    // Behaviour parameters, the same for all agents
+    float minborderDist;
+    float wanderR; // Radius of the wander circle
+    float change; // Wander angle range
+    float maxVelocityChange;
+    float maxRotation;
+    float topSpeed;
+    float velocityIncreaseStep;
+    float minVelocity;
+    int initialIntensity;
+};
+
+// What remains of a fire agent after it moved on: drawn a few more times with a decreasing intensity
+class FireEmbers {
+public:
+    FireEmbers();
+
+    void reserve(size_t capacity);
+    size_t size() const {
+        return projX.size();
+    }
+    void add(ofVec2f projectorCoord, float sangle, int sintensity);
+    void clear();
+
+    void draw(FlameRenderer& flames); // Add the flames of the embers with a decreasing intensity, remove the extinct ones
+
+private:
+    vector<float> projX, projY;
+    vector<float> angle;
+    vector<int> intensity;
+};
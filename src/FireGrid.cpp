@@ -0,0 +1,306 @@
+/***********************************************************************
+FireGrid.cpp - cellular automaton fire spread over the sandbox
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "FireGrid.h"
+
+FireGrid::FireGrid(std::shared_ptr<KinectProjector> const& k)
+:kinectProjector(k),
+cellSize(1),
+cols(0),
+rows(0),
+step(0),
+terrainGeneration(0),
+terrainValid(false),
+numBurning(0),
+numBurned(0),
+numBurnable(0),
+baseRate(1.0f),
+windCoefficient(0.4f),
+windExponent(1.0f),
+slopeCoefficient(5.275f),
+burnRate(0.05f),
+windSpeed(0),
+phiWind(0),
+windVector(1, 0),
+cellPitch(1),
+meshStep(8)
+{
+}
+
+/**
+ * @fn	void FireGrid::reset(ofRectangle skinectROI, int scellSize)
+ *
+ * @brief	Allocates the cells covering the ROI and clears them.
+ *
+ * @param	skinectROI	The kinect ROI.
+ * @param	scellSize 	Kinect pixels per cell side.
+ */
+
+void FireGrid::reset(ofRectangle skinectROI, int scellSize){
+    kinectROI = skinectROI;
+    cellSize = std::max(scellSize, 1);
+    cols = std::max(static_cast<int>(kinectROI.width)/cellSize, 1);
+    rows = std::max(static_cast<int>(kinectROI.height)/cellSize, 1);
+    size_t size = static_cast<size_t>(cols)*rows;
+    state.resize(size);
+    nextState.resize(size);
+    fuel.resize(size);
+    progress.resize(size);
+    ignitionStep.resize(size);
+    elevation.resize(size);
+    gradient.resize(size);
+
+    colors.allocate(cols, rows, OF_IMAGE_COLOR_ALPHA);
+    texture.allocate(cols, rows, GL_RGBA);
+    texture.setTextureMinMagFilter(GL_NEAREST, GL_NEAREST);
+
+    mesh.setup(ofVec2f(kinectROI.x, kinectROI.y), cols, rows, cellSize, meshStep, texture);
+    clear();
+}
+
+/**
+ * @fn	void FireGrid::clear()
+ *
+ * @brief	Puts out the fire and restores the fuel of all cells.
+ *
+ */
+
+void FireGrid::clear(){
+    std::fill(state.begin(), state.end(), CELL_UNBURNED);
+    std::fill(fuel.begin(), fuel.end(), 1.0f);
+    std::fill(progress.begin(), progress.end(), 0.0f);
+    std::fill(ignitionStep.begin(), ignitionStep.end(), -1);
+    step = 0;
+    numBurning = 0;
+    numBurned = 0;
+    activeMinX = cols;
+    activeMinY = rows;
+    activeMaxX = -1;
+    activeMaxY = -1;
+    terrainValid = false; // The water cells were cleared
+    updateTerrain();
+}
+
+/**
+ * @fn	void FireGrid::setWind(float swindSpeed, float swindDirection)
+ *
+ * @brief	Sets the wind.
+ *
+ * @param	swindSpeed	   	The wind speed.
+ * @param	swindDirection	The direction toward which the wind blows, in degrees.
+ */
+
+void FireGrid::setWind(float swindSpeed, float swindDirection){
+    windSpeed = swindSpeed;
+    float radian = ofDegToRad(swindDirection);
+    windVector = ofVec2f(cos(radian), sin(radian));
+}
+
+/**
+ * @fn	void FireGrid::ignite(ofVec2f kinectCoord)
+ *
+ * @brief	Sets the burnable cells around a kinect point on fire.
+ *
+ * @param	kinectCoord	The kinect coordinate of the ignition point.
+ */
+
+void FireGrid::ignite(ofVec2f kinectCoord){
+    updateTerrain();
+    int ci = static_cast<int>((kinectCoord.x-kinectROI.x)/cellSize);
+    int cj = static_cast<int>((kinectCoord.y-kinectROI.y)/cellSize);
+    for (int j = std::max(cj-1, 0); j <= std::min(cj+1, rows-1); j++){
+        for (int i = std::max(ci-1, 0); i <= std::min(ci+1, cols-1); i++){
+            int c = j*cols+i;
+            if (state[c] != CELL_UNBURNED)
+                continue;
+            state[c] = CELL_BURNING;
+            nextState[c] = CELL_BURNING;
+            ignitionStep[c] = step;
+            numBurning++;
+            activeMinX = std::min(activeMinX, i);
+            activeMinY = std::min(activeMinY, j);
+            activeMaxX = std::max(activeMaxX, i);
+            activeMaxY = std::max(activeMaxY, j);
+        }
+    }
+}
+
+float FireGrid::getBurnedFraction() const{
+    return numBurnable > 0 ? static_cast<float>(numBurned+numBurning)/numBurnable : 0;
+}
+
+void FireGrid::updateTerrain(){
+    // Only a new frame or a new base plane can change the terrain
+    const ElevationMap& elevationMap = kinectProjector->getElevationMap();
+    const TerrainAnalysis& terrainAnalysis = kinectProjector->getTerrainAnalysis();
+    if (terrainValid && elevationMap.getGeneration() == terrainGeneration)
+        return;
+    terrainGeneration = elevationMap.getGeneration();
+    terrainValid = true;
+
+    // Water cells do not burn, the sand can be reshaped during the fire
+    numBurnable = 0;
+    for (int j = 0; j < rows; j++){
+        int y = static_cast<int>(kinectROI.y)+j*cellSize+cellSize/2;
+        for (int i = 0; i < cols; i++){
+            int c = j*cols+i;
+            int x = static_cast<int>(kinectROI.x)+i*cellSize+cellSize/2;
+            elevation[c] = elevationMap.isInside(x, y) ? elevationMap.getElevation(x, y) : kinectProjector->elevationAtKinectCoord(x, y);
+            gradient[c] = terrainAnalysis.isInside(x, y) ? terrainAnalysis.getGradient(x, y) : ofVec2f(0);
+            if (state[c] == CELL_UNBURNED && elevation[c] < 0){
+                state[c] = CELL_NONBURNABLE;
+            } else if (state[c] == CELL_NONBURNABLE && elevation[c] >= 0){
+                state[c] = CELL_UNBURNED;
+            }
+            nextState[c] = state[c];
+            numBurnable += state[c] != CELL_NONBURNABLE;
+        }
+    }
+    // World distance between two neighbouring cell centers, at the center of the ROI
+    ofVec2f center = kinectROI.getCenter();
+    ofVec3f a = kinectProjector->kinectCoordToWorldCoord(floor(center.x), floor(center.y));
+    ofVec3f b = kinectProjector->kinectCoordToWorldCoord(floor(center.x)+cellSize, floor(center.y));
+    cellPitch = std::max(ofVec2f(b.x-a.x, b.y-a.y).length(), 0.001f);
+}
+
+float FireGrid::spreadRate(int from, int to, float dx, float dy) const{
+    // Wind: full effect downwind, backing fire slowed down upwind
+    float windCos = dx*windVector.x+dy*windVector.y;
+    float windTerm = windCos >= 0 ? 1+phiWind*windCos : 1/(1-phiWind*windCos);
+    // Slope: faster uphill, slower downhill. Mean gradient of the two cells along
+    // the direction, converted from kinect pixels to world distance
+    ofVec2f slopeGradient = (gradient[from]+gradient[to])*0.5f;
+    float tanSlope = (slopeGradient.x*dx+slopeGradient.y*dy)*cellSize/cellPitch;
+    float phiSlope = slopeCoefficient*tanSlope*tanSlope;
+    float slopeTerm = tanSlope >= 0 ? 1+phiSlope : 1/(1+phiSlope);
+    return std::min(baseRate/cellSize*windTerm*slopeTerm, 1.0f);
+}
+
+/**
+ * @fn	void FireGrid::update()
+ *
+ * @brief	Advances the fire by one step.
+ *
+ */
+
+void FireGrid::update(){
+    updateTerrain();
+    if (numBurning == 0)
+        return;
+    phiWind = windCoefficient*pow(windSpeed, windExponent);
+
+    static const int offsetX[8] = {-1, 0, 1, -1, 1, -1, 0, 1};
+    static const int offsetY[8] = {-1, -1, -1, 0, 0, 1, 1, 1};
+    static const float diagonal = sqrt(2.0f);
+
+    // Only the burning cells and their neighbours can change
+    int minX = std::max(activeMinX-1, 0);
+    int minY = std::max(activeMinY-1, 0);
+    int maxX = std::min(activeMaxX+1, cols-1);
+    int maxY = std::min(activeMaxY+1, rows-1);
+    activeMinX = cols;
+    activeMinY = rows;
+    activeMaxX = -1;
+    activeMaxY = -1;
+    numBurning = 0;
+    for (int j = minY; j <= maxY; j++){
+        for (int i = minX; i <= maxX; i++){
+            int c = j*cols+i;
+            unsigned char s = state[c];
+            if (s == CELL_BURNING){
+                fuel[c] -= burnRate;
+                if (fuel[c] <= 0){
+                    fuel[c] = 0;
+                    nextState[c] = CELL_BURNED;
+                    numBurned++;
+                    continue;
+                }
+            } else if (s == CELL_UNBURNED){
+                // Gather the fire coming from the burning neighbours
+                for (int n = 0; n < 8; n++){
+                    int ni = i+offsetX[n];
+                    int nj = j+offsetY[n];
+                    if (ni < 0 || nj < 0 || ni >= cols || nj >= rows)
+                        continue;
+                    int from = nj*cols+ni;
+                    if (state[from] != CELL_BURNING)
+                        continue;
+                    float distance = (offsetX[n] != 0 && offsetY[n] != 0) ? diagonal : 1.0f;
+                    progress[c] += spreadRate(from, c, -offsetX[n]/distance, -offsetY[n]/distance)/distance;
+                }
+                if (progress[c] < 1)
+                    continue;
+                nextState[c] = CELL_BURNING;
+                ignitionStep[c] = step;
+            } else {
+                continue;
+            }
+            numBurning++;
+            activeMinX = std::min(activeMinX, i);
+            activeMinY = std::min(activeMinY, j);
+            activeMaxX = std::max(activeMaxX, i);
+            activeMaxY = std::max(activeMaxY, j);
+        }
+    }
+    for (int j = minY; j <= maxY; j++){
+        std::copy(nextState.begin()+j*cols+minX, nextState.begin()+j*cols+maxX+1, state.begin()+j*cols+minX);
+    }
+    step++;
+}
+
+/**
+ * @fn	void FireGrid::draw()
+ *
+ * @brief	Draws the burning and burned cells in projector coordinates.
+ *
+ */
+
+void FireGrid::draw(){
+    if (cols*rows == 0)
+        return;
+    updateTexture();
+    ofSetColor(255);
+    mesh.draw(*kinectProjector, texture);
+}
+
+void FireGrid::updateTexture(){
+    unsigned char* pixels = colors.getData();
+    for (size_t c = 0; c < state.size(); c++, pixels += 4){
+        if (state[c] == CELL_BURNING){
+            // From yellow when the cell catches fire to red when its fuel runs out
+            pixels[0] = 255;
+            pixels[1] = static_cast<unsigned char>(64+160*fuel[c]);
+            pixels[2] = 0;
+            pixels[3] = 230;
+        } else if (state[c] == CELL_BURNED){
+            pixels[0] = 30;
+            pixels[1] = 20;
+            pixels[2] = 15;
+            pixels[3] = 200;
+        } else {
+            pixels[0] = 0;
+            pixels[1] = 0;
+            pixels[2] = 0;
+            pixels[3] = 0;
+        }
+    }
+    texture.loadData(colors);
+}
@@ -0,0 +1,102 @@
+/***********************************************************************
+FireGrid.h - cellular automaton fire spread over the sandbox
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#pragma once
+#include "ofMain.h"
+
+#include "KinectProjector/KinectProjector.h"
+#include "SurfaceMesh.h"
+
+// Raster alternative to the Fire agents: each cell of the kinect ROI holds its
+// fuel, ignition time and burn state. A cell ignites when the fire coming from
+// its burning neighbours has travelled the distance between the cell centers,
+// at a rate of spread modulated by the wind and the slope in the Rothermel way:
+// R = R0 * (1 + phiWind) * (1 + phiSlope).
+class FireGrid {
+public:
+    enum CellState
+    {
+        CELL_UNBURNED,
+        CELL_BURNING,
+        CELL_BURNED,
+        CELL_NONBURNABLE // Water
+    };
+
+    FireGrid(std::shared_ptr<KinectProjector> const& k);
+
+    void reset(ofRectangle skinectROI, int scellSize);
+    void clear();
+
+    void setWind(float swindSpeed, float swindDirection);
+    void ignite(ofVec2f kinectCoord); // Set the cells around a kinect point on fire
+
+    void update();
+    void draw(); // In projector coordinates
+
+    int getNumBurningCells() const {
+        return numBurning;
+    }
+    int getNumBurnedCells() const {
+        return numBurned;
+    }
+    float getBurnedFraction() const; // Burned or burning cells over the burnable ones
+
+private:
+    void updateTerrain(); // If the elevation map changed since the last update
+    float spreadRate(int from, int to, float dx, float dy) const; // Cells per step along the unit direction dx, dy
+    void updateTexture();
+
+    std::shared_ptr<KinectProjector> kinectProjector;
+    ofRectangle kinectROI;
+    int cellSize; // Kinect pixels per cell side
+    int cols, rows;
+    int step;
+
+    // Cell planes, row major
+    vector<unsigned char> state, nextState;
+    vector<float> fuel; // Remaining fuel, 1 when unburned
+    vector<float> progress; // Fraction of the distance travelled by the incoming fire
+    vector<int> ignitionStep; // Step at which the cell caught fire, -1 if it did not
+    vector<float> elevation;
+    vector<ofVec2f> gradient; // Terrain analysis gradient at the cell centers, elevation per kinect pixel
+    unsigned long long terrainGeneration; // Generation of the elevation map read by the last updateTerrain()
+    bool terrainValid; // False when the cell states have to be checked against the terrain again
+
+    // Bounding box of the burning cells, the sweep is limited to it
+    int activeMinX, activeMinY, activeMaxX, activeMaxY;
+    int numBurning, numBurned, numBurnable;
+
+    // Spread parameters
+    float baseRate; // Rate of spread without wind and slope, in kinect pixels per step
+    float windCoefficient, windExponent; // phiWind = windCoefficient*windSpeed^windExponent*cos(angle to the wind)
+    float slopeCoefficient; // phiSlope = slopeCoefficient*tan(slope)^2 uphill
+    float burnRate; // Fuel consumed per step
+    float windSpeed;
+    float phiWind; // Wind factor of the current step
+    ofVec2f windVector; // Unit vector toward which the wind blows
+    float cellPitch; // World distance between two neighbouring cell centers
+
+    // Drawing
+    ofPixels colors;
+    ofTexture texture;
+    SurfaceMesh mesh;
+    int meshStep; // Cells between two mesh vertices
+};
@@ -0,0 +1,123 @@
+/***********************************************************************
+FlameRenderer.cpp - instanced drawing of the fire agents
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "FlameRenderer.h"
+
+FlameRenderer::FlameRenderer()
+:instancing(false),
+instanceLocation(-1)
+{
+}
+
+/**
+ * @fn	void FlameRenderer::setup()
+ *
+ * @brief	Tessellates the flame shape, loads the shader and uploads the shape to the vbo.
+ *
+ */
+
+void FlameRenderer::setup(){
+    // The flame drawn by the fire agents: three arcs, scaled by 2
+    float sc = 2;
+    ofPath flame;
+    flame.arc(0, -3 * sc, 3 * sc, 3 * sc, 90, 270);
+    flame.arc(0, -5 * sc, sc, sc, 90, 270);
+    flame.arc(0, -2 * sc, 2 * sc, 2 * sc, 270, 90);
+    ofMesh tessellation = flame.getTessellation();
+    shape.clear();
+    if (tessellation.getNumIndices() > 0){
+        for (auto index : tessellation.getIndices())
+            shape.push_back(tessellation.getVertices()[index]);
+    } else {
+        for (auto & vertex : tessellation.getVertices())
+            shape.push_back(vertex);
+    }
+    instances.reserve(4*4096);
+
+    instancing = false;
+#ifndef TARGET_OPENGLES
+    if (glewIsSupported("GL_VERSION_3_3") || glewIsSupported("GL_ARB_instanced_arrays")){
+        bool loaded;
+        if (ofIsGLProgrammableRenderer()){
+            ofLogVerbose("FlameRenderer") << "setup(): Loading shadersGL3/flameShader";
+            loaded = shader.load("shaders/shadersGL3/flameShader");
+        } else {
+            ofLogVerbose("FlameRenderer") << "setup(): Loading shadersGL2/flameShader";
+            loaded = shader.load("shaders/shadersGL2/flameShader");
+        }
+        instanceLocation = loaded ? shader.getAttributeLocation("instance") : -1;
+        instancing = instanceLocation >= 0;
+    }
+#endif
+    if (instancing){
+        vbo.setVertexData(shape.data(), static_cast<int>(shape.size()), GL_STATIC_DRAW);
+    } else {
+        ofLogVerbose("FlameRenderer") << "setup(): No instancing, the flames are batched on the CPU";
+    }
+}
+
+void FlameRenderer::clear(){
+    instances.clear();
+}
+
+/**
+ * @fn	void FlameRenderer::draw()
+ *
+ * @brief	Draws the flames added since the last clear() with one draw call.
+ *
+ */
+
+void FlameRenderer::draw(){
+    if (instances.empty() || shape.empty())
+        return;
+    if (instancing)
+        drawInstanced();
+    else
+        drawBatched();
+}
+
+void FlameRenderer::drawInstanced(){
+    vbo.setAttributeData(instanceLocation, &instances[0].x, 4, static_cast<int>(instances.size()), GL_STREAM_DRAW);
+    vbo.setAttributeDivisor(instanceLocation, 1);
+    shader.begin();
+    vbo.drawInstanced(GL_TRIANGLES, 0, static_cast<int>(shape.size()), static_cast<int>(instances.size()));
+    shader.end();
+}
+
+void FlameRenderer::drawBatched(){
+    batch.clear();
+    batch.setMode(OF_PRIMITIVE_TRIANGLES);
+    batch.getVertices().reserve(instances.size()*shape.size());
+    batch.getColors().reserve(instances.size()*shape.size());
+    for (auto & instance : instances){
+        float radian = ofDegToRad(instance.z);
+        float c = cos(radian);
+        float s = sin(radian);
+        // Same color as the flame shader: orange fading to black with the intensity
+        float intensityFactor = instance.w <= 0 ? 0 : instance.w * 0.33f;
+        ofFloatColor color(intensityFactor, 0.25f * intensityFactor, 0);
+        for (auto & vertex : shape){
+            batch.addVertex(ofVec3f(instance.x + c*vertex.x - s*vertex.y, instance.y + s*vertex.x + c*vertex.y, 0));
+            batch.addColor(color);
+        }
+    }
+    batch.draw();
+}
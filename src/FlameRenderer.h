@@ -0,0 +1,58 @@
+/***********************************************************************
+FlameRenderer.h - instanced drawing of the fire agents
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#pragma once
+#include "ofMain.h"
+
+// Draws all the flames of a frame with a single draw call. The flame shape
+// is tessellated once into a vbo, each flame only adds its projector
+// position, angle and intensity to the instance buffer. Without instancing
+// support (GLES or GL < 3.3 without ARB_instanced_arrays) the flames are
+// transformed on the CPU into a single mesh.
+class FlameRenderer {
+public:
+    FlameRenderer();
+
+    void setup(); // Needs a GL context
+
+    void clear(); // Start a new batch
+    void add(ofVec2f projectorCoord, float angle, int intensity) {
+        instances.push_back(ofVec4f(projectorCoord.x, projectorCoord.y, angle, intensity));
+    }
+    void draw(); // Draw the flames in the order they were added
+
+    size_t size() const {
+        return instances.size();
+    }
+
+private:
+    void drawInstanced();
+    void drawBatched();
+
+    vector<ofVec2f> shape; // Triangles of the flame around (0, 0), pointing up
+    vector<ofVec4f> instances; // x, y: projector coordinate, z: angle in degrees, w: intensity
+
+    bool instancing;
+    ofVbo vbo;
+    ofShader shader;
+    int instanceLocation;
+    ofMesh batch; // Fallback without instancing
+};
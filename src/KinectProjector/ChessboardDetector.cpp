@@ -0,0 +1,163 @@
+/***********************************************************************
+ChessboardDetector - ChessboardDetector searches the calibration
+chessboard in the kinect color frames on a background thread.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#include "ChessboardDetector.h"
+
+ChessboardDetector::ChessboardDetector()
+:patternSize(4, 2),
+hasAffine(false)
+{
+}
+
+/**
+ * @fn	void ChessboardDetector::start(const ofPixels& colorFrame, ofRectangle window)
+ *
+ * @brief	Starts the search of the chessboard in a window of a color frame,
+ * 			the window is copied so the frame can change meanwhile.
+ *
+ * @param	colorFrame	The kinect color frame.
+ * @param	window	  	The part of the frame to search.
+ */
+
+void ChessboardDetector::start(const ofPixels& colorFrame, ofRectangle window){
+    ofRectangle frame(0, 0, colorFrame.getWidth(), colorFrame.getHeight());
+    window = window.getIntersection(frame);
+    if (window.isEmpty())
+        window = frame;
+    cv::Rect rect(static_cast<int>(window.x), static_cast<int>(window.y), static_cast<int>(window.width), static_cast<int>(window.height));
+    window.set(rect.x, rect.y, rect.width, rect.height); // Whole pixels, the corners are offset by the window
+    ofPixels pixels = colorFrame;
+    cv::Mat image = ofxCv::toCv(pixels)(rect).clone();
+    pending = std::async(std::launch::async, &ChessboardDetector::detect, image, patternSize, window);
+}
+
+bool ChessboardDetector::getResult(Result& result){
+    if (!pending.valid() || pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return false;
+    result = pending.get();
+    return true;
+}
+
+ChessboardDetector::Result ChessboardDetector::detect(cv::Mat image, cv::Size patternSize, ofRectangle window){
+    Result result;
+    result.window = window;
+    int chessFlags = cv::CALIB_CB_ADAPTIVE_THRESH + cv::CALIB_CB_FAST_CHECK;
+    result.found = findChessboardCorners(image, patternSize, result.corners, chessFlags);
+    if (result.found){
+        cv::Mat gray;
+        cvtColor(image, gray, CV_RGB2GRAY);
+        cornerSubPix(gray, result.corners, cv::Size(11, 11), cv::Size(-1, -1),
+                     cv::TermCriteria(CV_TERMCRIT_EPS + CV_TERMCRIT_ITER, 30, 0.1));
+        for (auto & corner : result.corners){
+            corner.x += window.x;
+            corner.y += window.y;
+        }
+    }
+    return result;
+}
+
+void ChessboardDetector::clearCorrespondences(){
+    projectorPoints.clear();
+    kinectPoints.clear();
+    hasAffine = false;
+}
+
+/**
+ * @fn	void ChessboardDetector::addCorrespondences(const vector<ofVec2f>& sprojectorPoints, const vector<cv::Point2f>& skinectPoints)
+ *
+ * @brief	Adds the corners of a chessboard found and refits the projector to
+ * 			kinect map used by the window prediction.
+ *
+ * @param	sprojectorPoints	The corners in projector coordinates.
+ * @param	skinectPoints   	The corners found in the kinect image.
+ */
+
+void ChessboardDetector::addCorrespondences(const vector<ofVec2f>& sprojectorPoints, const vector<cv::Point2f>& skinectPoints){
+    size_t count = std::min(sprojectorPoints.size(), skinectPoints.size());
+    for (size_t i = 0; i < count; i++){
+        projectorPoints.push_back(sprojectorPoints[i]);
+        kinectPoints.push_back(ofVec2f(skinectPoints[i].x, skinectPoints[i].y));
+    }
+    hasAffine = fitAffine();
+}
+
+bool ChessboardDetector::fitAffine(){
+    // Least squares: normal equations of (px, py, 1) for each kinect coordinate
+    double n[3][3] = {{0}};
+    double b[2][3] = {{0}};
+    for (size_t i = 0; i < projectorPoints.size(); i++){
+        double p[3] = {projectorPoints[i].x, projectorPoints[i].y, 1};
+        for (int r = 0; r < 3; r++){
+            for (int c = 0; c < 3; c++)
+                n[r][c] += p[r]*p[c];
+            b[0][r] += p[r]*kinectPoints[i].x;
+            b[1][r] += p[r]*kinectPoints[i].y;
+        }
+    }
+    double det = n[0][0]*(n[1][1]*n[2][2]-n[1][2]*n[2][1])-n[0][1]*(n[1][0]*n[2][2]-n[1][2]*n[2][0])+n[0][2]*(n[1][0]*n[2][1]-n[1][1]*n[2][0]);
+    if (std::abs(det) < 1e-6)
+        return false;
+    // Cramer's rule
+    for (int k = 0; k < 2; k++){
+        for (int c = 0; c < 3; c++){
+            double m[3][3];
+            for (int r = 0; r < 3; r++)
+                for (int j = 0; j < 3; j++)
+                    m[r][j] = j == c ? b[k][r] : n[r][j];
+            double detc = m[0][0]*(m[1][1]*m[2][2]-m[1][2]*m[2][1])-m[0][1]*(m[1][0]*m[2][2]-m[1][2]*m[2][0])+m[0][2]*(m[1][0]*m[2][1]-m[1][1]*m[2][0]);
+            affine[k][c] = static_cast<float>(detc/det);
+        }
+    }
+    return true;
+}
+
+/**
+ * @fn	ofRectangle ChessboardDetector::predictWindow(ofRectangle projectorRect, ofRectangle projectorArea, ofRectangle kinectROI, ofRectangle frame) const
+ *
+ * @brief	Predicts where a chessboard drawn by the projector appears in the
+ * 			kinect image, with a margin of one chessboard on each side.
+ *
+ * @param	projectorRect	The chessboard in projector coordinates.
+ * @param	projectorArea	The projector image.
+ * @param	kinectROI	 	The sand ROI, used before the first chessboard is found.
+ * @param	frame		 	The kinect image.
+ *
+ * @return	The window to search.
+ */
+
+ofRectangle ChessboardDetector::predictWindow(ofRectangle projectorRect, ofRectangle projectorArea, ofRectangle kinectROI, ofRectangle frame) const{
+    ofRectangle window;
+    ofVec2f corners[4] = {projectorRect.getTopLeft(), projectorRect.getTopRight(), projectorRect.getBottomRight(), projectorRect.getBottomLeft()};
+    for (int i = 0; i < 4; i++){
+        ofVec2f p;
+        if (hasAffine){
+            p.x = affine[0][0]*corners[i].x+affine[0][1]*corners[i].y+affine[0][2];
+            p.y = affine[1][0]*corners[i].x+affine[1][1]*corners[i].y+affine[1][2];
+        } else {
+            p.x = kinectROI.x+(corners[i].x-projectorArea.x)/projectorArea.width*kinectROI.width;
+            p.y = kinectROI.y+(corners[i].y-projectorArea.y)/projectorArea.height*kinectROI.height;
+        }
+        if (i == 0)
+            window.set(p, 0, 0);
+        else
+            window.growToInclude(p);
+    }
+    window.scaleFromCenter(3); // The chessboard may be off by its own size
+    window = window.getIntersection(frame);
+    return window.isEmpty() ? frame : window;
+}
@@ -0,0 +1,66 @@
+/***********************************************************************
+ChessboardDetector - ChessboardDetector searches the calibration
+chessboard in the kinect color frames on a background thread.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#pragma once
+#include "ofMain.h"
+#include "ofxCv.h"
+#include <future>
+
+// A search runs on a copy of the frame cropped to a window, the result is
+// collected later through a future so that the main loop is not stalled.
+// The window is predicted from the projector position of the chessboard:
+// an affine map from the projector to the kinect image is fitted on the
+// corners already found, before the first chessboard the projector is
+// assumed to cover the sand ROI.
+class ChessboardDetector {
+public:
+    struct Result {
+        bool found;
+        vector<cv::Point2f> corners; // Kinect image coordinates, refined to subpixel
+        ofRectangle window; // Searched part of the frame
+    };
+
+    ChessboardDetector();
+
+    void setPatternSize(int cols, int rows){ // Inner corners
+        patternSize = cv::Size(cols, rows);
+    }
+
+    // Search a frame in the background, one search at a time
+    void start(const ofPixels& colorFrame, ofRectangle window);
+    bool isBusy() const {
+        return pending.valid();
+    }
+    bool getResult(Result& result); // False while the search is running
+
+    // Window prediction
+    void clearCorrespondences();
+    void addCorrespondences(const vector<ofVec2f>& projectorPoints, const vector<cv::Point2f>& kinectPoints);
+    ofRectangle predictWindow(ofRectangle projectorRect, ofRectangle projectorArea, ofRectangle kinectROI, ofRectangle frame) const;
+
+private:
+    static Result detect(cv::Mat image, cv::Size patternSize, ofRectangle window);
+    bool fitAffine(); // Projector to kinect image, false if the points are degenerate
+
+    cv::Size patternSize;
+    std::future<Result> pending;
+
+    vector<ofVec2f> projectorPoints, kinectPoints;
+    bool hasAffine;
+    float affine[2][3]; // kinect = affine*(projector, 1)
+};
@@ -0,0 +1,515 @@
+/***********************************************************************
+DepthRecording - Recording of raw kinect frames to a chunked file and
+deterministic replay of the recordings.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#include "DepthRecording.h"
+#include <cstring>
+
+#ifdef TARGET_WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const char recordingMagic[8] = {'M', 'S', 'D', 'E', 'P', 'T', 'H', '1'};
+    const char chunkMagic[4] = {'F', 'R', 'A', 'M'};
+    const uint32_t recordingVersion = 2;
+    const uint32_t keyframeInterval = 30; // Frames between two keyframes, one second at the kinect rate
+
+    // Depth encoding, see DepthRecording.h
+    const size_t maxZeroRun = 0xffff;
+    const size_t maxLiteralRun = 0x7fff;
+    const size_t minZeroRun = 4; // Shorter runs of unchanged pixels are cheaper as literals
+    const uint16_t wideLiterals = 0x8000;
+
+    uint64_t getChunkSize(uint32_t width, uint32_t height, uint32_t colorChannels, uint32_t depthSize, bool hasColor){
+        uint64_t size = sizeof(ChunkHeader) + depthSize;
+        if (hasColor)
+            size += uint64_t(width)*height*colorChannels;
+        return (size+7)/8*8;
+    }
+
+    size_t getMaxEncodedDepthSize(size_t size){
+        // Each run covers one pixel or more, with a 4 byte run header and at most 2 bytes per pixel
+        return 6*size;
+    }
+
+    uint16_t getDepthDifference(const uint16_t* depth, const uint16_t* previous, size_t i){
+        return previous != 0 ? uint16_t(depth[i]-previous[i]) : depth[i];
+    }
+
+    bool isNarrow(uint16_t difference){
+        int16_t signedDifference = static_cast<int16_t>(difference);
+        return signedDifference >= -128 && signedDifference <= 127;
+    }
+
+    /**
+     * @fn	size_t encodeDepth(const uint16_t* depth, const uint16_t* previous, size_t size, unsigned char* out)
+     *
+     * @brief	Run length encodes the differences of a depth frame to the previous one.
+     *
+     * @param 		  	depth   	The depth frame.
+     * @param 		  	previous	The previous depth frame, null for a keyframe.
+     * @param 		  	size		The number of pixels.
+     * @param [out]	out			At least getMaxEncodedDepthSize(size) bytes.
+     *
+     * @return	The size of the encoded frame.
+     */
+
+    size_t encodeDepth(const uint16_t* depth, const uint16_t* previous, size_t size, unsigned char* out){
+        unsigned char* o = out;
+        size_t i = 0;
+        while (i < size){
+            size_t zeros = 0;
+            while (i < size && zeros < maxZeroRun && getDepthDifference(depth, previous, i) == 0){
+                zeros++;
+                i++;
+            }
+            // The literals stop before the next long enough run of unchanged pixels, or
+            // where the differences change of width: the sensor dropouts are wide
+            bool narrow = i < size && isNarrow(getDepthDifference(depth, previous, i));
+            size_t end = i;
+            size_t streak = 0;
+            while (end < size && end-i < maxLiteralRun){
+                uint16_t difference = getDepthDifference(depth, previous, end);
+                if (isNarrow(difference) != narrow)
+                    break;
+                streak = difference == 0 ? streak+1 : 0;
+                end++;
+                if (streak == minZeroRun){
+                    end -= minZeroRun;
+                    break;
+                }
+            }
+            uint16_t run[2] = {static_cast<uint16_t>(zeros), static_cast<uint16_t>((end-i) | (narrow ? 0 : wideLiterals))};
+            memcpy(o, run, sizeof(run));
+            o += sizeof(run);
+            for (; i < end; i++){
+                uint16_t difference = getDepthDifference(depth, previous, i);
+                if (narrow){
+                    *o++ = static_cast<unsigned char>(difference);
+                } else {
+                    memcpy(o, &difference, sizeof(difference));
+                    o += sizeof(difference);
+                }
+            }
+        }
+        return o-out;
+    }
+
+    /**
+     * @fn	bool decodeDepth(const unsigned char* in, size_t inSize, uint16_t* depth, size_t size, bool keyframe)
+     *
+     * @brief	Decodes a depth frame encoded by encodeDepth().
+     *
+     * @param 		  	in			The encoded frame.
+     * @param 		  	inSize  	The size of the encoded frame.
+     * @param [in,out]	depth   	The previous frame, replaced by the decoded one.
+     * @param 		  	size		The number of pixels.
+     * @param 		  	keyframe	True if the frame was encoded without a previous frame.
+     *
+     * @return	False if the encoded frame is corrupted.
+     */
+
+    bool decodeDepth(const unsigned char* in, size_t inSize, uint16_t* depth, size_t size, bool keyframe){
+        const unsigned char* inEnd = in + inSize;
+        size_t i = 0;
+        while (i < size){
+            uint16_t run[2];
+            if (size_t(inEnd-in) < sizeof(run))
+                return false;
+            memcpy(run, in, sizeof(run));
+            in += sizeof(run);
+            size_t zeros = run[0];
+            size_t count = run[1] & ~wideLiterals;
+            bool narrow = (run[1] & wideLiterals) == 0;
+            if (zeros + count > size - i || size_t(inEnd-in) < count*(narrow ? 1 : 2))
+                return false;
+            if (keyframe)
+                std::fill(depth+i, depth+i+zeros, 0);
+            i += zeros;
+            for (size_t end = i+count; i < end; i++){
+                uint16_t difference;
+                if (narrow){
+                    difference = static_cast<uint16_t>(static_cast<int8_t>(*in++));
+                } else {
+                    memcpy(&difference, in, sizeof(difference));
+                    in += sizeof(difference);
+                }
+                depth[i] = keyframe ? difference : uint16_t(depth[i]+difference);
+            }
+        }
+        return in == inEnd;
+    }
+}
+
+MappedFile::MappedFile()
+:data(0),
+size(0)
+#ifdef TARGET_WIN32
+,fileHandle(INVALID_HANDLE_VALUE),
+mappingHandle(0)
+#endif
+{
+}
+
+MappedFile::~MappedFile(){
+    close();
+}
+
+bool MappedFile::open(const string& path){
+    close();
+#ifdef TARGET_WIN32
+    fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0){
+        close();
+        return false;
+    }
+    size = static_cast<size_t>(fileSize.QuadPart);
+    mappingHandle = CreateFileMappingA(fileHandle, 0, PAGE_WRITECOPY, 0, 0, 0);
+    if (mappingHandle == 0){
+        close();
+        return false;
+    }
+    data = static_cast<unsigned char*>(MapViewOfFile(mappingHandle, FILE_MAP_COPY, 0, 0, 0));
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0){
+        ::close(fd);
+        return false;
+    }
+    size = static_cast<size_t>(fileStat.st_size);
+    void* mapping = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd); // The mapping keeps the file open
+    data = mapping == MAP_FAILED ? 0 : static_cast<unsigned char*>(mapping);
+#endif
+    if (data == 0){
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close(){
+#ifdef TARGET_WIN32
+    if (data != 0)
+        UnmapViewOfFile(data);
+    if (mappingHandle != 0)
+        CloseHandle(mappingHandle);
+    if (fileHandle != INVALID_HANDLE_VALUE)
+        CloseHandle(fileHandle);
+    mappingHandle = 0;
+    fileHandle = INVALID_HANDLE_VALUE;
+#else
+    if (data != 0)
+        munmap(data, size);
+#endif
+    data = 0;
+    size = 0;
+}
+
+RecordingDepthSource::RecordingDepthSource(std::shared_ptr<DepthSource> ssource, const string& spath, bool srecordColor)
+:source(ssource),
+path(spath),
+recordColor(srecordColor),
+file(0),
+startTime(0),
+frameIndex(0)
+{
+}
+
+RecordingDepthSource::~RecordingDepthSource(){
+    stopRecording();
+}
+
+bool RecordingDepthSource::setup(){
+    return source->setup();
+}
+
+bool RecordingDepthSource::open(){
+    if (!source->open())
+        return false;
+    if (!startRecording())
+        ofLogError("RecordingDepthSource") << "open(): Cannot create recording file " << path;
+    return true;
+}
+
+void RecordingDepthSource::close(){
+    source->close();
+    stopRecording();
+}
+
+void RecordingDepthSource::update(){
+    source->update();
+    if (file != 0 && source->isFrameNew())
+        writeFrame();
+}
+
+bool RecordingDepthSource::isFrameNew(){
+    return source->isFrameNew();
+}
+
+int RecordingDepthSource::getWidth() const{
+    return source->getWidth();
+}
+
+int RecordingDepthSource::getHeight() const{
+    return source->getHeight();
+}
+
+const ofShortPixels& RecordingDepthSource::getRawDepthPixels(){
+    return source->getRawDepthPixels();
+}
+
+const ofPixels& RecordingDepthSource::getPixels(){
+    return source->getPixels();
+}
+
+ofVec3f RecordingDepthSource::getWorldCoordinateAt(int x, int y, float z){
+    return source->getWorldCoordinateAt(x, y, z);
+}
+
+bool RecordingDepthSource::startRecording(){
+    stopRecording();
+    ofFilePath::createEnclosingDirectory(path, false);
+    file = fopen(path.c_str(), "wb");
+    if (file == 0)
+        return false;
+    // A large stdio buffer: frames are written with a few big sequential writes
+    writeBuffer.resize(8*1024*1024);
+    setvbuf(file, &writeBuffer[0], _IOFBF, writeBuffer.size());
+
+    RecordingHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, recordingMagic, sizeof(header.magic));
+    header.version = recordingVersion;
+    header.width = source->getWidth();
+    header.height = source->getHeight();
+    header.colorChannels = 3;
+    ofVec3f a = source->getWorldCoordinateAt(0, 0, 1);// Kinect internal parameters, see KinectGrabber::getWorldMatrix()
+    ofVec3f b = source->getWorldCoordinateAt(1, 1, 1);
+    header.worldOffset[0] = a.x;
+    header.worldOffset[1] = a.y;
+    header.worldScale[0] = b.x - a.x;
+    header.worldScale[1] = b.y - a.y;
+    fwrite(&header, sizeof(header), 1, file);
+
+    startTime = ofGetElapsedTimeMicros();
+    frameIndex = 0;
+    ofLogVerbose("RecordingDepthSource") << "startRecording(): Recording to " << path;
+    return true;
+}
+
+void RecordingDepthSource::stopRecording(){
+    if (file != 0){
+        fclose(file);
+        file = 0;
+        ofLogVerbose("RecordingDepthSource") << "stopRecording(): " << frameIndex << " frames recorded";
+    }
+}
+
+void RecordingDepthSource::writeFrame(){
+    const ofShortPixels& depth = source->getRawDepthPixels();
+    const ofPixels& color = source->getPixels();
+    uint32_t width = source->getWidth();
+    uint32_t height = source->getHeight();
+    bool hasColor = recordColor && color.getWidth() == width && color.getHeight() == height && color.getNumChannels() == 3;
+    if (depth.getWidth() != width || depth.getHeight() != height)
+        return;
+
+    /* Encode the differences to the previous frame, or the frame itself for a keyframe: */
+    size_t numPixels = size_t(width)*height;
+    bool keyframe = frameIndex % keyframeInterval == 0 || previousDepth.size() != numPixels;
+    encodedDepth.resize(getMaxEncodedDepthSize(numPixels));
+    size_t depthSize = encodeDepth(depth.getData(), keyframe ? 0 : previousDepth.data(), numPixels, encodedDepth.data());
+    previousDepth.assign(depth.getData(), depth.getData() + numPixels);
+
+    ChunkHeader chunk;
+    memset(&chunk, 0, sizeof(chunk));
+    memcpy(chunk.magic, chunkMagic, sizeof(chunk.magic));
+    chunk.flags = (hasColor ? ChunkHeader::CHUNK_HAS_COLOR : 0) | (keyframe ? ChunkHeader::CHUNK_KEYFRAME : 0);
+    chunk.timestamp = ofGetElapsedTimeMicros() - startTime;
+    chunk.chunkSize = getChunkSize(width, height, 3, depthSize, hasColor);
+    chunk.frameIndex = frameIndex++;
+    chunk.depthSize = depthSize;
+
+    size_t colorSize = hasColor ? numPixels*3 : 0;
+    static const char padding[8] = {0};
+    size_t paddingSize = chunk.chunkSize - sizeof(chunk) - depthSize - colorSize;
+    bool written = fwrite(&chunk, sizeof(chunk), 1, file) == 1 && fwrite(encodedDepth.data(), 1, depthSize, file) == depthSize;
+    if (written && hasColor)
+        written = fwrite(color.getData(), 1, colorSize, file) == colorSize;
+    if (written)
+        written = fwrite(padding, 1, paddingSize, file) == paddingSize;
+    if (!written){
+        ofLogError("RecordingDepthSource") << "writeFrame(): Cannot write to " << path << ", recording stopped";
+        stopRecording();
+    }
+}
+
+ReplayDepthSource::ReplayDepthSource(const string& spath, bool srealtime, bool sloop)
+:path(spath),
+realtime(srealtime),
+loop(sloop),
+currentFrame(-1),
+decodedFrame(-1),
+frameNew(false),
+startTime(0)
+{
+    memset(&header, 0, sizeof(header));
+}
+
+bool ReplayDepthSource::setup(){
+    chunks.clear();
+    if (!mappedFile.open(path)){
+        ofLogError("ReplayDepthSource") << "setup(): Cannot open recording " << path;
+        return false;
+    }
+    size_t size = mappedFile.getSize();
+    unsigned char* data = mappedFile.getData();
+    if (size < sizeof(RecordingHeader)){
+        ofLogError("ReplayDepthSource") << "setup(): Truncated recording " << path;
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, recordingMagic, sizeof(header.magic)) != 0 || header.version != recordingVersion){
+        ofLogError("ReplayDepthSource") << "setup(): " << path << " is not a depth recording";
+        return false;
+    }
+
+    /* Build the index of the frames, a truncated last frame is ignored: */
+    size_t offset = sizeof(RecordingHeader);
+    while (offset + sizeof(ChunkHeader) <= size){
+        ChunkHeader* chunk = reinterpret_cast<ChunkHeader*>(data + offset);
+        bool hasColor = (chunk->flags & ChunkHeader::CHUNK_HAS_COLOR) != 0;
+        if (memcmp(chunk->magic, chunkMagic, sizeof(chunk->magic)) != 0 ||
+            chunk->chunkSize != getChunkSize(header.width, header.height, header.colorChannels, chunk->depthSize, hasColor) ||
+            chunk->chunkSize > size - offset ||
+            (chunks.empty() && !(chunk->flags & ChunkHeader::CHUNK_KEYFRAME)))
+            break;
+        chunks.push_back(chunk);
+        offset += chunk->chunkSize;
+    }
+    ofLogVerbose("ReplayDepthSource") << "setup(): " << path << ": " << header.width << "x" << header.height << ", " << chunks.size() << " frames";
+
+    depthPixels.allocate(header.width, header.height, 1);
+    depthPixels.set(0);
+    decodedFrame = -1;
+    colorPixels.allocate(header.width, header.height, OF_IMAGE_COLOR);
+    colorPixels.set(0);
+    return !chunks.empty();
+}
+
+bool ReplayDepthSource::open(){
+    if (chunks.empty())
+        return false;
+    currentFrame = -1;
+    startTime = ofGetElapsedTimeMicros();
+    return true;
+}
+
+void ReplayDepthSource::close(){
+    currentFrame = -1;
+}
+
+void ReplayDepthSource::update(){
+    frameNew = false;
+    if (chunks.empty())
+        return;
+    int numFrames = static_cast<int>(chunks.size());
+    int frame = currentFrame+1;
+    if (realtime){
+        /* Skip to the last frame recorded before the elapsed replay time: */
+        uint64_t elapsed = ofGetElapsedTimeMicros() - startTime;
+        uint64_t firstTimestamp = chunks[0]->timestamp;
+        if (frame >= numFrames && loop && elapsed > chunks[numFrames-1]->timestamp - firstTimestamp){
+            startTime = ofGetElapsedTimeMicros();
+            elapsed = 0;
+            frame = 0;
+        }
+        if (frame >= numFrames || chunks[frame]->timestamp - firstTimestamp > elapsed)
+            return;
+        while (frame+1 < numFrames && chunks[frame+1]->timestamp - firstTimestamp <= elapsed)
+            frame++;
+    } else if (frame >= numFrames){
+        if (!loop)
+            return;
+        frame = 0;
+    }
+    setFrame(frame);
+}
+
+void ReplayDepthSource::setFrame(int frame){
+    /* Decode from the last keyframe, or from the decoded frame if it is on the way: */
+    int first = frame;
+    while (!(chunks[first]->flags & ChunkHeader::CHUNK_KEYFRAME))
+        first--;
+    if (decodedFrame >= first && decodedFrame <= frame)
+        first = decodedFrame+1;
+    size_t numPixels = size_t(header.width)*header.height;
+    for (int f = first; f <= frame; f++){
+        ChunkHeader* chunk = chunks[f];
+        bool keyframe = (chunk->flags & ChunkHeader::CHUNK_KEYFRAME) != 0;
+        if (!decodeDepth(reinterpret_cast<unsigned char*>(chunk + 1), chunk->depthSize, depthPixels.getData(), numPixels, keyframe)){
+            ofLogError("ReplayDepthSource") << "setFrame(): Corrupted depth in frame " << f << " of " << path;
+            decodedFrame = -1;
+            return;
+        }
+        decodedFrame = f;
+    }
+    ChunkHeader* chunk = chunks[frame];
+    unsigned char* chunkData = reinterpret_cast<unsigned char*>(chunk + 1);
+    if (chunk->flags & ChunkHeader::CHUNK_HAS_COLOR)
+        colorPixels.setFromPixels(chunkData + chunk->depthSize, header.width, header.height, header.colorChannels);
+    currentFrame = frame;
+    frameNew = true;
+}
+
+bool ReplayDepthSource::isFrameNew(){
+    return frameNew;
+}
+
+int ReplayDepthSource::getWidth() const{
+    return header.width;
+}
+
+int ReplayDepthSource::getHeight() const{
+    return header.height;
+}
+
+const ofShortPixels& ReplayDepthSource::getRawDepthPixels(){
+    return depthPixels;
+}
+
+const ofPixels& ReplayDepthSource::getPixels(){
+    return colorPixels;
+}
+
+ofVec3f ReplayDepthSource::getWorldCoordinateAt(int x, int y, float z){
+    return ofVec3f((header.worldOffset[0] + x*header.worldScale[0])*z, (header.worldOffset[1] + y*header.worldScale[1])*z, z);
+}
@@ -0,0 +1,169 @@
+/***********************************************************************
+DepthRecording - Recording of raw kinect frames to a chunked file and
+deterministic replay of the recordings.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#pragma once
+#include "DepthSource.h"
+#include <cstdio>
+#include <stdint.h>
+
+/*
+Recording file layout (little endian):
+ - a RecordingHeader,
+ - one chunk per frame: a ChunkHeader followed by the encoded depth frame
+   (depthSize bytes) and, if CHUNK_HAS_COLOR is set, the color frame
+   (width*height*3 bytes), padded to a multiple of 8 bytes.
+
+The depth frame is encoded as runs of a 16 bit count of pixels equal to the
+previous frame, a 16 bit count of literals, then the literals: differences
+to the previous frame, in int8 or, if bit 15 of the count is set, in uint16.
+A CHUNK_KEYFRAME frame is encoded against a frame of zeros, and every
+keyframeInterval-th frame is a keyframe so that replay can seek.
+*/
+struct RecordingHeader {
+    char magic[8]; // "MSDEPTH1"
+    uint32_t version;
+    uint32_t width, height;
+    uint32_t colorChannels;
+    float worldOffset[2]; // World x and y at pixel (0, 0) and depth 1
+    float worldScale[2]; // World x and y increments per pixel at depth 1
+    uint32_t reserved[6];
+};
+
+struct ChunkHeader {
+    enum
+    {
+        CHUNK_HAS_COLOR = 1,
+        CHUNK_KEYFRAME = 2
+    };
+    char magic[4]; // "FRAM"
+    uint32_t flags;
+    uint64_t timestamp; // Microseconds since the start of the recording
+    uint64_t chunkSize; // Size of the chunk including this header
+    uint32_t frameIndex;
+    uint32_t depthSize; // Size of the encoded depth frame
+};
+
+// Copy-on-write memory mapping of a whole file: the mapped data can be
+// modified without changing the file
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool open(const string& path);
+    void close();
+
+    unsigned char* getData() {
+        return data;
+    }
+    size_t getSize() const {
+        return size;
+    }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    unsigned char* data;
+    size_t size;
+#ifdef TARGET_WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#endif
+};
+
+// Pass the frames of another source through and record them
+class RecordingDepthSource: public DepthSource {
+public:
+    RecordingDepthSource(std::shared_ptr<DepthSource> ssource, const string& spath, bool srecordColor);
+    ~RecordingDepthSource();
+
+    bool setup() override;
+    bool open() override;
+    void close() override;
+    void update() override;
+    bool isFrameNew() override;
+
+    int getWidth() const override;
+    int getHeight() const override;
+    const ofShortPixels& getRawDepthPixels() override;
+    const ofPixels& getPixels() override;
+    ofVec3f getWorldCoordinateAt(int x, int y, float z) override;
+    string getName() const override {
+        return "record";
+    }
+
+private:
+    bool startRecording();
+    void stopRecording();
+    void writeFrame();
+
+    std::shared_ptr<DepthSource> source;
+    string path;
+    bool recordColor;
+    FILE* file;
+    vector<char> writeBuffer;
+    vector<unsigned char> encodedDepth; // Encoded depth of the current frame
+    vector<uint16_t> previousDepth; // Raw depth of the previous frame, the reference of the differences
+    uint64_t startTime;
+    uint32_t frameIndex;
+};
+
+// Replay a recording, at the recorded speed or as fast as possible
+class ReplayDepthSource: public DepthSource {
+public:
+    ReplayDepthSource(const string& spath, bool srealtime, bool sloop);
+
+    bool setup() override;
+    bool open() override;
+    void close() override;
+    void update() override;
+    bool isFrameNew() override;
+
+    int getWidth() const override;
+    int getHeight() const override;
+    const ofShortPixels& getRawDepthPixels() override;
+    const ofPixels& getPixels() override;
+    ofVec3f getWorldCoordinateAt(int x, int y, float z) override;
+    string getName() const override {
+        return "replay";
+    }
+
+    int getNumFrames() const {
+        return static_cast<int>(chunks.size());
+    }
+    int getCurrentFrame() const {
+        return currentFrame;
+    }
+
+private:
+    void setFrame(int frame);
+
+    string path;
+    bool realtime;
+    bool loop;
+    MappedFile mappedFile;
+    RecordingHeader header;
+    vector<ChunkHeader*> chunks; // Index of the frames in the mapped file
+    int currentFrame;
+    int decodedFrame; // Frame held by depthPixels, -1 if none
+    bool frameNew;
+    uint64_t startTime; // Time at which the first frame was replayed
+    ofShortPixels depthPixels; // Decoded from the chunks, frame after frame
+    ofPixels colorPixels;
+};
@@ -0,0 +1,148 @@
+/***********************************************************************
+DepthSource - DepthSource provides the raw depth and color frames
+filtered by the kinect grabber: from a kinect, a recording or a
+synthetic generator.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#include "DepthSource.h"
+#include "DepthRecording.h"
+#include "SyntheticDepthSource.h"
+
+CaptureSettings::CaptureSettings()
+:mode(MODE_KINECT),
+file("recordings/sandbox.depth"),
+realtime(true),
+loop(true),
+lockstep(false),
+recordColor(true)
+{
+}
+
+CaptureSettings::Synthetic::Synthetic()
+:width(640),
+height(480),
+fps(30),
+seed(1),
+baseDepth(1000),
+hillHeight(150),
+hillSize(200),
+numLakes(2),
+numHands(1),
+noise(1.5f),
+dropouts(0.01f)
+{
+}
+
+bool CaptureSettings::load(const string& settingsFile){
+    ofXml xml;
+    if (!xml.load(settingsFile))
+        return false;
+    xml.setTo("CAPTURESETTINGS");
+    string smode = xml.getValue<string>("mode");
+    if (smode == "record"){
+        mode = MODE_RECORD;
+    } else if (smode == "replay"){
+        mode = MODE_REPLAY;
+    } else if (smode == "synthetic"){
+        mode = MODE_SYNTHETIC;
+    } else {
+        mode = MODE_KINECT;
+    }
+    if (xml.exists("file"))
+        file = xml.getValue<string>("file");
+    if (xml.exists("realtime"))
+        realtime = xml.getValue<bool>("realtime");
+    if (xml.exists("loop"))
+        loop = xml.getValue<bool>("loop");
+    if (xml.exists("lockstep"))
+        lockstep = xml.getValue<bool>("lockstep");
+    if (xml.exists("recordColor"))
+        recordColor = xml.getValue<bool>("recordColor");
+    if (xml.exists("synthetic")){
+        xml.setTo("synthetic");
+        synthetic.width = xml.getValue<int>("width", synthetic.width);
+        synthetic.height = xml.getValue<int>("height", synthetic.height);
+        synthetic.fps = xml.getValue<float>("fps", synthetic.fps);
+        synthetic.seed = xml.getValue<int>("seed", synthetic.seed);
+        synthetic.baseDepth = xml.getValue<float>("baseDepth", synthetic.baseDepth);
+        synthetic.hillHeight = xml.getValue<float>("hillHeight", synthetic.hillHeight);
+        synthetic.hillSize = xml.getValue<float>("hillSize", synthetic.hillSize);
+        synthetic.numLakes = xml.getValue<int>("lakes", synthetic.numLakes);
+        synthetic.numHands = xml.getValue<int>("hands", synthetic.numHands);
+        synthetic.noise = xml.getValue<float>("noise", synthetic.noise);
+        synthetic.dropouts = xml.getValue<float>("dropouts", synthetic.dropouts);
+        xml.setToParent();
+    }
+    return true;
+}
+
+std::shared_ptr<DepthSource> DepthSource::create(const CaptureSettings& settings){
+    switch (settings.mode){
+        case CaptureSettings::MODE_RECORD:
+            return std::make_shared<RecordingDepthSource>(std::make_shared<KinectDepthSource>(), ofToDataPath(settings.file), settings.recordColor);
+        case CaptureSettings::MODE_REPLAY:
+            return std::make_shared<ReplayDepthSource>(ofToDataPath(settings.file), settings.realtime, settings.loop);
+        case CaptureSettings::MODE_SYNTHETIC:
+            return std::make_shared<SyntheticDepthSource>(settings.synthetic);
+        default:
+            return std::make_shared<KinectDepthSource>();
+    }
+}
+
+bool KinectDepthSource::setup(){
+    kinect.init();
+    kinect.setRegistration(true); // To have correspondance between RGB and depth images
+    kinect.setUseTexture(false);
+    width = kinect.getWidth();
+    height = kinect.getHeight();
+    return true;
+}
+
+bool KinectDepthSource::open(){
+    return kinect.open();
+}
+
+void KinectDepthSource::close(){
+    kinect.close();
+}
+
+void KinectDepthSource::update(){
+    kinect.update();
+}
+
+bool KinectDepthSource::isFrameNew(){
+    return kinect.isFrameNew();
+}
+
+int KinectDepthSource::getWidth() const{
+    return width;
+}
+
+int KinectDepthSource::getHeight() const{
+    return height;
+}
+
+const ofShortPixels& KinectDepthSource::getRawDepthPixels(){
+    return kinect.getRawDepthPixels();
+}
+
+const ofPixels& KinectDepthSource::getPixels(){
+    return kinect.getPixels();
+}
+
+ofVec3f KinectDepthSource::getWorldCoordinateAt(int x, int y, float z){
+    return kinect.getWorldCoordinateAt(x, y, z);
+}
@@ -0,0 +1,104 @@
+/***********************************************************************
+DepthSource - DepthSource provides the raw depth and color frames
+filtered by the kinect grabber: from a kinect, a recording or a
+synthetic generator.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#pragma once
+#include "ofMain.h"
+#include "ofxKinect.h"
+
+// Capture source selection, read from settings/captureSettings.xml
+struct CaptureSettings {
+    enum Mode
+    {
+        MODE_KINECT, // Live kinect
+        MODE_RECORD, // Live kinect, frames are recorded to file
+        MODE_REPLAY, // Frames are replayed from file
+        MODE_SYNTHETIC // Procedural sand terrain
+    };
+
+    // Parameters of the synthetic terrain
+    struct Synthetic {
+        Synthetic();
+        int width, height; // Frame size
+        float fps; // Frame rate, <= 0 to generate frames as fast as possible
+        unsigned int seed;
+        float baseDepth; // Depth of the sandbox floor in mm
+        float hillHeight; // Height of the highest hills in mm
+        float hillSize; // Size of the hills in pixels
+        int numLakes; // Number of depressions dug in the sand
+        int numHands; // Number of hands moving above the sand
+        float noise; // Standard deviation of the sensor noise in mm
+        float dropouts; // Fraction of invalid pixels (0 or 2047)
+    };
+
+    CaptureSettings();
+    bool load(const string& settingsFile);
+
+    Mode mode;
+    string file; // Recording file, relative to the data folder
+    bool realtime; // Replay at the recorded speed, or as fast as possible
+    bool loop; // Restart the replay at the end of the recording
+    bool lockstep; // Replay every frame to the main thread, for exact simulation replays
+    bool recordColor; // Also record the color frames
+    Synthetic synthetic;
+};
+
+// Interface of the sources of raw frames used by the kinect grabber
+class DepthSource {
+public:
+    virtual ~DepthSource(){}
+
+    virtual bool setup() = 0; // Initialise the source, the frame size is known afterwards
+    virtual bool open() = 0;
+    virtual void close() = 0;
+    virtual void update() = 0; // Get the next frame if available
+    virtual bool isFrameNew() = 0;
+
+    virtual int getWidth() const = 0;
+    virtual int getHeight() const = 0;
+    virtual const ofShortPixels& getRawDepthPixels() = 0; // Raw depth values in mm
+    virtual const ofPixels& getPixels() = 0; // Color frame registered with the depth frame
+    virtual ofVec3f getWorldCoordinateAt(int x, int y, float z) = 0; // World coordinates of a depth pixel
+    virtual string getName() const = 0;
+
+    // Create the source selected by the capture settings
+    static std::shared_ptr<DepthSource> create(const CaptureSettings& settings);
+};
+
+// Live kinect frames from ofxKinect
+class KinectDepthSource: public DepthSource {
+public:
+    bool setup() override;
+    bool open() override;
+    void close() override;
+    void update() override;
+    bool isFrameNew() override;
+
+    int getWidth() const override;
+    int getHeight() const override;
+    const ofShortPixels& getRawDepthPixels() override;
+    const ofPixels& getPixels() override;
+    ofVec3f getWorldCoordinateAt(int x, int y, float z) override;
+    string getName() const override {
+        return "kinect";
+    }
+
+private:
+    ofxKinect kinect;
+    int width, height;
+};
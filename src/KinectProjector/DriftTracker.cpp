@@ -0,0 +1,213 @@
+/***********************************************************************
+DriftTracker - DriftTracker follows the slow drift of the sea level
+caused by the kinect or the table moving.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#include "DriftTracker.h"
+#include "PipelineProfiler.h"
+
+DriftTracker::DriftTracker()
+:step(4),
+rowsPerUpdate(8),
+maxSlope(10),
+maxDeviation(4),
+maxElevation(400),
+smoothing(0.1f),
+maxCorrectionOffset(30),
+maxCorrectionTilt(tan(ofDegToRad(2))),
+minSamples(200),
+referencePlaneEq(0),
+correctedPlaneEq(0),
+correctionX(0),
+correctionY(0),
+correctionOffset(0),
+numSweeps(0),
+minX(0),
+minY(0),
+width(0),
+height(0),
+cols(0),
+rows(0),
+nextRow(0),
+sx(0), sy(0), sxx(0), sxy(0), syy(0), sd(0), sxd(0), syd(0),
+numSamples(0)
+{
+}
+
+void DriftTracker::setStep(int sstep){
+    step = std::max(sstep, 1);
+    width = 0; // Rebuild the grid at the next update
+}
+
+void DriftTracker::setRowsPerUpdate(int srowsPerUpdate){
+    rowsPerUpdate = std::max(srowsPerUpdate, 1);
+}
+
+void DriftTracker::setMaxSlope(float smaxSlope){
+    maxSlope = smaxSlope;
+}
+
+void DriftTracker::setMaxDeviation(float smaxDeviation){
+    maxDeviation = smaxDeviation;
+}
+
+void DriftTracker::setSmoothing(float ssmoothing){
+    smoothing = ofClamp(ssmoothing, 0.001f, 1);
+}
+
+void DriftTracker::setMaxCorrection(float smaxOffset, float smaxTilt){
+    maxCorrectionOffset = smaxOffset;
+    maxCorrectionTilt = tan(ofDegToRad(smaxTilt));
+}
+
+/**
+ * @fn	void DriftTracker::reset(const ofVec4f& sreferencePlaneEq)
+ *
+ * @brief	Restarts the tracking from a new reference plane, all the reference
+ * 			elevations are taken again.
+ *
+ * @param	sreferencePlaneEq	The reference plane equation.
+ */
+
+void DriftTracker::reset(const ofVec4f& sreferencePlaneEq){
+    referencePlaneEq = sreferencePlaneEq;
+    correctedPlaneEq = sreferencePlaneEq;
+    correctionX = 0;
+    correctionY = 0;
+    correctionOffset = 0;
+    numSweeps = 0;
+    width = 0; // Rebuild the grid at the next update
+}
+
+void DriftTracker::resetGrid(const ElevationMap& elevationMap){
+    minX = elevationMap.getMinX();
+    minY = elevationMap.getMinY();
+    width = elevationMap.getWidth();
+    height = elevationMap.getHeight();
+    cols = (width+step-1)/step;
+    rows = (height+step-1)/step;
+    reference.assign(static_cast<size_t>(cols)*rows, std::numeric_limits<float>::quiet_NaN());
+    nextRow = 0;
+    sx = sy = sxx = sxy = syy = sd = sxd = syd = 0;
+    numSamples = 0;
+}
+
+/**
+ * @fn	bool DriftTracker::update(const ElevationMap& elevationMap, const TerrainAnalysis& terrainAnalysis, const ofVec4f& basePlaneEq)
+ *
+ * @brief	Processes the next rows of samples of the elevation map, estimates the
+ * 			drift at the end of a sweep.
+ *
+ * @param	elevationMap   	The elevation map of the current frame.
+ * @param	terrainAnalysis	The terrain analysis of the elevation map.
+ * @param	basePlaneEq	   	The base plane currently used.
+ *
+ * @return	True if the corrected plane changed.
+ */
+
+bool DriftTracker::update(const ElevationMap& elevationMap, const TerrainAnalysis& terrainAnalysis, const ofVec4f& basePlaneEq){
+    PROFILE_STAGE(STAGE_DRIFT_TRACKING);
+    if (basePlaneEq != correctedPlaneEq && basePlaneEq != referencePlaneEq){ // Calibration or manual adjustment
+        ofLogVerbose("DriftTracker") << "update(): Base plane changed, restarting the tracking";
+        reset(basePlaneEq);
+    }
+    if (elevationMap.getMinX() != minX || elevationMap.getMinY() != minY || elevationMap.getWidth() != width || elevationMap.getHeight() != height)
+        resetGrid(elevationMap);
+    if (rows == 0)
+        return false;
+
+    const float* worldX = elevationMap.getWorldXData();
+    const float* worldY = elevationMap.getWorldYData();
+    const float* worldZ = elevationMap.getWorldZData();
+    const ofVec4f& p = referencePlaneEq;
+    int endRow = std::min(nextRow+rowsPerUpdate, rows);
+    for (int row = nextRow; row < endRow; row++){
+        int y = row*step;
+        for (int col = 0; col < cols; col++){
+            int x = col*step;
+            size_t ind = static_cast<size_t>(y)*width+x;
+            float wx = worldX[ind], wy = worldY[ind], wz = worldZ[ind];
+            float elevation = -(p.x*wx+p.y*wy+p.z*wz+p.w);
+            float& ref = reference[static_cast<size_t>(row)*cols+col];
+            if (!(std::abs(elevation) < maxElevation)){ // Invalid depth, also NaN
+                ref = std::numeric_limits<float>::quiet_NaN();
+                continue;
+            }
+            float drift = static_cast<float>(correctionX*wx+correctionY*wy+correctionOffset);
+            float difference = elevation-ref;
+            if (!(std::abs(difference-drift) <= maxDeviation)){ // New sample or moved sand
+                ref = elevation-drift;
+                continue;
+            }
+            if (terrainAnalysis.isInside(x+minX, y+minY) && terrainAnalysis.getSlope(x+minX, y+minY) > maxSlope)
+                continue;
+            sx += wx;
+            sy += wy;
+            sxx += static_cast<double>(wx)*wx;
+            sxy += static_cast<double>(wx)*wy;
+            syy += static_cast<double>(wy)*wy;
+            sd += difference;
+            sxd += static_cast<double>(wx)*difference;
+            syd += static_cast<double>(wy)*difference;
+            numSamples++;
+        }
+    }
+    nextRow = endRow;
+    if (nextRow < rows)
+        return false;
+
+    // End of the sweep
+    ofVec4f previousPlaneEq = correctedPlaneEq;
+    estimate();
+    nextRow = 0;
+    sx = sy = sxx = sxy = syy = sd = sxd = syd = 0;
+    numSamples = 0;
+    return correctedPlaneEq != previousPlaneEq;
+}
+
+void DriftTracker::estimate(){
+    numSweeps++;
+    if (numSamples < minSamples)
+        return;
+
+    // Normal equations of d = a*x+b*y+c
+    double n = static_cast<double>(numSamples);
+    double det = sxx*(syy*n-sy*sy)-sxy*(sxy*n-sy*sx)+sx*(sxy*sy-syy*sx);
+    double a, b, c;
+    if (std::abs(det) > 1e-9*sxx*syy*n){
+        a = (sxd*(syy*n-sy*sy)-sxy*(syd*n-sy*sd)+sx*(syd*sy-syy*sd))/det;
+        b = (sxx*(syd*n-sy*sd)-sxd*(sxy*n-sy*sx)+sx*(sxy*sd-syd*sx))/det;
+        c = (sxx*(syy*sd-sy*syd)-sxy*(sxy*sd-sy*sxd)+sx*(sxy*syd-syy*sxd))/det;
+    } else { // The flat samples are on a line, only the offset is estimated
+        a = correctionX;
+        b = correctionY;
+        c = (sd-a*sx-b*sy)/n;
+    }
+    if (std::abs(c) > maxCorrectionOffset || sqrt(a*a+b*b) > maxCorrectionTilt){
+        ofLogVerbose("DriftTracker") << "estimate(): Drift out of range, offset: " << c << " mm, tilt: " << ofRadToDeg(atan(sqrt(a*a+b*b))) << " degrees";
+        return;
+    }
+    correctionX += smoothing*(a-correctionX);
+    correctionY += smoothing*(b-correctionY);
+    correctionOffset += smoothing*(c-correctionOffset);
+    updateCorrectedPlane();
+}
+
+void DriftTracker::updateCorrectedPlane(){
+    // elevation-(a*x+b*y+c) = -((nx+a)*x+(ny+b)*y+nz*z+w+c)
+    ofVec4f plane(referencePlaneEq.x+correctionX, referencePlaneEq.y+correctionY, referencePlaneEq.z, referencePlaneEq.w+correctionOffset);
+    correctedPlaneEq = plane/ofVec3f(plane).length();
+}
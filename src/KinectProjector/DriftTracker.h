@@ -0,0 +1,94 @@
+/***********************************************************************
+DriftTracker - DriftTracker follows the slow drift of the sea level
+caused by the kinect or the table moving.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#pragma once
+#include "ofMain.h"
+
+#include "ElevationMap.h"
+#include "TerrainAnalysis.h"
+
+// Each sampled pixel of the elevation map keeps a reference elevation
+// relative to the reference plane (the calibrated base plane with the manual
+// adjustments). The drift is the plane d = a*x+b*y+c (world x, y in mm) fitted
+// to the differences between the elevations and their references on the flat
+// pixels whose difference agrees with the current drift: a pixel which
+// disagrees by more than the maximal deviation is sand which moved, its
+// reference is taken again. A few rows of the sampling grid are processed at
+// each update, the drift is estimated at the end of each sweep of the grid
+// and the correction follows the estimates with an exponential smoothing.
+// The corrected plane removes the correction from the elevations.
+class DriftTracker {
+public:
+    DriftTracker();
+
+    void setStep(int sstep); // Kinect pixels between the samples
+    void setRowsPerUpdate(int srowsPerUpdate); // Rows of samples processed by each update
+    void setMaxSlope(float smaxSlope); // Degrees, steeper pixels are not fitted
+    void setMaxDeviation(float smaxDeviation); // mm
+    void setSmoothing(float ssmoothing); // Weight of a new estimate in the correction, in ]0, 1]
+    void setMaxCorrection(float smaxOffset, float smaxTilt); // mm and degrees, larger estimates are ignored
+
+    // Restart the tracking from a new reference plane, the correction is cleared
+    void reset(const ofVec4f& sreferencePlaneEq);
+    // Process the next rows of samples, a basePlaneEq which is neither the reference nor
+    // the corrected plane resets the tracking. Return true when the corrected plane changed.
+    bool update(const ElevationMap& elevationMap, const TerrainAnalysis& terrainAnalysis, const ofVec4f& basePlaneEq);
+
+    const ofVec4f& getReferencePlaneEq() const {
+        return referencePlaneEq;
+    }
+    const ofVec4f& getCorrectedPlaneEq() const {
+        return correctedPlaneEq;
+    }
+    ofVec3f getCorrection() const { // Tilts along world x and y (mm per mm) and offset (mm)
+        return ofVec3f(correctionX, correctionY, correctionOffset);
+    }
+    int getNumSweeps() const { // Since the last reset
+        return numSweeps;
+    }
+
+private:
+    void resetGrid(const ElevationMap& elevationMap);
+    void estimate(); // At the end of a sweep
+    void updateCorrectedPlane();
+
+    int step;
+    int rowsPerUpdate;
+    float maxSlope;
+    float maxDeviation;
+    float maxElevation; // Samples further from the reference plane are invalid depths
+    float smoothing;
+    float maxCorrectionOffset;
+    float maxCorrectionTilt; // Tangent of the maximal angle
+    size_t minSamples; // Fitted samples needed for an estimate
+
+    ofVec4f referencePlaneEq;
+    ofVec4f correctedPlaneEq;
+    double correctionX, correctionY, correctionOffset;
+    int numSweeps;
+
+    // Sampling grid of the elevation map
+    int minX, minY, width, height;
+    int cols, rows;
+    int nextRow;
+    vector<float> reference; // NaN until the sample is valid
+
+    // Least squares sums of the current sweep
+    double sx, sy, sxx, sxy, syy, sd, sxd, syd;
+    size_t numSamples;
+};
@@ -0,0 +1,106 @@
+/***********************************************************************
+ElevationMap - ElevationMap caches the world coordinates and the
+elevation of each pixel of the kinect ROI.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#include "ElevationMap.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ELEVATIONMAP_SSE2
+#include <emmintrin.h>
+#endif
+
+ElevationMap::ElevationMap()
+:minX(0),
+minY(0),
+width(0),
+height(0),
+basePlaneEq(0),
+generation(0)
+{
+}
+
+void ElevationMap::update(const float* depth, int frameWidth, const ofRectangle& ROI, const ofMatrix4x4& kinectWorldMatrix, const ofVec4f& sbasePlaneEq){
+    minX = static_cast<int>(ROI.getMinX());
+    minY = static_cast<int>(ROI.getMinY());
+    width = std::max(static_cast<int>(ROI.getMaxX())-minX, 0);
+    height = std::max(static_cast<int>(ROI.getMaxY())-minY, 0);
+    size_t size = static_cast<size_t>(width)*height;
+    worldX.resize(size);
+    worldY.resize(size);
+    worldZ.resize(size);
+    elevation.resize(size);
+    basePlaneEq = sbasePlaneEq;
+    generation++;
+
+    // Same computation as KinectProjector::kinectCoordToWorldCoord(): world = kinectWorldMatrix*(x, y, z, 1)*z
+    const ofMatrix4x4& m = kinectWorldMatrix;
+    for (int y = 0; y < height; y++){
+        const float* depthRow = depth+static_cast<size_t>(y+minY)*frameWidth+minX;
+        size_t row = static_cast<size_t>(y)*width;
+        float ky = static_cast<float>(y+minY);
+        float ox = m(0, 1)*ky+m(0, 3); // Terms constant along the row
+        float oy = m(1, 1)*ky+m(1, 3);
+        float oz = m(2, 1)*ky+m(2, 3);
+        int x = 0;
+#ifdef ELEVATIONMAP_SSE2
+        const __m128 m00 = _mm_set1_ps(m(0, 0)), m02 = _mm_set1_ps(m(0, 2));
+        const __m128 m10 = _mm_set1_ps(m(1, 0)), m12 = _mm_set1_ps(m(1, 2));
+        const __m128 m20 = _mm_set1_ps(m(2, 0)), m22 = _mm_set1_ps(m(2, 2));
+        const __m128 vox = _mm_set1_ps(ox), voy = _mm_set1_ps(oy), voz = _mm_set1_ps(oz);
+        const __m128 e0 = _mm_set1_ps(basePlaneEq.x), e1 = _mm_set1_ps(basePlaneEq.y);
+        const __m128 e2 = _mm_set1_ps(basePlaneEq.z), e3 = _mm_set1_ps(basePlaneEq.w);
+        __m128 kx = _mm_setr_ps(static_cast<float>(minX), static_cast<float>(minX+1), static_cast<float>(minX+2), static_cast<float>(minX+3));
+        const __m128 four = _mm_set1_ps(4.0f);
+        for (; x+4 <= width; x += 4, kx = _mm_add_ps(kx, four)){
+            __m128 z = _mm_loadu_ps(depthRow+x);
+            __m128 wx = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, kx), vox), _mm_mul_ps(m02, z)), z);
+            __m128 wy = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m10, kx), voy), _mm_mul_ps(m12, z)), z);
+            __m128 wz = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m20, kx), voz), _mm_mul_ps(m22, z)), z);
+            __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e0, wx), _mm_mul_ps(e1, wy)), _mm_add_ps(_mm_mul_ps(e2, wz), e3));
+            _mm_storeu_ps(&worldX[row+x], wx);
+            _mm_storeu_ps(&worldY[row+x], wy);
+            _mm_storeu_ps(&worldZ[row+x], wz);
+            _mm_storeu_ps(&elevation[row+x], _mm_sub_ps(_mm_setzero_ps(), dot));
+        }
+#endif
+        for (; x < width; x++){
+            float kx = static_cast<float>(x+minX);
+            float z = depthRow[x];
+            float wx = (m(0, 0)*kx+ox+m(0, 2)*z)*z;
+            float wy = (m(1, 0)*kx+oy+m(1, 2)*z)*z;
+            float wz = (m(2, 0)*kx+oz+m(2, 2)*z)*z;
+            worldX[row+x] = wx;
+            worldY[row+x] = wy;
+            worldZ[row+x] = wz;
+            elevation[row+x] = -(basePlaneEq.x*wx+basePlaneEq.y*wy+basePlaneEq.z*wz+basePlaneEq.w);
+        }
+    }
+}
+
+void ElevationMap::setBasePlaneEq(const ofVec4f& sbasePlaneEq){
+    if (sbasePlaneEq == basePlaneEq)
+        return;
+    basePlaneEq = sbasePlaneEq;
+    updateElevation();
+}
+
+void ElevationMap::updateElevation(){
+    generation++;
+    size_t size = elevation.size();
+    for (size_t i = 0; i < size; i++)
+        elevation[i] = -(basePlaneEq.x*worldX[i]+basePlaneEq.y*worldY[i]+basePlaneEq.z*worldZ[i]+basePlaneEq.w);
+}
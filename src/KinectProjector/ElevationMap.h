@@ -0,0 +1,83 @@
+/***********************************************************************
+ElevationMap - ElevationMap caches the world coordinates and the
+elevation of each pixel of the kinect ROI.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#pragma once
+#include "ofMain.h"
+
+// Rebuilt once per filtered frame so that the simulation reads the elevations
+// instead of transforming every kinect point it looks at. The planes cover the
+// ROI only, callers have to check isInside() before reading them.
+class ElevationMap {
+public:
+    ElevationMap();
+
+    // Compute the world coordinates and the elevations of the ROI of a filtered depth frame
+    void update(const float* depth, int frameWidth, const ofRectangle& ROI, const ofMatrix4x4& kinectWorldMatrix, const ofVec4f& basePlaneEq);
+    // Recompute the elevations only, does nothing if the base plane did not change
+    void setBasePlaneEq(const ofVec4f& sbasePlaneEq);
+    const ofVec4f& getBasePlaneEq() const { // Base plane of the current elevations
+        return basePlaneEq;
+    }
+
+    bool isInside(int x, int y) const { // x, y in kinect pixel coordinate
+        return static_cast<unsigned int>(x-minX) < static_cast<unsigned int>(width) && static_cast<unsigned int>(y-minY) < static_cast<unsigned int>(height);
+    }
+    float getElevation(int x, int y) const { // x, y inside the ROI
+        return elevation[(y-minY)*width+x-minX];
+    }
+    ofVec3f getWorldCoord(int x, int y) const { // x, y inside the ROI
+        int ind = (y-minY)*width+x-minX;
+        return ofVec3f(worldX[ind], worldY[ind], worldZ[ind]);
+    }
+
+    const float* getElevationData() const { // Rows of getWidth() elevations starting at getMinX(), getMinY()
+        return elevation.data();
+    }
+    const float* getWorldXData() const { // Same layout as getElevationData()
+        return worldX.data();
+    }
+    const float* getWorldYData() const {
+        return worldY.data();
+    }
+    const float* getWorldZData() const {
+        return worldZ.data();
+    }
+    unsigned long long getGeneration() const { // Incremented each time the elevations change
+        return generation;
+    }
+    int getMinX() const {
+        return minX;
+    }
+    int getMinY() const {
+        return minY;
+    }
+    int getWidth() const {
+        return width;
+    }
+    int getHeight() const {
+        return height;
+    }
+
+private:
+    void updateElevation();
+
+    int minX, minY, width, height;
+    ofVec4f basePlaneEq; // Base plane of the current elevations
+    unsigned long long generation;
+    std::vector<float> worldX, worldY, worldZ, elevation;
+};
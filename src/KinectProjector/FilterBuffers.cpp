@@ -0,0 +1,77 @@
+/***********************************************************************
+FilterBuffers - FilterBuffers holds the per pixel buffers of the
+temporal frame filter as separate aligned planes.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#include "FilterBuffers.h"
+
+#include <algorithm>
+#include <stdint.h>
+
+FilterBuffers::FilterBuffers()
+:width(0),
+height(0),
+numAveragingSlots(0),
+allocatedBytes(0),
+memory(0),
+count(0),
+sum(0),
+sumSq(0),
+valid(0)
+{
+}
+
+FilterBuffers::~FilterBuffers(){
+    release();
+}
+
+void FilterBuffers::allocate(int swidth, int sheight, int snumAveragingSlots, float initialValue){
+    release();
+    width = swidth;
+    height = sheight;
+    numAveragingSlots = snumAveragingSlots;
+
+    // Round the plane size up to a multiple of the cache line so that every plane is aligned
+    size_t planeSize = static_cast<size_t>(width)*height;
+    size_t floatsPerLine = alignment/sizeof(float);
+    size_t planeStride = (planeSize+floatsPerLine-1)/floatsPerLine*floatsPerLine;
+    size_t numPlanes = 4+numAveragingSlots;
+    allocatedBytes = numPlanes*planeStride*sizeof(float);
+
+    memory = new char[allocatedBytes+alignment-1];
+    uintptr_t address = reinterpret_cast<uintptr_t>(memory);
+    float* planes = reinterpret_cast<float*>((address+alignment-1)/alignment*alignment);
+
+    count = planes;
+    sum = planes+planeStride;
+    sumSq = planes+2*planeStride;
+    valid = planes+3*planeStride;
+    averagingSlots.resize(numAveragingSlots);
+    for(int i=0;i<numAveragingSlots;++i)
+        averagingSlots[i] = planes+(4+i)*planeStride;
+
+    /* Initialize the statistics, valid and averaging planes: */
+    std::fill(count, valid, 0.0f);
+    std::fill(valid, planes+numPlanes*planeStride, initialValue);
+}
+
+void FilterBuffers::release(){
+    delete[] memory;
+    memory = 0;
+    allocatedBytes = 0;
+    count = sum = sumSq = valid = 0;
+    averagingSlots.clear();
+}
@@ -0,0 +1,112 @@
+/***********************************************************************
+FilterBuffers - FilterBuffers holds the per pixel buffers of the
+temporal frame filter as separate aligned planes.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#pragma once
+#include <cstddef>
+#include <vector>
+
+// Structure of arrays: every statistic and every averaging slot is a separate
+// plane of width*height floats starting on a cache line boundary, so that
+// the filter streams through contiguous memory with aligned vector loads.
+class FilterBuffers {
+public:
+    static const size_t alignment = 64; // Cache line size
+
+    FilterBuffers();
+    ~FilterBuffers();
+
+    void allocate(int swidth, int sheight, int snumAveragingSlots, float initialValue); // Allocate and initialise all planes
+    void release();
+
+    bool isAllocated() const {
+        return memory != 0;
+    }
+    int getWidth() const {
+        return width;
+    }
+    int getHeight() const {
+        return height;
+    }
+    int getNumAveragingSlots() const {
+        return numAveragingSlots;
+    }
+
+    // Planes, indexed by y*width+x
+    float* getCount() {
+        return count;
+    }
+    float* getSum() {
+        return sum;
+    }
+    float* getSumSq() {
+        return sumSq;
+    }
+    float* getValid() {
+        return valid;
+    }
+    float* getAveragingSlot(int slotNum) {
+        return averagingSlots[slotNum];
+    }
+    float* const* getAveragingSlots() {
+        return &averagingSlots[0];
+    }
+
+    // Debug accessors
+    float getCount(int x, int y) const {
+        return count[y*width+x];
+    }
+    float getSum(int x, int y) const {
+        return sum[y*width+x];
+    }
+    float getSumSq(int x, int y) const {
+        return sumSq[y*width+x];
+    }
+    float getValid(int x, int y) const {
+        return valid[y*width+x];
+    }
+    float getAveragingSlot(int x, int y, int slotNum) const {
+        return averagingSlots[slotNum][y*width+x];
+    }
+
+    size_t getAllocatedBytes() const {
+        return allocatedBytes;
+    }
+    // Memory traffic of the filter for one pixel: raw input read, averaging slot,
+    // statistics and valid value read and written back, filtered output written
+    static size_t getBytesPerPixel() {
+        return sizeof(unsigned short) + 2*sizeof(float) + 3*2*sizeof(float) + 2*sizeof(float) + sizeof(float);
+    }
+    // Memory traffic of the filter for a frame of numPixels pixels
+    static size_t getBytesPerFrame(size_t numPixels) {
+        return numPixels*getBytesPerPixel();
+    }
+
+private:
+    FilterBuffers(const FilterBuffers&);
+    FilterBuffers& operator=(const FilterBuffers&);
+
+    int width, height;
+    int numAveragingSlots;
+    size_t allocatedBytes;
+    char* memory; // Unaligned block holding all the planes
+    float* count; // Number of valid samples
+    float* sum; // Sum of valid samples
+    float* sumSq; // Sum of squares of valid samples
+    float* valid; // Most recent stable depth value
+    std::vector<float*> averagingSlots; // Ring of planes storing the last numAveragingSlots samples
+};
@@ -0,0 +1,63 @@
+/***********************************************************************
+FrameExchange - FrameExchange hands the filtered kinect frames over
+from the kinect grabber thread to the main thread.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#include "FrameExchange.h"
+
+FrameExchange::FrameExchange()
+:back(0),
+front(1),
+middle(2)
+{
+}
+
+void FrameExchange::allocate(int width, int height){
+    for (auto & frame : frames){
+        frame.depth.allocate(width, height, 1);
+        frame.depth.set(0);
+        frame.color.allocate(width, height, OF_IMAGE_COLOR);
+        frame.color.set(0);
+        frame.gradient.clear();
+        frame.gradFieldcols = 0;
+        frame.gradFieldrows = 0;
+        frame.tileCols = (width+KinectFrame::tileSize-1)/KinectFrame::tileSize;
+        frame.tileRows = (height+KinectFrame::tileSize-1)/KinectFrame::tileSize;
+        frame.changedTiles.assign(frame.tileCols*frame.tileRows, 1);
+        frame.imageStabilized = false;
+        frame.sequence = 0;
+        frame.publishTime = 0;
+        frame.clearGeneration = 0;
+    }
+    back = 0;
+    front = 1;
+    middle = 2;
+}
+
+void FrameExchange::publish(){
+    // Release the back frame content to the consumer and take over the previous middle frame
+    unsigned int previous = middle.exchange(static_cast<unsigned int>(back) | freshFlag, std::memory_order_acq_rel);
+    back = previous & indexMask;
+}
+
+bool FrameExchange::receive(){
+    if (!(middle.load(std::memory_order_relaxed) & freshFlag))
+        return false;
+    // Acquire the middle frame content and give back the previous front frame
+    unsigned int previous = middle.exchange(static_cast<unsigned int>(front), std::memory_order_acq_rel);
+    front = previous & indexMask;
+    return true;
+}
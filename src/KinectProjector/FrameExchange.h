@@ -0,0 +1,77 @@
+/***********************************************************************
+FrameExchange - FrameExchange hands the filtered kinect frames over
+from the kinect grabber thread to the main thread.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#pragma once
+#include "ofMain.h"
+#include <atomic>
+
+// A filtered frame: the depth, color and gradient field computed from the same kinect frame
+struct KinectFrame {
+    static const int tileSize = 32; // Kinect pixels per side of the change tiles, aligned on the frame origin
+
+    ofFloatPixels depth; // Filtered depth frame
+    ofPixels color; // Color frame
+    vector<ofVec2f> gradient; // Gradient field
+    int gradFieldcols, gradFieldrows;
+    // 1 for the tiles where a stable depth changed since the previous received frame, row by
+    // row. The spatial filter spreads a change a few pixels into the neighbouring tiles.
+    vector<unsigned char> changedTiles;
+    int tileCols, tileRows;
+    bool imageStabilized; // Whether the filter had enough frames to stabilize
+    unsigned long long sequence; // Number of the frame since the grabber started
+    uint64_t publishTime; // PipelineProfiler time at which the grabber published the frame
+    unsigned int clearGeneration; // Used by the grabber to know when the depth frame has to be cleared
+};
+
+// Lock-free triple buffer between one producer (the grabber thread) and one
+// consumer (the main thread). The producer fills the back frame and publishes
+// it, the consumer picks up the most recent published frame. The three frames
+// are allocated once and recycled, a frame is never written while it is read.
+class FrameExchange {
+public:
+    FrameExchange();
+
+    // Allocate the frames, must be called before the producer and the consumer start
+    void allocate(int width, int height);
+
+    // Producer side
+    KinectFrame& getBackFrame() {
+        return frames[back];
+    }
+    void publish(); // Make the back frame available to the consumer and get a new back frame
+    bool isReceived() const { // Whether the consumer got the last published frame
+        return !(middle.load(std::memory_order_acquire) & freshFlag);
+    }
+
+    // Consumer side
+    bool receive(); // Get the most recent published frame if any, return false if no new frame was published
+    const KinectFrame& getFrontFrame() const {
+        return frames[front];
+    }
+    KinectFrame& getFrontFrame() { // The producer does not touch the front frame until the next receive()
+        return frames[front];
+    }
+
+private:
+    static const unsigned int indexMask = 3;
+    static const unsigned int freshFlag = 4; // Set when the middle frame has not been received yet
+
+    KinectFrame frames[3];
+    int back, front; // Owned by the producer and the consumer
+    std::atomic<unsigned int> middle; // Index of the frame in transit | freshFlag
+};
@@ -0,0 +1,86 @@
+/***********************************************************************
+GradientField - GradientField shares the gradient field of the last
+filtered frame between the main thread and the simulation readers.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#include "GradientField.h"
+#include <atomic>
+
+GradientField::GradientField()
+:front(std::make_shared<GradientFieldSnapshot>()),
+back(std::make_shared<GradientFieldSnapshot>()),
+generation(0)
+{
+    front->cols = front->rows = 0;
+    front->resolution = 1;
+    front->generation = 0;
+}
+
+/**
+ * @fn	void GradientField::setup(int cols, int rows, int resolution)
+ *
+ * @brief	Publishes a null gradient field of a new size.
+ *
+ * @param	cols	  	The number of columns.
+ * @param	rows	  	The number of rows.
+ * @param	resolution	The kinect pixels per cell.
+ */
+
+void GradientField::setup(int cols, int rows, int resolution){
+    vector<ofVec2f> cells(cols*rows, ofVec2f(0));
+    publish(cells, cols, rows, resolution);
+}
+
+/**
+ * @fn	void GradientField::publish(vector<ofVec2f>& cells, int cols, int rows, int resolution)
+ *
+ * @brief	Swaps a gradient field into the back snapshot and makes it the front
+ * 			one. To be called by a single writer thread.
+ *
+ * @param	cells	  	The cells, row by row. Gets the previous cells of the back
+ * 						snapshot, or nothing if a reader still holds it.
+ * @param	cols	  	The number of columns.
+ * @param	rows	  	The number of rows.
+ * @param	resolution	The kinect pixels per cell.
+ */
+
+void GradientField::publish(vector<ofVec2f>& cells, int cols, int rows, int resolution){
+    // A reader still holds the back snapshot: leave it to the reader
+    if (!back || back.use_count() > 1)
+        back = std::make_shared<GradientFieldSnapshot>();
+    else // use_count() is a relaxed load: order the reuse after the last reader released it
+        std::atomic_thread_fence(std::memory_order_acquire);
+    back->cols = cols;
+    back->rows = rows;
+    back->resolution = std::max(resolution, 1);
+    back->generation = ++generation;
+    back->cells.swap(cells);
+    swap();
+}
+
+void GradientField::swap(){
+    std::lock_guard<std::mutex> lock(mutex);
+    std::swap(front, back);
+}
+
+std::shared_ptr<const GradientFieldSnapshot> GradientField::getSnapshot() const{
+    std::lock_guard<std::mutex> lock(mutex);
+    return front;
+}
+
+unsigned long long GradientField::getGeneration() const{
+    return getSnapshot()->generation;
+}
@@ -0,0 +1,66 @@
+/***********************************************************************
+GradientField - GradientField shares the gradient field of the last
+filtered frame between the main thread and the simulation readers.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#pragma once
+#include "ofMain.h"
+#include <memory>
+#include <mutex>
+
+// A gradient field that is never modified once published: readers keep it
+// alive as long as they hold it, whatever the writer does meanwhile.
+struct GradientFieldSnapshot {
+    int cols, rows;
+    int resolution; // Kinect pixels per cell
+    unsigned long long generation; // Number of the publication
+    vector<ofVec2f> cells;
+
+    bool isInside(int col, int row) const {
+        return static_cast<unsigned int>(col) < static_cast<unsigned int>(cols) && static_cast<unsigned int>(row) < static_cast<unsigned int>(rows);
+    }
+    ofVec2f getGradient(float x, float y) const { // x, y in kinect pixel coordinate, 0 outside the field
+        int col = static_cast<int>(floor(x/resolution));
+        int row = static_cast<int>(floor(y/resolution));
+        return isInside(col, row) ? cells[row*cols+col] : ofVec2f(0);
+    }
+};
+
+// Double buffer of reference counted snapshots with one writer. A
+// publication swaps the cells into the back snapshot, so the writer gets the
+// previous cells back to fill the next field, and swaps the back snapshot
+// with the front one. The back snapshot is only reused when no reader holds
+// it anymore, otherwise a new one is allocated. Readers get the front
+// snapshot and can use it from any thread without locking.
+class GradientField {
+public:
+    GradientField();
+
+    // Writer side
+    void setup(int cols, int rows, int resolution); // Publish an empty field of a new size
+    void publish(vector<ofVec2f>& cells, int cols, int rows, int resolution); // Takes the cells over, without copy
+
+    // Reader side, any thread
+    std::shared_ptr<const GradientFieldSnapshot> getSnapshot() const;
+    unsigned long long getGeneration() const;
+
+private:
+    void swap(); // Make the back snapshot the front one
+
+    mutable std::mutex mutex; // Protects the front pointer only
+    std::shared_ptr<GradientFieldSnapshot> front, back;
+    unsigned long long generation;
+};
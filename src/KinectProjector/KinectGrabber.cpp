@@ -24,8 +24,13 @@ General Public License for more details.
 
 KinectGrabber::KinectGrabber()
 :newFrame(true),
+lockstep(false),
 bufferInitiated(false),
-kinectOpened(false)
+kinectOpened(false),
+numFilterBands(1),
+tileCols(0),
+tileRows(0),
+allTilesChanged(true)
 {
 }
 
@@ -47,25 +52,32 @@ void KinectGrabber::stop(){
     stopThread();
 }
 
-bool KinectGrabber::setup(){
+bool KinectGrabber::setup(std::shared_ptr<DepthSource> sdepthSource){
 	// settings and defaults
-	storedframes = 0;
-
-	kinect.init();
-	kinect.setRegistration(true); // To have correspondance between RGB and depth images
-	kinect.setUseTexture(false);
-	width = kinect.getWidth();
-	height = kinect.getHeight();
+	frameSequence = 0;
+	clearGeneration = 0;
+
+	depthSource = sdepthSource;
+	if (!depthSource->setup()){
+		ofLogError("kinectGrabber") << "setup(): Cannot setup " << depthSource->getName() << " depth source, using the kinect";
+		depthSource = std::make_shared<KinectDepthSource>();
+		depthSource->setup();
+	}
+	ofLogVerbose("kinectGrabber") << "setup(): Depth source: " << depthSource->getName();
+	width = depthSource->getWidth();
+	height = depthSource->getHeight();
 
 	kinectDepthImage.allocate(width, height, 1);
-    filteredframe.allocate(width, height, 1);
-    kinectColorImage.allocate(width, height);
-    kinectColorImage.setUseTexture(false);
+    frameExchange.allocate(width, height);
+    tileCols = (width+KinectFrame::tileSize-1)/KinectFrame::tileSize;
+    tileRows = (height+KinectFrame::tileSize-1)/KinectFrame::tileSize;
+    rowChangedTiles.assign(height*tileCols, 0);
+    pendingChangedTiles.assign(tileCols*tileRows, 1);
 	return openKinect();
 }
 
 bool KinectGrabber::openKinect() {
-	kinectOpened = kinect.open();
+	kinectOpened = depthSource->open();
 	return kinectOpened;
 }
 void KinectGrabber::setupFramefilter(int sgradFieldresolution, float newMaxOffset, ofRectangle ROI, bool sspatialFilter, bool sfollowBigChange, int snumAveragingSlots) {
@@ -92,6 +104,24 @@ void KinectGrabber::setupFramefilter(int sgradFieldresolution, float newMaxOffse
     outsideROIValue = 3999;
     minInitFrame = 60;
     
+    if (ofGetLogLevel("kinectGrabber") == OF_LOG_VERBOSE){
+        for (int i = TemporalFilter::IMPLEMENTATION_SCALAR; i <= TemporalFilter::IMPLEMENTATION_AVX2; i++){
+            TemporalFilter::Implementation implementation = static_cast<TemporalFilter::Implementation>(i);
+            if (TemporalFilter::isSupported(implementation)){
+                double nsPerPixel = TemporalFilter::benchmark(implementation, width, height, numAveragingSlots, 30);
+                ofLogVerbose("kinectGrabber") << "setupFramefilter(): Temporal filter " << TemporalFilter::getImplementationName(implementation) << ": " << nsPerPixel << " ns/pixel, " << FilterBuffers::getBytesPerPixel()/nsPerPixel << " GB/s";
+            }
+        }
+    }
+    ofLogVerbose("kinectGrabber") << "setupFramefilter(): Using temporal filter: " << TemporalFilter::getImplementationName(temporalFilter.getImplementation());
+    if (ofGetLogLevel("kinectGrabber") == OF_LOG_VERBOSE){
+        for (int i = 0; i < SpatialFilter::NUM_KERNELS; i++){
+            SpatialFilter::Kernel kernel = static_cast<SpatialFilter::Kernel>(i);
+            double nsPerPixel = SpatialFilter::benchmark(kernel, spaceFilter.getNumPasses(), width, height, 30);
+            ofLogVerbose("kinectGrabber") << "setupFramefilter(): Spatial filter " << SpatialFilter::getKernelName(kernel) << " x" << spaceFilter.getNumPasses() << ": " << nsPerPixel << " ns/pixel";
+        }
+    }
+    
     //Setup ROI
     setKinectROI(ROI);
     
@@ -100,56 +130,35 @@ void KinectGrabber::setupFramefilter(int sgradFieldresolution, float newMaxOffse
 }
 
 void KinectGrabber::initiateBuffers(void){
-	filteredframe.set(0);
-
-    averagingBuffer=new float[numAveragingSlots*height*width];
-    float* averagingBufferPtr=averagingBuffer;
-    for(int i=0;i<numAveragingSlots;++i)
-        for(unsigned int y=0;y<height;++y)
-            for(unsigned int x=0;x<width;++x,++averagingBufferPtr)
-                *averagingBufferPtr=initialValue;
-    
+	clearGeneration++; // Clear the filtered frames before they are filled again
+
+    /* Initialize the averaging, statistics and valid buffers: */
+    filterBuffers.allocate(width, height, numAveragingSlots, initialValue);
     averagingSlotIndex=0;
+    ofLogVerbose("kinectGrabber") << "initiateBuffers(): Filter buffers: " << filterBuffers.getAllocatedBytes()/1024 << " kB, filter memory traffic per frame: " << FilterBuffers::getBytesPerFrame(ROIwidth*ROIheight)/1024 << " kB";
     
-    /* Initialize the statistics buffer: */
-    statBuffer=new float[height*width*3];
-    float* sbPtr=statBuffer;
-    for(unsigned int y=0;y<height;++y)
-        for(unsigned int x=0;x<width;++x)
-            for(int i=0;i<3;++i,++sbPtr)
-                *sbPtr=0.0;
-    
-    /* Initialize the valid buffer: */
-    validBuffer=new float[height*width];
-    float* vbPtr=validBuffer;
-    for(unsigned int y=0;y<height;++y)
-        for(unsigned int x=0;x<width;++x,++vbPtr)
-            *vbPtr=initialValue;
-    
-    /* Initialize the gradient field buffer: */
-    gradField = new ofVec2f[gradFieldcols*gradFieldrows];
-    ofVec2f* gfPtr=gradField;
-    for(unsigned int y=0;y<gradFieldrows;++y)
-        for(unsigned int x=0;x<gradFieldcols;++x,++gfPtr)
-            *gfPtr=ofVec2f(0);
+    std::fill(rowChangedTiles.begin(), rowChangedTiles.end(), 0); // The ROI may have changed
+    allTilesChanged = true;
     
     bufferInitiated = true;
     currentInitFrame = 0;
     firstImageReady = false;
 }
 
-void KinectGrabber::resetBuffers(void){
+void KinectGrabber::releaseBuffers(void){
     if (bufferInitiated){
         bufferInitiated = false;
-        delete[] averagingBuffer;
-        delete[] statBuffer;
-        delete[] validBuffer;
-        delete[] gradField;
+        filterBuffers.release();
     }
+}
+
+void KinectGrabber::resetBuffers(void){
+    releaseBuffers();
     initiateBuffers();
 }
 
 void KinectGrabber::threadedFunction() {
+    PipelineProfiler::get().setThreadName("Kinect grabber");
 	while(isThreadRunning()) {
         this->actionsLock.lock(); // Update the grabber state if needed
         for(auto & action : this->actions) {
@@ -158,30 +167,37 @@ void KinectGrabber::threadedFunction() {
         this->actions.clear();
         this->actionsLock.unlock();
         
-        kinect.update();
-        if(kinect.isFrameNew()){
-            kinectDepthImage = kinect.getRawDepthPixels();
-            filter();
-            filteredframe.setImageType(OF_IMAGE_GRAYSCALE);
-            updateGradientField();
-			kinectColorImage.setFromPixels(kinect.getPixels());
+        // In lockstep no frame is dropped: the replay waits for the main thread
+        if (lockstep && !frameExchange.isReceived()){
+            ofSleepMillis(1);
+            continue;
         }
-        if (storedframes == 0)
         {
-            filtered.send(std::move(filteredframe));
-			gradient.send(std::move(gradField));
-            colored.send(std::move(kinectColorImage.getPixels()));
-            lock();
-            storedframes += 1;
-            unlock();
+            PROFILE_STAGE(STAGE_KINECT_UPDATE);
+            depthSource->update();
+        }
+        if(depthSource->isFrameNew()){
+            KinectFrame& frame = frameExchange.getBackFrame();
+            if (frame.clearGeneration != clearGeneration){
+                frame.depth.set(0);
+                frame.clearGeneration = clearGeneration;
+            }
+            kinectDepthImage = depthSource->getRawDepthPixels();
+            filter(frame.depth);
+            updateChangedTiles(frame);
+            updateGradientField(frame.depth, frame.gradient);
+            frame.gradFieldcols = gradFieldcols;
+            frame.gradFieldrows = gradFieldrows;
+            frame.color = depthSource->getPixels();
+            frame.imageStabilized = firstImageReady;
+            frame.sequence = ++frameSequence;
+            frame.publishTime = PipelineProfiler::now();
+            frameExchange.publish();
         }
-        
     }
-    kinect.close();
-    delete[] averagingBuffer;
-    delete[] statBuffer;
-    delete[] validBuffer;
-    delete[] gradField;
+    depthSource->close();
+    workerPool.release();
+    releaseBuffers();
 }
 
 void KinectGrabber::performInThread(std::function<void(KinectGrabber&)> action) {
@@ -190,86 +206,49 @@ void KinectGrabber::performInThread(std::function<void(KinectGrabber&)> action)
     this->actionsLock.unlock();
 }
 
-void KinectGrabber::filter()
+void KinectGrabber::filter(ofFloatPixels& filteredframe)
 {
     if (bufferInitiated)
     {
-        const RawDepth* inputFramePtr = static_cast<const RawDepth*>(kinectDepthImage.getData());
-        float* averagingBufferPtr = averagingBuffer+averagingSlotIndex*height*width;
-        float* statBufferPtr = statBuffer;
-        float* validBufferPtr = validBuffer;
-        float* filteredFramePtr = filteredframe.getData();
+        TemporalFilter::Parameters params;
+        params.maxOffset = maxOffset;
+        params.followBigChange = followBigChange;
+        params.bigChange = bigChange;
+        params.numAveragingSlots = numAveragingSlots;
+        params.minNumSamples = minNumSamples;
+        params.maxVariance = maxVariance;
+        params.hysteresis = hysteresis;
+        params.initialValue = initialValue;
         
-        inputFramePtr += minY*width;  // We only scan kinect ROI
-        averagingBufferPtr += minY*width;
-        statBufferPtr += minY*width*3;
-        validBufferPtr += minY*width;
-        filteredFramePtr += minY*width;
-
-		for(unsigned int y=minY ; y<maxY ; ++y)
+        TemporalFilter::Planes planes;
+        planes.input = static_cast<const RawDepth*>(kinectDepthImage.getData());
+        planes.averagingSlots = filterBuffers.getAveragingSlots();
+        planes.averagingSlotIndex = averagingSlotIndex;
+        planes.count = filterBuffers.getCount();
+        planes.sum = filterBuffers.getSum();
+        planes.sumSq = filterBuffers.getSumSq();
+        planes.valid = filterBuffers.getValid();
+        planes.output = filteredframe.getData();
+        
+        /* Filter the rows of the kinect ROI by bands in parallel and wait for all the bands: */
         {
-            inputFramePtr += minX;
-            averagingBufferPtr += minX;
-            statBufferPtr += minX*3;
-            validBufferPtr += minX;
-            filteredFramePtr += minX;
-            for(unsigned int x=minX ; x<maxX ; ++x,++inputFramePtr,++averagingBufferPtr,statBufferPtr+=3,++validBufferPtr,++filteredFramePtr)
-            {
-                float newVal = static_cast<float>(*inputFramePtr);
-                float oldVal = *averagingBufferPtr;
-                
-				if(newVal > maxOffset)//we are under the ceiling plane
-                {
-                    *averagingBufferPtr = newVal; // Store the value
-                    if (followBigChange && statBufferPtr[0] > 0){ // Follow big changes
-                        float oldFiltered = statBufferPtr[1]/statBufferPtr[0]; // Compare newVal with average
-                        if(oldFiltered-newVal >= bigChange || newVal-oldFiltered >= bigChange)
-                        {
-                            float* aaveragingBufferPtr;
-                            for (int i = 0; i < numAveragingSlots; i++){ // update all averaging slots
-                                aaveragingBufferPtr = averagingBuffer + i*height*width + y*width +x;
-                                *aaveragingBufferPtr = newVal;
-                            }
-                            statBufferPtr[0] = numAveragingSlots; //Update statistics
-                            statBufferPtr[1] = newVal*numAveragingSlots;
-                            statBufferPtr[2] = newVal*newVal*numAveragingSlots;
-                        }
-                    }
-                    /* Update the pixel's statistics: */
-                    ++statBufferPtr[0]; // Number of valid samples
-                    statBufferPtr[1] += newVal; // Sum of valid samples
-                    statBufferPtr[2] += newVal*newVal; // Sum of squares of valid samples
-                    
-                    /* Check if the previous value in the averaging buffer was not initiated */
-                    if(oldVal != initialValue)
-                    {
-                        --statBufferPtr[0]; // Number of valid samples
-                        statBufferPtr[1] -= oldVal; // Sum of valid samples
-                        statBufferPtr[2] -= oldVal * oldVal; // Sum of squares of valid samples
-                    }
-                }
-                // Check if the pixel is "stable": */
-                if(statBufferPtr[0] >= minNumSamples &&
-                   statBufferPtr[2]*statBufferPtr[0] <= maxVariance*statBufferPtr[0]*statBufferPtr[0] + statBufferPtr[1]*statBufferPtr[1])
+            PROFILE_STAGE(STAGE_FILTER);
+            int numBands = std::max(1, std::min(numFilterBands, ROIheight));
+            workerPool.run(numBands, [this, &params, &planes, numBands](int band) {
+                int bandMinY = minY + band*ROIheight/numBands;
+                int bandMaxY = minY + (band+1)*ROIheight/numBands;
+                for(int y=bandMinY ; y<bandMaxY ; ++y)
                 {
-                    /* Check if the new running mean is outside the previous value's envelope: */
-                    float newFiltered = statBufferPtr[1]/statBufferPtr[0];
-                    if(abs(newFiltered-*validBufferPtr) >= hysteresis)
-                    {
-                        /* Set the output pixel value to the depth-corrected running mean: */
-                        *filteredFramePtr = *validBufferPtr = newFiltered;
-                    } else {
-                        /* Leave the pixel at its previous value: */
-                        *filteredFramePtr = *validBufferPtr;
+                    // Tile by tile, to know where the stable depths changed
+                    unsigned char* changed = &rowChangedTiles[y*tileCols];
+                    for (int x = minX; x < maxX; ){
+                        int tile = x/KinectFrame::tileSize;
+                        int end = std::min((tile+1)*KinectFrame::tileSize, maxX);
+                        changed[tile] = temporalFilter.filterSpan(params, planes, y*width+x, y*width+end);
+                        x = end;
                     }
                 }
-                *filteredFramePtr = *validBufferPtr;
-			}
-            inputFramePtr += width-maxX;
-            averagingBufferPtr += width-maxX;
-            statBufferPtr += (width-maxX)*3;
-            validBufferPtr += width-maxX;
-            filteredFramePtr += width-maxX;
+            });
         }
 
         /* Go to the next averaging slot: */
@@ -285,106 +264,141 @@ void KinectGrabber::filter()
         /* Apply a spatial filter if requested: */
         if(spatialFilter)
         {
-            applySpaceFilter();
+            applySpaceFilter(filteredframe);
         }
 	}
 }
 
-void KinectGrabber::applySpaceFilter()
-{
-    for(int filterPass=0;filterPass<2;++filterPass)
-    {
-        /* Low-pass filter the entire output frame in-place: */
-        for(unsigned int x=minX;x<maxX;++x)
-        {
-            /* Get a pointer to the current column: */
-            float* colPtr = filteredframe.getData()+x;
-            
-            /* Filter the first pixel in the column: */
-            float lastVal = *colPtr;
-            *colPtr = (colPtr[0]*2.0f+colPtr[width])/3.0f;
-            colPtr += width;
-            
-            /* Filter the interior pixels in the column: */
-            for(unsigned int y=minY+1;y<maxY-1;++y,colPtr+=width)
-            {
-                /* Filter the pixel: */
-                float nextLastVal=*colPtr;
-                *colPtr=(lastVal+colPtr[0]*2.0f+colPtr[width])*0.25f;
-                lastVal=nextLastVal;
-            }
-            
-            /* Filter the last pixel in the column: */
-            *colPtr=(lastVal+colPtr[0]*2.0f)/3.0f;
-        }
-        float* rowPtr = filteredframe.getData();
-        for(unsigned int y=minY;y<maxY;++y)
-        {
-            /* Filter the first pixel in the row: */
-            float lastVal=*rowPtr;
-            *rowPtr=(rowPtr[0]*2.0f+rowPtr[1])/3.0f;
-            ++rowPtr;
-            
-            /* Filter the interior pixels in the row: */
-            for(unsigned int x=minX+1;x<maxX-1;++x,++rowPtr)
-            {
-                /* Filter the pixel: */
-                float nextLastVal=*rowPtr;
-                *rowPtr=(lastVal+rowPtr[0]*2.0f+rowPtr[1])*0.25f;
-                lastVal=nextLastVal;
-            }
-            
-            /* Filter the last pixel in the row: */
-            *rowPtr=(lastVal+rowPtr[0]*2.0f)/3.0f;
-            ++rowPtr;
+/**
+ * @fn	void KinectGrabber::updateChangedTiles(KinectFrame& frame)
+ *
+ * @brief	Sets the changed tiles of a frame from the valid values updated by the
+ * 			filter. The changes of a frame which the main thread did not receive are
+ * 			carried over to the next frame.
+ *
+ * @param	frame	The frame to publish.
+ */
+
+void KinectGrabber::updateChangedTiles(KinectFrame& frame){
+    if (frameExchange.isReceived())
+        std::fill(pendingChangedTiles.begin(), pendingChangedTiles.end(), 0);
+    if (allTilesChanged){
+        std::fill(pendingChangedTiles.begin(), pendingChangedTiles.end(), 1);
+        allTilesChanged = false;
+    } else if (bufferInitiated && minX < maxX){
+        int firstTile = minX/KinectFrame::tileSize;
+        int lastTile = (maxX-1)/KinectFrame::tileSize;
+        for (int y = minY; y < maxY; y++){
+            const unsigned char* changed = &rowChangedTiles[y*tileCols];
+            unsigned char* tiles = &pendingChangedTiles[(y/KinectFrame::tileSize)*tileCols];
+            for (int tile = firstTile; tile <= lastTile; tile++)
+                tiles[tile] |= changed[tile];
         }
     }
+    frame.changedTiles = pendingChangedTiles;
+    frame.tileCols = tileCols;
+    frame.tileRows = tileRows;
 }
 
-void KinectGrabber::updateGradientField()
+void KinectGrabber::applySpaceFilter(ofFloatPixels& filteredframe)
 {
-    int ind = 0;
-    float gx;
-    float gy;
-    int gvx, gvy;
-    float lgth = 0;
-    float* filteredFramePtr=filteredframe.getData();
-    for(unsigned int y=0;y<gradFieldrows;++y) {
-        for(unsigned int x=0;x<gradFieldcols;++x) {
-            if (isInsideROI(x*gradFieldresolution, y*gradFieldresolution) && isInsideROI((x+1)*gradFieldresolution, (y+1)*gradFieldresolution) ){
-                gx = 0;
-                gvx = 0;
-                gy = 0;
-                gvy = 0;
-                for (unsigned int i=0; i<gradFieldresolution; i++) {
-                    ind = y*gradFieldresolution*width+i*width+x*gradFieldresolution;
-                    if (filteredFramePtr[ind]!= 0 && filteredFramePtr[ind+gradFieldresolution-1]!=0){
-                        gvx+=1;
-                        gx+=filteredFramePtr[ind]-filteredFramePtr[ind+gradFieldresolution-1];
-                    }
-                    ind = y*gradFieldresolution*width+i+x*gradFieldresolution;
-                    if (filteredFramePtr[ind]!= 0 && filteredFramePtr[ind+(gradFieldresolution-1)*width]!=0){
-                        gvy+=1;
-                        gy+=filteredFramePtr[ind]-filteredFramePtr[ind+(gradFieldresolution-1)*width];
-                    }
-                }
-                if (gvx !=0 && gvy !=0)
-                    gradField[y*gradFieldcols+x]=ofVec2f(gx/gradFieldresolution/gvx, gy/gradFieldresolution/gvy);
-                if (gradField[y*gradFieldcols+x].length() > maxgradfield){
-                    gradField[y*gradFieldcols+x].scale(maxgradfield);// /= gradField[y*gradFieldcols+x].length()*maxgradfield;
-                    lgth+=1;
-                }
-            } else {
-                gradField[y*gradFieldcols+x] = ofVec2f(0);
-            }
+    PROFILE_STAGE(STAGE_SPATIAL_FILTER);
+    spaceFilter.apply(filteredframe.getData(), width, minX, minY, maxX, maxY);
+}
+
+/**
+ * @fn	void KinectGrabber::updateGradientField(const ofFloatPixels& filteredframe, vector<ofVec2f>& gradient)
+ *
+ * @brief	Computes the gradient field of the cells inside the ROI, the other
+ * 			cells are zero. The gradient of a cell is the mean difference between
+ * 			its first and last columns (x) and between its first and last rows (y),
+ * 			over the pixel pairs with a depth on both sides. The differences are
+ * 			read from two integral images built once per frame: prefix sums down
+ * 			the rows for the edge columns of every cell column, and prefix sums
+ * 			along the ROI for the edge rows of every cell row. Each component of a
+ * 			cell is then two subtractions. The sums are in double, exact for depth
+ * 			values, so a cell does not depend on the cells before it.
+ *
+ * @param	filteredframe	The filtered depth frame.
+ * @param	gradient	 	The gradient field, gradFieldcols*gradFieldrows cells.
+ */
+
+void KinectGrabber::updateGradientField(const ofFloatPixels& filteredframe, vector<ofVec2f>& gradient)
+{
+    PROFILE_STAGE(STAGE_GRADIENT_FIELD);
+    gradient.assign(gradFieldcols*gradFieldrows, ofVec2f(0));
+    const int r = gradFieldresolution;
+    if (r < 2)
+        return;
+
+    // Cells entirely inside the ROI
+    int firstCol = (minX+r-1)/r;
+    int lastCol = std::min(maxX/r, gradFieldcols); // Exclusive
+    int firstRow = (minY+r-1)/r;
+    int lastRow = std::min(maxY/r, gradFieldrows);
+    if (firstCol >= lastCol || firstRow >= lastRow)
+        return;
+    int numCols = lastCol-firstCol;
+    int numRows = lastRow-firstRow;
+    int x0 = firstCol*r;
+    int y0 = firstRow*r;
+    int numX = numCols*r;
+    int numY = numRows*r;
+    const float* filteredFramePtr = filteredframe.getData();
+    const float maxgradfield2 = maxgradfield*maxgradfield;
+
+    // X: (numY+1) rows of numCols prefix sums, row i sums the pixel rows y0 ... y0+i-1
+    gradientColumnSums.resize(static_cast<size_t>(numY+1)*numCols);
+    gradientColumnCounts.resize(static_cast<size_t>(numY+1)*numCols);
+    std::fill(gradientColumnSums.begin(), gradientColumnSums.begin()+numCols, 0.0);
+    std::fill(gradientColumnCounts.begin(), gradientColumnCounts.begin()+numCols, 0);
+    for (int i = 0; i < numY; i++){
+        const float* row = filteredFramePtr+static_cast<size_t>(y0+i)*width+x0;
+        const double* previousSums = &gradientColumnSums[static_cast<size_t>(i)*numCols];
+        const int* previousCounts = &gradientColumnCounts[static_cast<size_t>(i)*numCols];
+        double* sums = &gradientColumnSums[static_cast<size_t>(i+1)*numCols];
+        int* counts = &gradientColumnCounts[static_cast<size_t>(i+1)*numCols];
+        for (int c = 0; c < numCols; c++){
+            float left = row[c*r];
+            float right = row[c*r+r-1];
+            bool valid = left != 0 && right != 0;
+            sums[c] = previousSums[c]+(valid ? static_cast<double>(left)-right : 0);
+            counts[c] = previousCounts[c]+valid;
         }
     }
-}
 
-bool KinectGrabber::isInsideROI(int x, int y){
-    if (x<minX||x>maxX||y<minY||y>maxY)
-        return false;
-    return true;
+    // Y: numRows rows of numX+1 prefix sums, entry x sums the columns x0 ... x0+x-1
+    gradientRowSums.resize(static_cast<size_t>(numRows)*(numX+1));
+    gradientRowCounts.resize(static_cast<size_t>(numRows)*(numX+1));
+    for (int j = 0; j < numRows; j++){
+        const float* top = filteredFramePtr+static_cast<size_t>(y0+j*r)*width+x0;
+        const float* bottom = top+static_cast<size_t>(r-1)*width;
+        double* sums = &gradientRowSums[static_cast<size_t>(j)*(numX+1)];
+        int* counts = &gradientRowCounts[static_cast<size_t>(j)*(numX+1)];
+        sums[0] = 0;
+        counts[0] = 0;
+        for (int x = 0; x < numX; x++){
+            bool valid = top[x] != 0 && bottom[x] != 0;
+            sums[x+1] = sums[x]+(valid ? static_cast<double>(top[x])-bottom[x] : 0);
+            counts[x+1] = counts[x]+valid;
+        }
+    }
+
+    for (int j = 0; j < numRows; j++){
+        size_t top = static_cast<size_t>(j*r)*numCols;
+        size_t bottom = static_cast<size_t>((j+1)*r)*numCols;
+        size_t row = static_cast<size_t>(j)*(numX+1);
+        for (int c = 0; c < numCols; c++){
+            int gvx = gradientColumnCounts[bottom+c]-gradientColumnCounts[top+c];
+            float gx = static_cast<float>(gradientColumnSums[bottom+c]-gradientColumnSums[top+c]);
+            int gvy = gradientRowCounts[row+(c+1)*r]-gradientRowCounts[row+c*r];
+            float gy = static_cast<float>(gradientRowSums[row+(c+1)*r]-gradientRowSums[row+c*r]);
+            ofVec2f g(gvx != 0 ? gx/r/gvx : 0, gvy != 0 ? gy/r/gvy : 0);
+            if (g.lengthSquared() > maxgradfield2)
+                g.scale(maxgradfield);
+            gradient[(firstRow+j)*gradFieldcols+firstCol+c] = g;
+        }
+    }
 }
 
 void KinectGrabber::setKinectROI(ofRectangle ROI){
@@ -397,63 +411,67 @@ void KinectGrabber::setKinectROI(ofRectangle ROI){
     resetBuffers();
 }
 
+void KinectGrabber::setNumFilterBands(int snumFilterBands){
+    numFilterBands = snumFilterBands;
+    if (numFilterBands < 1) // Automatic: one band per core
+        numFilterBands = WorkerPool::getHardwareConcurrency();
+    workerPool.setup(numFilterBands-1); // The grabber thread filters a band too
+    ofLogVerbose("kinectGrabber") << "setNumFilterBands(): Number of filter bands: " << numFilterBands;
+}
+
+void KinectGrabber::setSpatialFilterKernel(SpatialFilter::Kernel skernel){
+    spaceFilter.setKernel(skernel);
+    allTilesChanged = true;
+    ofLogVerbose("kinectGrabber") << "setSpatialFilterKernel(): Spatial filter kernel: " << SpatialFilter::getKernelName(spaceFilter.getKernel());
+}
+
+void KinectGrabber::setSpatialFilterPasses(int snumPasses){
+    spaceFilter.setNumPasses(snumPasses);
+    allTilesChanged = true;
+    ofLogVerbose("kinectGrabber") << "setSpatialFilterPasses(): Spatial filter passes: " << spaceFilter.getNumPasses();
+}
+
+void KinectGrabber::setLockstep(bool slockstep){
+    lockstep = slockstep;
+}
+
 void KinectGrabber::setAveragingSlotsNumber(int snumAveragingSlots){
-    if (bufferInitiated){
-            bufferInitiated = false;
-            delete[] averagingBuffer;
-            delete[] statBuffer;
-            delete[] validBuffer;
-            delete[] gradField;
-        }
+    releaseBuffers();
     numAveragingSlots = snumAveragingSlots;
     minNumSamples=(numAveragingSlots+1)/2;
     initiateBuffers();
 }
 
 void KinectGrabber::setGradFieldResolution(int sgradFieldresolution){
-    if (bufferInitiated){
-        bufferInitiated = false;
-        delete[] averagingBuffer;
-        delete[] statBuffer;
-        delete[] validBuffer;
-        delete[] gradField;
-    }
     gradFieldresolution = sgradFieldresolution;
-    initiateBuffers();
+    gradFieldcols = width / gradFieldresolution;
+    gradFieldrows = height / gradFieldresolution;
+    ofLogVerbose("kinectGrabber") << "setGradFieldResolution(): Gradient Field Cols: " << gradFieldcols << " Rows: " << gradFieldrows;
 }
 
 void KinectGrabber::setFollowBigChange(bool newfollowBigChange){
-    if (bufferInitiated){
-        bufferInitiated = false;
-        delete[] averagingBuffer;
-        delete[] statBuffer;
-        delete[] validBuffer;
-        delete[] gradField;
-    }
+    releaseBuffers();
     followBigChange = newfollowBigChange;
     initiateBuffers();
 }
 
 ofVec3f KinectGrabber::getStatBuffer(int x, int y){
-    float* statBufferPtr = statBuffer+3*(x + y*width);
-    return ofVec3f(statBufferPtr[0], statBufferPtr[1], statBufferPtr[2]);
+    return ofVec3f(filterBuffers.getCount(x, y), filterBuffers.getSum(x, y), filterBuffers.getSumSq(x, y));
 }
 
 float KinectGrabber::getAveragingBuffer(int x, int y, int slotNum){
-    float* averagingBufferPtr = averagingBuffer + slotNum*height*width + (x + y*width);
-    return *averagingBufferPtr;
+    return filterBuffers.getAveragingSlot(x, y, slotNum);
 }
 
 float KinectGrabber::getValidBuffer(int x, int y){
-    float* validBufferPtr = validBuffer + (x + y*width);
-    return *validBufferPtr;
+    return filterBuffers.getValid(x, y);
 }
 
 ofMatrix4x4 KinectGrabber::getWorldMatrix() {
 	auto mat = ofMatrix4x4();
 	if (kinectOpened) {
-		ofVec3f a = kinect.getWorldCoordinateAt(0, 0, 1);// Trick to access kinect internal parameters without having to modify ofxKinect
-		ofVec3f b = kinect.getWorldCoordinateAt(1, 1, 1);
+		ofVec3f a = depthSource->getWorldCoordinateAt(0, 0, 1);// Trick to access kinect internal parameters without having to modify ofxKinect
+		ofVec3f b = depthSource->getWorldCoordinateAt(1, 1, 1);
 		ofLogVerbose("kinectGrabber") << "getWorldMatrix(): Computing kinect world matrix";
 		mat = ofMatrix4x4(b.x - a.x, 0, 0, a.x,
 			0, b.y - a.y, 0, a.y,
@@ -26,6 +26,13 @@ General Public License for more details.
 #include "ofxKinect.h"
 
 #include "Utils.h"
+#include "TemporalFilter.h"
+#include "FilterBuffers.h"
+#include "SpatialFilter.h"
+#include "WorkerPool.h"
+#include "FrameExchange.h"
+#include "DepthSource.h"
+#include "PipelineProfiler.h"
 
 class KinectGrabber: public ofThread {
 public:
@@ -37,11 +44,12 @@ public:
     void start();
     void stop();
     void performInThread(std::function<void(KinectGrabber&)> action);
-    bool setup();
+    bool setup(std::shared_ptr<DepthSource> sdepthSource); // Source of the raw frames
 	bool openKinect();
 	void setupFramefilter(int gradFieldresolution, float newMaxOffset, ofRectangle ROI, bool spatialFilter, bool followBigChange, int numAveragingSlots);
     void initiateBuffers(void); // Reinitialise buffers
     void resetBuffers(void);
+    void releaseBuffers(void);
     
     ofVec3f getStatBuffer(int x, int y);
     float getAveragingBuffer(int x, int y, int slotNum);
@@ -51,10 +59,13 @@ public:
     void setKinectROI(ofRectangle skinectROI);
     void setAveragingSlotsNumber(int snumAveragingSlots);
     void setGradFieldResolution(int sgradFieldresolution);
-    
-    void decStoredframes(){
-        storedframes -= 1;
+    void setNumFilterBands(int snumFilterBands); // Values < 1 use one band per core
+    int getNumFilterBands() const {
+        return numFilterBands;
     }
+    void setSpatialFilterKernel(SpatialFilter::Kernel skernel);
+    void setSpatialFilterPasses(int snumPasses);
+    void setLockstep(bool slockstep); // Wait for the main thread to receive each frame before reading the next one
     
     bool isImageStabilized(){
         return firstImageReady;
@@ -84,23 +95,24 @@ public:
     
     void setSpatialFiltering(bool newspatialFilter){
         spatialFilter = newspatialFilter;
+        allTilesChanged = true;
     }
     
-	ofThreadChannel<ofFloatPixels> filtered;
-	ofThreadChannel<ofPixels> colored;
-	ofThreadChannel<ofVec2f*> gradient;
+	FrameExchange frameExchange; // Filtered frames sent to the main thread
     
 private:
 	void threadedFunction() override;
-    void filter();
-    bool isInsideROI(int x, int y); // test is x, y is inside ROI
-    void applySpaceFilter();
-    void updateGradientField();
+    void filter(ofFloatPixels& filteredframe);
+    void applySpaceFilter(ofFloatPixels& filteredframe);
+    void updateChangedTiles(KinectFrame& frame);
+    void updateGradientField(const ofFloatPixels& filteredframe, vector<ofVec2f>& gradient);
     
 	bool newFrame;
+    bool lockstep;
     bool bufferInitiated;
     bool firstImageReady;
-    int storedframes;
+    unsigned long long frameSequence; // Number of filtered frames
+    unsigned int clearGeneration; // Incremented when the filtered frames have to be cleared
     
     // Thread lambda functions (actions)
 	vector<std::function<void(KinectGrabber&)> > actions;
@@ -108,26 +120,33 @@ private:
     
     // Kinect parameters
 	bool kinectOpened;
-    ofxKinect               kinect;
+    std::shared_ptr<DepthSource> depthSource; // Kinect, recording or replay
     unsigned int width, height; // Width and height of kinect frames
     int minX, maxX, ROIwidth; // ROI definition
     int minY, maxY, ROIheight;
     
     // General buffers
-    ofxCvColorImage         kinectColorImage;
     ofShortPixels     kinectDepthImage;
-    ofFloatPixels filteredframe;
-    ofVec2f* gradField;
     
     // Filtering buffers
-	float* averagingBuffer; // Buffer to calculate running averages of each pixel's depth value
-	float* statBuffer; // Buffer retaining the running means and variances of each pixel's depth value
-	float* validBuffer; // Buffer holding the most recent stable depth value for each pixel
+	FilterBuffers filterBuffers; // Averaging slots, running means and variances and most recent stable value of each pixel's depth value
+    TemporalFilter temporalFilter; // Vectorized running average filter
+    WorkerPool workerPool; // Threads filtering the ROI bands
+    int numFilterBands; // Number of row bands of the ROI filtered in parallel
+    
+    // Tiles of KinectFrame::tileSize pixels where the stable depths changed
+    int tileCols, tileRows;
+    vector<unsigned char> rowChangedTiles; // Tiles changed in each row of the frame, written by the band of the row
+    vector<unsigned char> pendingChangedTiles; // Changes not received by the main thread yet
+    bool allTilesChanged; // The filtered frame changed everywhere: buffers reset or spatial filter changed
     
     // Gradient computation variables
     int gradFieldcols, gradFieldrows;
     int gradFieldresolution;           //Resolution of grid relative to window width and height in pixels
     float maxgradfield, depthrange;
+    vector<double> gradientColumnSums; // Prefix sums down the ROI rows of the first/last column differences of each cell column
+    vector<double> gradientRowSums; // Prefix sums along the ROI of the first/last row differences of each cell row
+    vector<int> gradientColumnCounts, gradientRowCounts; // Number of pixel pairs in the sums
     
     // Frame filter parameters
 	int numAveragingSlots; // Number of slots in each pixel's averaging buffer
@@ -141,6 +160,7 @@ private:
     float bigChange; // Amount of change over which the averaging slot is reset to new value
 	float instableValue; // Value to assign to instable pixels if retainValids is false
 	bool spatialFilter; // Flag whether to apply a spatial filter to time-averaged depth values
+    SpatialFilter spaceFilter; // Separable smoothing of the ROI of the filtered frame
     float maxOffset;
     
     int minInitFrame; // Minimal number of frame to consider the kinect initialized
@@ -33,14 +33,23 @@ basePlaneUpdated (false),
 projKinectCalibrationUpdated (false),
 ROIUpdated (false),
 imageStabilized (false),
+frameNew (false),
+frameSequence (0),
+tileCols (0),
+tileRows (0),
+fishInd (-1),
 waitingForFlattenSand (false),
-drawKinectView(false)
+drawKinectView(false),
+planeFitter(workerPool),
+driftTracking(false),
+terrainAnalysis(workerPool)
 {
     projWindow = p;
 }
 
 void KinectProjector::setup(bool sdisplayGui){
 	ofAddListener(ofEvents().exit, this, &KinectProjector::exit);
+    PipelineProfiler::get().setThreadName("Main");
 	
 	// instantiate the modal windows //
     modalTheme = make_shared<ofxModalThemeProjKinect>();
@@ -83,7 +92,10 @@ void KinectProjector::setup(bool sdisplayGui){
     maxOffsetSafeRange = 50; // Range above the autocalib measured max offset
 
     // kinectgrabber: start & default setup
-	kinectOpened = kinectgrabber.setup();
+    if (captureSettings.load("settings/captureSettings.xml"))
+        ofLogVerbose("KinectProjector") << "KinectProjector.setup(): Capture settings loaded " ;
+	kinectOpened = kinectgrabber.setup(DepthSource::create(captureSettings));
+    kinectgrabber.setLockstep(captureSettings.mode == CaptureSettings::MODE_REPLAY && captureSettings.lockstep);
 	if (!kinectOpened){
 	    confirmModal->setMessage("Cannot connect to Kinect. Please check that the kinect is (1) connected, (2) powerer and (3) not used by another application.");
 	    confirmModal->show();
@@ -91,6 +103,10 @@ void KinectProjector::setup(bool sdisplayGui){
 	spatialFiltering = true;
     followBigChanges = false;
     numAveragingSlots = 15;
+    numFilterBands = 0;
+    projectorMapStep = 2;
+    spatialFilterKernel = SpatialFilter::KERNEL_BINOMIAL3;
+    spatialFilterPasses = 2;
     
     // Get projector and kinect width & height
     projRes = ofVec2f(projWindow->getWidth(), projWindow->getHeight());
@@ -99,6 +115,7 @@ void KinectProjector::setup(bool sdisplayGui){
     
     // Initialize the fbos and images
     FilteredDepthImage.allocate(kinectRes.x, kinectRes.y);
+    depthTexture.allocate(kinectRes.x, kinectRes.y, GL_R32F);
     kinectColorImage.allocate(kinectRes.x, kinectRes.y);
     thresholdedImage.allocate(kinectRes.x, kinectRes.y);
     Dptimg.allocate(20, 20); // Small detailed ROI
@@ -129,11 +146,19 @@ void KinectProjector::setup(bool sdisplayGui){
     } else {
         ofLogVerbose("KinectProjector") << "KinectProjector.setup(): Settings could not be loaded " ;
     }
+    // The ROI may come from a depth source with a larger frame size
+    kinectROI = kinectROI.getIntersection(ofRectangle(0, 0, kinectRes.x, kinectRes.y));
     
 	// finish kinectgrabber setup and start the grabber
+    kinectgrabber.setNumFilterBands(numFilterBands);
+    workerPool.setup(kinectgrabber.getNumFilterBands()-1); // The main thread runs tasks too
+    kinectgrabber.setSpatialFilterKernel(spatialFilterKernel);
+    kinectgrabber.setSpatialFilterPasses(spatialFilterPasses);
     kinectgrabber.setupFramefilter(gradFieldResolution, maxOffset, kinectROI, spatialFiltering, followBigChanges, numAveragingSlots);
     kinectWorldMatrix = kinectgrabber.getWorldMatrix();
     ofLogVerbose("KinectProjector") << "KinectProjector.setup(): kinectWorldMatrix: " << kinectWorldMatrix ;
+    projectorMap.setStep(projectorMapStep);
+    updateCoordinateMaps();
     
     // Setup gradient field
     setupGradientField();
@@ -167,11 +192,7 @@ void KinectProjector::setupGradientField(){
     gradFieldcols = kinectRes.x / gradFieldResolution;
     gradFieldrows = kinectRes.y / gradFieldResolution;
     
-    gradField = new ofVec2f[gradFieldcols*gradFieldrows];
-    ofVec2f* gfPtr=gradField;
-    for(unsigned int y=0;y<gradFieldrows;++y)
-        for(unsigned int x=0;x<gradFieldcols;++x,++gfPtr)
-            *gfPtr=ofVec2f(0);
+    gradientField.setup(gradFieldcols, gradFieldrows, gradFieldResolution);
 }
 
 void KinectProjector::setGradFieldResolution(int sgradFieldResolution){
@@ -183,36 +204,58 @@ void KinectProjector::setGradFieldResolution(int sgradFieldResolution){
 }
 
 void KinectProjector::update(){
+    PipelineProfiler::get().collect();
+    PROFILE_STAGE(STAGE_PROJECTOR_UPDATE);
+
     // Clear updated state variables
     basePlaneUpdated = false;
     ROIUpdated = false;
     projKinectCalibrationUpdated = false;
+    frameNew = false;
 
-	if (displayGui)
+	if (displayGui){
+        if (ofGetFrameNum() % 15 == 0)
+            updateProfilerGui();
 		gui->update();
+    }
 
-    // Get depth image from kinect grabber
-    ofFloatPixels filteredframe;
-    if (kinectgrabber.filtered.tryReceive(filteredframe)) {
-        FilteredDepthImage.setFromPixels(filteredframe.getData(), kinectRes.x, kinectRes.y);
-        FilteredDepthImage.updateTexture();
-        
-        // Get color image from kinect grabber
-        ofPixels coloredframe;
-        if (kinectgrabber.colored.tryReceive(coloredframe)) {
-            kinectColorImage.setFromPixels(coloredframe);
+    // Get the most recent frame from kinect grabber
+    if (kinectgrabber.frameExchange.receive()) {
+        KinectFrame& frame = kinectgrabber.frameExchange.getFrontFrame();
+        frameNew = true;
+        frameSequence = frame.sequence;
+        if (tileChangeSequences.size() != frame.changedTiles.size()){
+            tileChangeSequences.assign(frame.changedTiles.size(), 0);
+            tileCols = frame.tileCols;
+            tileRows = frame.tileRows;
+        }
+        for (size_t i = 0; i < frame.changedTiles.size(); i++){
+            if (frame.changedTiles[i])
+                tileChangeSequences[i] = frameSequence;
         }
+        PipelineProfiler::get().record(STAGE_FRAME_HANDOFF, frame.publishTime, PipelineProfiler::now());
+        // Follow the drift of the sea level, a few rows per frame of the maps of the
+        // previous frame, so that the new maps are built once with the corrected plane
+        if (driftTracking && !calibrating && driftTracker.update(elevationMap, terrainAnalysis, basePlaneEq)){
+            basePlaneEq = driftTracker.getCorrectedPlaneEq();
+            basePlaneNormal = ofVec3f(basePlaneEq);
+            basePlaneOffset = ofVec3f(0,0,-basePlaneEq.w);
+            basePlaneUpdated = true;
+        }
+        
+        // The front frame is ours until the next receive(): it is read in place, without copy
+        depthTexture.loadData(frame.depth);
+        updateCoordinateMaps();
         
-        // Get gradient field from kinect grabber
-        kinectgrabber.gradient.tryReceive(gradField);
+        // Get color image
+        kinectColorImage.setFromPixels(frame.color);
         
-        // Update grabber stored frame number
-        kinectgrabber.lock();
-        kinectgrabber.decStoredframes();
-        kinectgrabber.unlock();
+        // Hand the gradient field over to the readers (skipped while the grabber has not switched to a new resolution yet)
+        if (frame.gradFieldcols == gradFieldcols && frame.gradFieldrows == gradFieldrows)
+            gradientField.publish(frame.gradient, gradFieldcols, gradFieldrows, gradFieldResolution);
         
         // Is the depth image stabilized
-        imageStabilized = kinectgrabber.isImageStabilized();
+        imageStabilized = frame.imageStabilized;
         
         // Are we calibrating ?
         if (calibrating && !waitingForFlattenSand) {
@@ -221,6 +264,8 @@ void KinectProjector::update(){
 			//ofEnableAlphaBlending();
 			fboMainWindow.begin();
             if (drawKinectView){
+                // Scaled to the native scale for display
+                FilteredDepthImage.setFromPixels(frame.depth.getData(), kinectRes.x, kinectRes.y);
                 FilteredDepthImage.draw(0, 0);
 				ofNoFill();
 				ofDrawRectangle(kinectROI);
@@ -231,6 +276,51 @@ void KinectProjector::update(){
             fboMainWindow.end();
         }
     }
+    
+    // The base plane may have changed since the maps were built (gui without a new frame, calibration)
+    if (basePlaneUpdated && elevationMap.getBasePlaneEq() != basePlaneEq){
+        elevationMap.setBasePlaneEq(basePlaneEq);
+        terrainAnalysis.update(elevationMap);
+    }
+}
+
+/**
+ * @fn	bool KinectProjector::hasAreaChanged(int x0, int y0, int x1, int y1, unsigned long long sinceSequence) const
+ *
+ * @brief	Checks the change tiles covering a kinect area, a change in a tile is a
+ * 			possible change of all its pixels.
+ *
+ * @param	x0			 	The first column of the area.
+ * @param	y0			 	The first row of the area.
+ * @param	x1			 	The column after the area.
+ * @param	y1			 	The row after the area.
+ * @param	sinceSequence	The sequence of the last frame already seen by the caller.
+ *
+ * @return	True if a tile of the area changed after sinceSequence, or if no frame
+ * 			was received yet.
+ */
+
+bool KinectProjector::hasAreaChanged(int x0, int y0, int x1, int y1, unsigned long long sinceSequence) const{
+    if (tileChangeSequences.empty())
+        return true;
+    int firstCol = std::max(x0, 0)/KinectFrame::tileSize;
+    int lastCol = std::min((x1-1)/KinectFrame::tileSize, tileCols-1);
+    int firstRow = std::max(y0, 0)/KinectFrame::tileSize;
+    int lastRow = std::min((y1-1)/KinectFrame::tileSize, tileRows-1);
+    for (int row = firstRow; row <= lastRow; row++){
+        for (int col = firstCol; col <= lastCol; col++){
+            if (tileChangeSequences[row*tileCols+col] > sinceSequence)
+                return true;
+        }
+    }
+    return false;
+}
+
+void KinectProjector::updateCoordinateMaps(){
+    const float* depth = getDepthFrame();
+    elevationMap.update(depth, kinectRes.x, kinectROI, kinectWorldMatrix, basePlaneEq);
+    terrainAnalysis.update(elevationMap);
+    projectorMap.update(depth, kinectRes.x, kinectROI, kinectWorldMatrix, kinectProjMatrix);
 }
 
 void KinectProjector::updateCalibration(){
@@ -343,36 +433,17 @@ void KinectProjector::updateROIFromDepthImage(){
         ROICalibState = ROI_CALIBRATION_STATE_MOVE_UP;
         large = ofPolyline();
         ofxCvFloatImage temp;
-        temp.setFromPixels(FilteredDepthImage.getFloatPixelsRef().getData(), kinectRes.x, kinectRes.y);
+        temp.setFromPixels(getDepthFrame(), kinectRes.x, kinectRes.y);
         temp.setNativeScale(FilteredDepthImage.getNativeScaleMin(), FilteredDepthImage.getNativeScaleMax());
         temp.convertToRange(0, 1);
         thresholdedImage.setFromPixels(temp.getFloatPixelsRef());
-        threshold = 0; // We go from the higher distance to the kinect (lower position) to the lower distance
     } else if (ROICalibState == ROI_CALIBRATION_STATE_MOVE_UP) {
-        while (threshold < 255){
-            cvThreshold(thresholdedImage.getCvImage(), thresholdedImage.getCvImage(), 255-threshold, 255, CV_THRESH_TOZERO_INV);
-            thresholdedImage.updateTexture();
-            contourFinder.findContours(thresholdedImage, 12, kinectRes.x*kinectRes.y, 5, true, false);
-            ofPolyline small = ofPolyline();
-            for (int i = 0; i < contourFinder.nBlobs; i++) {
-                ofxCvBlob blobContour = contourFinder.blobs[i];
-                if (blobContour.hole) {
-                    ofPolyline poly = ofPolyline(blobContour.pts);
-                    if (poly.inside(kinectRes.x/2, kinectRes.y/2))
-                    {
-                        if (small.size() == 0 || poly.getArea() < small.getArea()) {
-                            small = poly;
-                        }
-                    }
-                }
-            }
-            if (large.getArea() < small.getArea())
-            {
-                ofLogVerbose("KinectProjector") << "updateROIFromDepthImage(): updating ROI" ;
-                large = small;
-            }
-            threshold+=1;
-        }
+        // Largest hole in the walls around the center at all the depth levels, in one sweep
+        uint64_t start = PipelineProfiler::now();
+        large = ofPolyline();
+        if (roiDetector.detect(thresholdedImage.getPixels().getData(), kinectRes.x, kinectRes.y))
+            large = roiDetector.getWallPolygon();
+        ofLogVerbose("KinectProjector") << "updateROIFromDepthImage(): walls found at level " << roiDetector.getLevel() << " in " << (PipelineProfiler::now()-start)/1000.0 << " ms" ;
         if (large.getArea() == 0)
         {
             calibModal->hide();
@@ -381,8 +452,7 @@ void KinectProjector::updateROIFromDepthImage(){
             confirmModal->show();
             calibrating = false;
         } else {
-            kinectROI = large.getBoundingBox();
-//            insideROIPoly = large.getResampledBySpacing(10);
+            kinectROI = roiDetector.getROI();
             kinectROI.standardize();
             calibModal->setMessage("Sand area successfully detected");
             ofLogVerbose("KinectProjector") << "updateROIFromDepthImage(): final kinectROI : " << kinectROI ;
@@ -478,6 +548,12 @@ void KinectProjector::updateProjKinectAutoCalibration(){
         cleared = false;
         upframe = false;
         trials = 0;
+        chessboardDetector.setPatternSize(chessboardX-1, chessboardY-1);
+        chessboardDetector.clearCorrespondences();
+        lastSearchWindowed = false;
+        pairsKinect.clear();
+        pairsProjector.clear();
+        kpt->clear();
         autoCalibState = AUTOCALIB_STATE_NEXT_POINT;
     } else if (autoCalibState == AUTOCALIB_STATE_NEXT_POINT && imageStabilized){
         if (currentCalibPts < 5 || (upframe && currentCalibPts < 10)) {
@@ -489,17 +565,22 @@ void KinectProjector::updateProjKinectAutoCalibration(){
                 calibModal->setMessage(mess);
             }
             
+            // The chessboard is searched in the background, the main loop keeps running meanwhile
+            if (!chessboardDetector.isBusy()){
+                if (frameNew)
+                    startChessboardSearch();
+                return;
+            }
+            ChessboardDetector::Result result;
+            if (!chessboardDetector.getResult(result))
+                return;
+            cvPoints = result.corners;
+            lastSearchWindowed = result.window != ofRectangle(0, 0, kinectRes.x, kinectRes.y);
             cvRgbImage = ofxCv::toCv(kinectColorImage.getPixels());
             cv::Size patternSize = cv::Size(chessboardX-1, chessboardY-1);
-            int chessFlags = cv::CALIB_CB_ADAPTIVE_THRESH + cv::CALIB_CB_FAST_CHECK;
-            bool foundChessboard = findChessboardCorners(cvRgbImage, patternSize, cvPoints, chessFlags);
+            bool foundChessboard = result.found;
             if(foundChessboard) {
                 if (cleared) { // We have previously detected a cleared screen <- Be sure that we don't acquire several times the same chessboard
-                    cv::Mat gray;
-                    cvtColor(cvRgbImage, gray, CV_RGB2GRAY);
-                    cornerSubPix(gray, cvPoints, cv::Size(11, 11), cv::Size(-1, -1),
-                                 cv::TermCriteria(CV_TERMCRIT_EPS + CV_TERMCRIT_ITER, 30, 0.1));
-                    
                     drawChessboardCorners(cvRgbImage, patternSize, cv::Mat(cvPoints), foundChessboard);
                     kinectColorImage.updateTexture();
                     fboMainWindow.begin();
@@ -510,6 +591,7 @@ void KinectProjector::updateProjKinectAutoCalibration(){
                     bool okchess = addPointPair();
                     
                     if (okchess) {
+                        chessboardDetector.addCorrespondences(currentProjectorPoints, cvPoints);
                         fboProjWindow.begin(); // Clear projector
                         ofBackground(255);
                         fboProjWindow.end();
@@ -577,10 +659,17 @@ void KinectProjector::updateProjKinectAutoCalibration(){
             confirmModal->setMessage("No point could be acquired. ");
             confirmModal->show();
             calibrating = false;
+        } else if (!kpt->calibrate()) { // Robust fit of the pairs accumulated by addPointPair()
+            ofLogVerbose("KinectProjector") << "autoCalib(): Error: The acquired points do not determine a projection !!" ;
+            calibModal->hide();
+            confirmModal->setTitle("Calibration failed");
+            confirmModal->setMessage("The acquired points do not determine a projection. ");
+            confirmModal->show();
+            calibrating = false;
         } else {
-            ofLogVerbose("KinectProjector") << "autoCalib(): Calibrating" ;
-            kpt->calibrate(pairsKinect, pairsProjector);
+            ofLogVerbose("KinectProjector") << "autoCalib(): Calibrated" ;
             kinectProjMatrix = kpt->getProjectionMatrix();
+            updateCoordinateMaps();
 
 			updateROIFromCalibration(); // Compute the limite of the ROI according to the projected area 
 
@@ -595,6 +684,27 @@ void KinectProjector::updateProjKinectAutoCalibration(){
     } else if (autoCalibState == AUTOCALIB_STATE_DONE){
     }
 }
+/**
+ * @fn	void KinectProjector::startChessboardSearch()
+ *
+ * @brief	Starts the background search of the chessboard in the current color
+ * 			frame. A displayed chessboard is searched in the window predicted from
+ * 			its projector position, the whole frame is searched to check that the
+ * 			screen was cleared and after a failed windowed search.
+ *
+ */
+
+void KinectProjector::startChessboardSearch(){
+    ofRectangle frame(0, 0, kinectRes.x, kinectRes.y);
+    ofRectangle window = frame;
+    if (cleared && !(lastSearchWindowed && trials > 0)){
+        ofPoint dispPt = ofPoint(projRes.x/2,projRes.y/2)+autoCalibPts[currentCalibPts];
+        ofRectangle chessboard(dispPt.x-chessboardSize/2, dispPt.y-chessboardSize/2, chessboardSize, chessboardSize);
+        window = chessboardDetector.predictWindow(chessboard, ofRectangle(0, 0, projRes.x, projRes.y), kinectROI, frame);
+    }
+    chessboardDetector.start(kinectColorImage.getPixels(), window);
+}
+
 //TODO: Add manual Prj Kinect calibration
 void KinectProjector::updateProjKinectManualCalibration(){
     // Draw a Chessboard
@@ -626,17 +736,12 @@ void KinectProjector::updateBasePlane(){
         ofLogVerbose("KinectProjector") << "updateBasePlane(): smallROI is null, cannot compute base plane normal" ;
         return;
     }
-    ofVec4f pt;
-    ofVec3f* points;
-    points = new ofVec3f[sw*sh];
-    ofLogVerbose("KinectProjector") << "updateBasePlane(): Computing points in smallROI : " << sw*sh ;
-    for (int x = 0; x<sw; x++){
-        for (int y = 0; y<sh; y ++){
-            points[x+y*sw] = kinectCoordToWorldCoord(x+sl, y+st);
-        }
+    ofLogVerbose("KinectProjector") << "updateBasePlane(): Computing plane from points in smallROI : " << sw*sh ;
+    if (!planeFitter.fit(getDepthFrame(), kinectRes.x, kinectRes.y, smallROI, kinectWorldMatrix)) {
+        ofLogVerbose("KinectProjector") << "updateBasePlane(): The points don't span a plane, keeping the previous base plane" ;
+        return;
     }
-    ofLogVerbose("KinectProjector") << "updateBasePlane(): Computing plane from points" ;
-    basePlaneEq = plane_from_points(points, sw*sh);
+    basePlaneEq = planeFitter.getPlaneEq();
     basePlaneNormal = ofVec3f(basePlaneEq);
     basePlaneOffset = ofVec3f(0,0,-basePlaneEq.w);
     basePlaneNormalBack = basePlaneNormal;
@@ -657,17 +762,12 @@ void KinectProjector::updateMaxOffset(){
         ofLogVerbose("KinectProjector") << "updateMaxOffset(): smallROI is null, cannot compute base plane normal" ;
         return;
     }
-    ofVec4f pt;
-    ofVec3f* points;
-    points = new ofVec3f[sw*sh];
-    ofLogVerbose("KinectProjector") << "updateMaxOffset(): Computing points in smallROI : " << sw*sh ;
-    for (int x = 0; x<sw; x++){
-        for (int y = 0; y<sh; y ++){
-            points[x+y*sw] = kinectCoordToWorldCoord(x+sl, y+st);//vertexCcvertexCc;
-        }
+    ofLogVerbose("KinectProjector") << "updateMaxOffset(): Computing plane from points in smallROI : " << sw*sh ;
+    if (!planeFitter.fit(getDepthFrame(), kinectRes.x, kinectRes.y, smallROI, kinectWorldMatrix)) {
+        ofLogVerbose("KinectProjector") << "updateMaxOffset(): The points don't span a plane, keeping the previous max offset" ;
+        return;
     }
-    ofLogVerbose("KinectProjector") << "updateMaxOffset(): Computing plane from points" ;
-    ofVec4f eqoff = plane_from_points(points, sw*sh);
+    ofVec4f eqoff = planeFitter.getPlaneEq();
     maxOffset = -eqoff.w-maxOffsetSafeRange;
     maxOffsetBack = maxOffset;
     // Update max Offset
@@ -692,6 +792,7 @@ bool KinectProjector::addPointPair() {
 //            cout << "Kinect: " << worldPoint << "Proj: " << currentProjectorPoints[i] << endl;
             pairsKinect.push_back(worldPoint);
             pairsProjector.push_back(currentProjectorPoints[i]);
+            kpt->addPointPair(worldPoint, currentProjectorPoints[i]);
         }
         resultMessage = "addPointPair(): Added " + ofToString((chessboardX-1)*(chessboardY-1)) + " points pairs.";
     } else {
@@ -753,19 +854,30 @@ void KinectProjector::drawChessboard(int x, int y, int chessboardSize) {
 void KinectProjector::drawGradField()
 {
     ofClear(255, 0);
-    for(int rowPos=0; rowPos< gradFieldrows ; rowPos++)
+    std::shared_ptr<const GradientFieldSnapshot> field = gradientField.getSnapshot();
+    int resolution = field->resolution;
+    vector<ofVec2f> kinectPoints(field->cols*field->rows);
+    for(int rowPos=0; rowPos< field->rows ; rowPos++)
     {
-        for(int colPos=0; colPos< gradFieldcols ; colPos++)
+        for(int colPos=0; colPos< field->cols ; colPos++)
         {
-            float x = colPos*gradFieldResolution + gradFieldResolution/2;
-            float y = rowPos*gradFieldResolution  + gradFieldResolution/2;
-            ofVec2f projectedPoint = kinectCoordToProjCoord(x, y);
-            int ind = colPos + rowPos * gradFieldcols;
-            ofVec2f v2 = gradField[ind];
+            kinectPoints[colPos + rowPos * field->cols] = ofVec2f(colPos*resolution + resolution/2, rowPos*resolution  + resolution/2);
+        }
+    }
+    vector<ofVec2f> projectedPoints(kinectPoints.size());
+    kinectCoordsToProjCoords(kinectPoints.data(), projectedPoints.data(), kinectPoints.size());
+    int highlighted = fishInd;
+    for(int rowPos=0; rowPos< field->rows ; rowPos++)
+    {
+        for(int colPos=0; colPos< field->cols ; colPos++)
+        {
+            int ind = colPos + rowPos * field->cols;
+            ofVec2f projectedPoint = projectedPoints[ind];
+            ofVec2f v2 = field->cells[ind];
             v2 *= arrowLength;
 
             ofSetColor(255,0,0,255);
-            if (ind == fishInd)
+            if (ind == highlighted)
                 ofSetColor(0,255,0,255);
             
             drawArrow(projectedPoint, v2);
@@ -792,9 +904,10 @@ void KinectProjector::updateNativeScale(float scaleMin, float scaleMax){
     FilteredDepthImage.setNativeScale(scaleMin, scaleMax);
 }
 
-ofVec2f KinectProjector::kinectCoordToProjCoord(float x, float y) // x, y in kinect pixel coord
+void KinectProjector::kinectCoordsToProjCoords(const ofVec2f* kinectCoords, ofVec2f* projCoords, size_t count)
 {
-    return worldCoordToProjCoord(kinectCoordToWorldCoord(x, y));
+    for (size_t i = 0; i < count; i++)
+        projCoords[i] = kinectCoordToProjCoord(kinectCoords[i].x, kinectCoords[i].y);
 }
 
 ofVec2f KinectProjector::worldCoordToProjCoord(ofVec3f vin)
@@ -823,11 +936,11 @@ ofVec3f KinectProjector::projCoordAndWorldZToWorldCoord(float projX, float projY
 	return ofVec3f(x, y, worldZ);
 }
 
-ofVec3f KinectProjector::kinectCoordToWorldCoord(float x, float y) // x, y in kinect pixel coord
+ofVec3f KinectProjector::computeKinectCoordToWorldCoord(float x, float y) // x, y in kinect pixel coord
 {
     ofVec4f kc = ofVec2f(x, y);
     int ind = static_cast<int>(y) * kinectRes.x + static_cast<int>(x);
-    kc.z = FilteredDepthImage.getFloatPixelsRef().getData()[ind];
+    kc.z = getDepthFrame()[ind];
     kc.w = 1;
     ofVec4f wc = kinectWorldMatrix*kc*kc.z;
     return ofVec3f(wc);
@@ -848,9 +961,9 @@ ofVec3f KinectProjector::RawKinectCoordToWorldCoord(float x, float y) // x, y in
     return ofVec3f(wc);
 }
 
-float KinectProjector::elevationAtKinectCoord(float x, float y) // x, y in kinect pixel coordinate
+float KinectProjector::computeElevationAtKinectCoord(float x, float y) // x, y in kinect pixel coordinate
 {
-    ofVec4f wc = kinectCoordToWorldCoord(x, y);
+    ofVec4f wc = computeKinectCoordToWorldCoord(x, y);
     wc.w = 1;
     float elevation = -basePlaneEq.dot(wc);
     return elevation;
@@ -866,9 +979,13 @@ float KinectProjector::elevationToKinectDepth(float elevation, float x, float y)
 }
 
 ofVec2f KinectProjector::gradientAtKinectCoord(float x, float y){
-    int ind = static_cast<int>(floor(x/gradFieldResolution)) + gradFieldcols*static_cast<int>(floor(y/gradFieldResolution));
-    fishInd = ind;
-    return gradField[ind];
+    std::shared_ptr<const GradientFieldSnapshot> field = gradientField.getSnapshot();
+    int col = static_cast<int>(floor(x/field->resolution));
+    int row = static_cast<int>(floor(y/field->resolution));
+    if (!field->isInside(col, row))
+        return ofVec2f(0);
+    fishInd = col + field->cols*row;
+    return field->cells[col + field->cols*row];
 }
 
 void KinectProjector::setupGui(){
@@ -876,18 +993,31 @@ void KinectProjector::setupGui(){
     gui = new ofxDatGui( ofxDatGuiAnchor::TOP_LEFT);
 	gui->setTheme(new ofxDatGuiThemeAqua());
     gui->addFRM();
+    auto profilerFolder = gui->addFolder("Pipeline latency p50|p95|p99", ofColor::orange);
+    profilerLabels.clear();
+    for (int stage = 0; stage < NUM_PIPELINE_STAGES; stage++)
+        profilerLabels.push_back(profilerFolder->addLabel(PipelineProfiler::getStageName(stage)));
+    profilerFolder->addButton("Export pipeline trace");
     gui->addBreak();
     gui->addSlider("Tilt X", -30, 30, 0);
     gui->addSlider("Tilt Y", -30, 30, 0);
     gui->addSlider("Vertical offset", -100, 100, 0);
     gui->addButton("Reset sea level");
     gui->addBreak();
+    vector<string> kernelNames;
+    for (int i = 0; i < SpatialFilter::NUM_KERNELS; i++)
+        kernelNames.push_back(SpatialFilter::getKernelName(static_cast<SpatialFilter::Kernel>(i)));
+    gui->addDropdown("Spatial filter kernel", kernelNames)->setName("Spatial filter kernel");
+    gui->getDropdown("Spatial filter kernel")->select(spatialFilterKernel);
     
     auto advancedFolder = gui->addFolder("Advanced", ofColor::purple);
     advancedFolder->addToggle("Display kinect depth view", drawKinectView)->setName("Draw kinect depth view");
     advancedFolder->addSlider("Ceiling", -300, 300, 0);
     advancedFolder->addToggle("Spatial filtering", spatialFiltering);
+    advancedFolder->addSlider("Spatial filter passes", 1, SpatialFilter::maxNumPasses, spatialFilterPasses)->setPrecision(0);
     advancedFolder->addToggle("Quick reaction", followBigChanges);
+    advancedFolder->addToggle("Track sea level drift", driftTracking);
+    advancedFolder->addToggle("Terrain curvature", terrainAnalysis.hasCurvature());
     advancedFolder->addSlider("Averaging", 1, 40, numAveragingSlots)->setPrecision(0);
     advancedFolder->addBreak();
     advancedFolder->addButton("Calibrate")->setName("Full Calibration");
@@ -904,11 +1034,19 @@ void KinectProjector::setupGui(){
     gui->onButtonEvent(this, &KinectProjector::onButtonEvent);
     gui->onToggleEvent(this, &KinectProjector::onToggleEvent);
     gui->onSliderEvent(this, &KinectProjector::onSliderEvent);
+    gui->onDropdownEvent(this, &KinectProjector::onDropdownEvent);
 
 	// disactivate autodraw
 	gui->setAutoDraw(false);
 }
 
+void KinectProjector::updateProfilerGui(){
+    for (int stage = 0; stage < static_cast<int>(profilerLabels.size()); stage++){
+        PipelineProfiler::Percentiles percentiles = PipelineProfiler::get().getPercentiles(stage);
+        profilerLabels[stage]->setLabel(string(PipelineProfiler::getStageName(stage)) + ": " + ofToString(percentiles.p50, 1) + "|" + ofToString(percentiles.p95, 1) + "|" + ofToString(percentiles.p99, 1) + " ms");
+    }
+}
+
 void KinectProjector::startFullCalibration(){
     calibrating = true;
     calibrationState = CALIBRATION_STATE_FULL_AUTO_CALIBRATION;
@@ -948,6 +1086,20 @@ void KinectProjector::setSpatialFiltering(bool sspatialFiltering){
     });
 }
 
+void KinectProjector::setSpatialFilterKernel(SpatialFilter::Kernel sspatialFilterKernel){
+    spatialFilterKernel = sspatialFilterKernel;
+    kinectgrabber.performInThread([sspatialFilterKernel](KinectGrabber & kg) {
+        kg.setSpatialFilterKernel(sspatialFilterKernel);
+    });
+}
+
+void KinectProjector::setSpatialFilterPasses(int sspatialFilterPasses){
+    spatialFilterPasses = sspatialFilterPasses;
+    kinectgrabber.performInThread([sspatialFilterPasses](KinectGrabber & kg) {
+        kg.setSpatialFilterPasses(sspatialFilterPasses);
+    });
+}
+
 void KinectProjector::setFollowBigChanges(bool sfollowBigChanges){
     followBigChanges = sfollowBigChanges;
     kinectgrabber.performInThread([sfollowBigChanges](KinectGrabber & kg) {
@@ -955,9 +1107,45 @@ void KinectProjector::setFollowBigChanges(bool sfollowBigChanges){
     });
 }
 
+/**
+ * @fn	void KinectProjector::setDriftTracking(bool sdriftTracking)
+ *
+ * @brief	Enables the tracking of the sea level drift, the tracking starts from
+ * 			the current base plane. Disabling it keeps the current correction.
+ *
+ * @param	sdriftTracking	True to track the drift.
+ */
+
+void KinectProjector::setDriftTracking(bool sdriftTracking){
+    if (sdriftTracking && !driftTracking)
+        driftTracker.reset(basePlaneEq);
+    driftTracking = sdriftTracking;
+}
+
+/**
+ * @fn	void KinectProjector::setTerrainCurvature(bool sterrainCurvature)
+ *
+ * @brief	Enables the curvature raster of the terrain analysis, from the next
+ * 			frame.
+ *
+ * @param	sterrainCurvature	True to compute the curvature.
+ */
+
+void KinectProjector::setTerrainCurvature(bool sterrainCurvature){
+    terrainAnalysis.setCurvature(sterrainCurvature);
+}
+
 void KinectProjector::onButtonEvent(ofxDatGuiButtonEvent e){
     if (e.target->is("Full Calibration")) {
         startFullCalibration();
+    } else if (e.target->is("Export pipeline trace")) {
+        string traceFile = ofToDataPath("traces/pipeline-"+ofGetTimestampString()+".json");
+        ofFilePath::createEnclosingDirectory(traceFile, false);
+        if (PipelineProfiler::get().exportChromeTrace(traceFile)){
+            ofLogNotice("KinectProjector") << "onButtonEvent(): Pipeline trace exported to " << traceFile;
+        } else {
+            ofLogError("KinectProjector") << "onButtonEvent(): Pipeline trace could not be exported to " << traceFile;
+        }
     } else if (e.target->is("Update ROI from calibration")) {
 		updateROIFromCalibration();
 	} else if (e.target->is("Automatically detect sand region")) {
@@ -984,6 +1172,10 @@ void KinectProjector::onToggleEvent(ofxDatGuiToggleEvent e){
 		setSpatialFiltering(e.checked);
     }else if (e.target->is("Quick reaction")) {
         setFollowBigChanges(e.checked);
+    } else if (e.target->is("Track sea level drift")) {
+        setDriftTracking(e.checked);
+    } else if (e.target->is("Terrain curvature")) {
+        setTerrainCurvature(e.checked);
     } else if (e.target->is("Draw kinect depth view")){
         drawKinectView = e.checked;
     }
@@ -1010,6 +1202,14 @@ void KinectProjector::onSliderEvent(ofxDatGuiSliderEvent e){
         kinectgrabber.performInThread([e](KinectGrabber & kg) {
             kg.setAveragingSlotsNumber(e.value);
         });
+    } else if(e.target->is("Spatial filter passes")){
+        setSpatialFilterPasses(e.value);
+    }
+}
+
+void KinectProjector::onDropdownEvent(ofxDatGuiDropdownEvent e){
+    if (e.target->is("Spatial filter kernel")){
+        setSpatialFilterKernel(static_cast<SpatialFilter::Kernel>(e.child));
     }
 }
 
@@ -1092,6 +1292,18 @@ bool KinectProjector::loadSettings(){
     spatialFiltering = xml.getValue<bool>("spatialFiltering");
     followBigChanges = xml.getValue<bool>("followBigChanges");
     numAveragingSlots = xml.getValue<int>("numAveragingSlots");
+    if (xml.exists("numFilterBands"))
+        numFilterBands = xml.getValue<int>("numFilterBands");
+    if (xml.exists("projectorMapStep"))
+        projectorMapStep = xml.getValue<int>("projectorMapStep");
+    if (xml.exists("spatialFilterKernel"))
+        spatialFilterKernel = SpatialFilter::getKernelFromName(xml.getValue<string>("spatialFilterKernel"));
+    if (xml.exists("spatialFilterPasses"))
+        spatialFilterPasses = xml.getValue<int>("spatialFilterPasses");
+    if (xml.exists("driftTracking"))
+        driftTracking = xml.getValue<bool>("driftTracking");
+    if (xml.exists("terrainCurvature"))
+        terrainAnalysis.setCurvature(xml.getValue<bool>("terrainCurvature"));
     return true;
 }
 
@@ -1104,11 +1316,18 @@ bool KinectProjector::saveSettings(){
     xml.addValue("kinectROI", kinectROI);
     xml.addValue("basePlaneNormalBack", basePlaneNormalBack);
     xml.addValue("basePlaneOffsetBack", basePlaneOffsetBack);
-    xml.addValue("basePlaneEq", basePlaneEq);
+    bool driftCorrected = driftTracking && basePlaneEq == driftTracker.getCorrectedPlaneEq();
+    xml.addValue("basePlaneEq", driftCorrected ? driftTracker.getReferencePlaneEq() : basePlaneEq); // The drift is measured again at the next start
     xml.addValue("maxOffsetBack", maxOffsetBack);
     xml.addValue("spatialFiltering", spatialFiltering);
     xml.addValue("followBigChanges", followBigChanges);
     xml.addValue("numAveragingSlots", numAveragingSlots);
+    xml.addValue("numFilterBands", numFilterBands);
+    xml.addValue("projectorMapStep", projectorMapStep);
+    xml.addValue("spatialFilterKernel", string(SpatialFilter::getKernelName(spatialFilterKernel)));
+    xml.addValue("spatialFilterPasses", spatialFilterPasses);
+    xml.addValue("driftTracking", driftTracking);
+    xml.addValue("terrainCurvature", terrainAnalysis.hasCurvature());
     xml.setToParent();
     return xml.save(settingsFile);
 }
\ No newline at end of file
@@ -29,6 +29,14 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include "ofxOpenCv.h"
 #include "ofxCv.h"
 #include "KinectGrabber.h"
+#include "ElevationMap.h"
+#include "TerrainAnalysis.h"
+#include "GradientField.h"
+#include "ProjectorMap.h"
+#include "ROIDetector.h"
+#include "ChessboardDetector.h"
+#include "PlaneFitter.h"
+#include "DriftTracker.h"
 #include "ofxModal.h"
 
 #include "KinectProjectorCalibration.h"
@@ -59,13 +67,42 @@ public:
     // Coordinate conversion functions
     ofVec2f worldCoordToProjCoord(ofVec3f vin);
 	ofVec3f projCoordAndWorldZToWorldCoord(float projX, float projY, float worldZ);
-	ofVec2f kinectCoordToProjCoord(float x, float y);
-    ofVec3f kinectCoordToWorldCoord(float x, float y);
+	ofVec2f kinectCoordToProjCoord(float x, float y){ // x, y in kinect pixel coord
+        if (projectorMap.isInside(x, y))
+            return projectorMap.getProjCoord(x, y);
+        return worldCoordToProjCoord(computeKinectCoordToWorldCoord(x, y)); // Outside the ROI
+    }
+    void kinectCoordsToProjCoords(const ofVec2f* kinectCoords, ofVec2f* projCoords, size_t count);
+    ofVec3f kinectCoordToWorldCoord(float x, float y){ // x, y in kinect pixel coord
+        int ix = static_cast<int>(x);
+        int iy = static_cast<int>(y);
+        if (ix == x && iy == y && elevationMap.isInside(ix, iy))
+            return elevationMap.getWorldCoord(ix, iy);
+        return computeKinectCoordToWorldCoord(x, y); // Subpixel or outside the ROI
+    }
 	ofVec2f worldCoordTokinectCoord(ofVec3f wc);
 	ofVec3f RawKinectCoordToWorldCoord(float x, float y);
-    float elevationAtKinectCoord(float x, float y);
+    float elevationAtKinectCoord(float x, float y){ // x, y in kinect pixel coordinate
+        int ix = static_cast<int>(x);
+        int iy = static_cast<int>(y);
+        if (elevationMap.isInside(ix, iy))
+            return elevationMap.getElevation(ix, iy);
+        return computeElevationAtKinectCoord(x, y);
+    }
     float elevationToKinectDepth(float elevation, float x, float y);
-    ofVec2f gradientAtKinectCoord(float x, float y);
+    const ElevationMap& getElevationMap() const { // Elevations of the ROI of the last filtered frame
+        return elevationMap;
+    }
+    const TerrainAnalysis& getTerrainAnalysis() const { // Gradients, slopes, aspects and optional curvatures of the ROI of the last filtered frame
+        return terrainAnalysis;
+    }
+    ofVec2f gradientAtKinectCoord(float x, float y); // Can be called from any thread
+    std::shared_ptr<const GradientFieldSnapshot> getGradientField() const { // Keeps the field of the call alive, for many lookups
+        return gradientField.getSnapshot();
+    }
+    WorkerPool& getWorkerPool() { // Parallel loops of the main thread, sized like the grabber filter
+        return workerPool;
+    }
     
     // Setup & calibration functions
     void startFullCalibration();
@@ -73,22 +110,28 @@ public:
     void startAutomaticKinectProjectorCalibration();
     void setGradFieldResolution(int gradFieldResolution);
     void setSpatialFiltering(bool sspatialFiltering);
+    void setSpatialFilterKernel(SpatialFilter::Kernel sspatialFilterKernel);
+    void setSpatialFilterPasses(int sspatialFilterPasses);
     void setFollowBigChanges(bool sfollowBigChanges);
+    void setDriftTracking(bool sdriftTracking); // Follow the slow drift of the sea level between calibrations
+    void setTerrainCurvature(bool sterrainCurvature); // Curvature raster of getTerrainAnalysis()
     
     // Gui and event functions
     void setupGui();
+    void updateProfilerGui();
     void onButtonEvent(ofxDatGuiButtonEvent e);
     void onToggleEvent(ofxDatGuiToggleEvent e);
     void onSliderEvent(ofxDatGuiSliderEvent e);
+    void onDropdownEvent(ofxDatGuiDropdownEvent e);
     void onConfirmModalEvent(ofxModalEvent e);
     void onCalibModalEvent(ofxModalEvent e);
     
     // Functions for shaders
     void bind(){
-        FilteredDepthImage.getTexture().bind();
+        depthTexture.bind();
     }
     void unbind(){
-        FilteredDepthImage.getTexture().unbind();
+        depthTexture.unbind();
     }
     ofMatrix4x4 getTransposedKinectWorldMatrix(){
         return kinectWorldMatrix.getTransposedOf(kinectWorldMatrix);
@@ -98,8 +141,8 @@ public:
     }
     
     // Getter and setter
-    ofTexture & getTexture(){
-        return FilteredDepthImage.getTexture();
+    ofTexture & getTexture(){ // Filtered depth in mm
+        return depthTexture;
     }
     ofRectangle getKinectROI(){
         return kinectROI;
@@ -125,6 +168,18 @@ public:
     bool isImageStabilized(){
         return imageStabilized;
     }
+    bool isFrameNew(){ // A new filtered frame was received by the last update()
+        return frameNew;
+    }
+    unsigned long long getFrameSequence(){ // Number of the current filtered frame since the grabber started
+        return frameSequence;
+    }
+    // Whether a stable depth of the kinect area [x0, x1[ x [y0, y1[ changed in a frame received
+    // after the frame sequence, at the resolution of the change tiles of the grabber
+    bool hasAreaChanged(int x0, int y0, int x1, int y1, unsigned long long sinceSequence) const;
+    const CaptureSettings& getCaptureSettings(){
+        return captureSettings;
+    }
     bool isBasePlaneUpdated(){ // To be called after update()
         return basePlaneUpdated;
     }
@@ -169,6 +224,12 @@ private:
     // Private methods
     void exit(ofEventArgs& e);
     void setupGradientField();
+    void updateCoordinateMaps(); // Rebuild the elevation and projector maps from the current filtered frame
+    const float* getDepthFrame() const { // Filtered depth of the front frame, valid until the next receive()
+        return kinectgrabber.frameExchange.getFrontFrame().depth.getData();
+    }
+    ofVec3f computeKinectCoordToWorldCoord(float x, float y);
+    float computeElevationAtKinectCoord(float x, float y);
     
     void updateCalibration();
     void updateFullAutoCalibration();
@@ -189,6 +250,7 @@ private:
     void askToFlattenSand();
 
     void drawChessboard(int x, int y, int chessboardSize);
+    void startChessboardSearch();
     void drawArrow(ofVec2f projectedPoint, ofVec2f v1);
 
     void saveCalibrationAndSettings();
@@ -198,6 +260,7 @@ private:
     // States variables
     bool secondScreenFound;
 	bool kinectOpened;
+    CaptureSettings captureSettings;
     bool ROIcalibrated;
     bool projKinectCalibrated;
     bool calibrating;
@@ -205,12 +268,17 @@ private:
     bool projKinectCalibrationUpdated;
     bool basePlaneUpdated;
     bool imageStabilized;
+    bool frameNew;
+    unsigned long long frameSequence;
+    vector<unsigned long long> tileChangeSequences; // Sequence of the last frame which changed each change tile
+    int tileCols, tileRows;
     bool waitingForFlattenSand;
     bool drawKinectView;
     Calibration_state calibrationState;
     ROI_calibration_state ROICalibState;
     Auto_calibration_state autoCalibState;
     Full_Calibration_state fullCalibState;
+    WorkerPool workerPool; // Shared by the parallel loops of the main thread
 
     // Projector window
     std::shared_ptr<ofAppBaseWindow> projWindow;
@@ -220,11 +288,15 @@ private:
     bool                        spatialFiltering;
     bool                        followBigChanges;
     int                         numAveragingSlots;
+    int                         numFilterBands; // Row bands filtered in parallel and threads of the main thread pool, < 1 for one per core
+    SpatialFilter::Kernel       spatialFilterKernel;
+    int                         spatialFilterPasses;
 
     //kinect buffer
-    ofxCvFloatImage             FilteredDepthImage;
+    ofxCvFloatImage             FilteredDepthImage; // Kinect view only, scaled to the native scale
+    ofTexture                   depthTexture; // Filtered depth of the front frame in mm, for the shaders
     ofxCvColorImage             kinectColorImage;
-    ofVec2f*                    gradField;
+    GradientField               gradientField; // Gradient field of the last frame, readable from any thread
     
     // Projector and kinect variables
     ofVec2f projRes;
@@ -242,7 +314,7 @@ private:
     int gradFieldcols, gradFieldrows;
     int gradFieldResolution;
     float arrowLength;
-    int fishInd;
+    std::atomic<int> fishInd; // Cell of the last gradient lookup, highlighted by drawGradField()
     
     // Calibration variables
     ofxKinectProjectorToolkit*  kpt;
@@ -255,17 +327,25 @@ private:
     ofxCvGrayscaleImage         thresholdedImage;
     ofxCvContourFinder          contourFinder;
     float                       threshold;
-    ofPolyline                  large;
+    ofPolyline                  large; // Walls around the sand area
+    ROIDetector                 roiDetector;
     ofRectangle                 kinectROI, kinectROIManualCalib;
     
     // Base plane
     ofVec3f basePlaneNormal, basePlaneNormalBack;
     ofVec3f basePlaneOffset, basePlaneOffsetBack;
     ofVec4f basePlaneEq; // Base plane equation in GLSL-compatible format
+    PlaneFitter planeFitter; // Robust fit of the base plane and of the ceiling
+    DriftTracker driftTracker; // Corrections of the base plane between calibrations
+    bool driftTracking;
     
     // Conversion matrices
     ofMatrix4x4                 kinectProjMatrix;
     ofMatrix4x4                 kinectWorldMatrix;
+    ElevationMap                elevationMap; // World coordinates and elevations of the ROI, updated with each frame
+    TerrainAnalysis             terrainAnalysis; // Derivatives of the elevation map, updated with it
+    ProjectorMap                projectorMap; // Projector coordinates of the ROI, updated with each frame and calibration
+    int                         projectorMapStep; // Kinect pixels between the projector map nodes
     
     // Max offset for keeping kinect points
     float maxOffset;
@@ -278,6 +358,8 @@ private:
     bool cleared;
     int trials;
     bool upframe;
+    ChessboardDetector chessboardDetector; // Background chessboard search
+    bool lastSearchWindowed; // The last search was restricted to a predicted window
     
     // Chessboard variables
     int   chessboardSize;
@@ -290,6 +372,7 @@ private:
     shared_ptr<ofxModalAlert>   calibModal;
     shared_ptr<ofxModalThemeProjKinect>   modalTheme;
     ofxDatGui* gui;
+    vector<ofxDatGuiLabel*> profilerLabels; // p50/p95/p99 latency of each pipeline stage
 };
 
 
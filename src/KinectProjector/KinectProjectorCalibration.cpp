@@ -30,46 +30,284 @@ ofxKinectProjectorToolkit::ofxKinectProjectorToolkit(ofVec2f sprojRes, ofVec2f s
 	projRes = sprojRes;
 	kinectRes = skinectRes;
     calibrated = false;
+    worldScale = 1000; // mm
+    projectorScale = std::max(std::max(projRes.x, projRes.y), 1.0f);
+    inlierThreshold = 3;
+    rmsError = 0;
+    x = 0;
+    xn = 0;
+    clear();
+}
+
+void ofxKinectProjectorToolkit::clear(){
+    normalMatrix = 0;
+    normalVector = 0;
+    worldPoints.clear();
+    projectorPoints.clear();
+    residuals.clear();
+    inliers.clear();
+}
+
+/**
+ * @fn	void ofxKinectProjectorToolkit::addPointPair(const ofVec3f& pairKinect, const ofVec2f& pairProjector)
+ *
+ * @brief	Adds a point pair to the normal equations.
+ *
+ * @param	pairKinect   	The point in kinect world coordinates.
+ * @param	pairProjector	The point in projector coordinates.
+ */
+
+void ofxKinectProjectorToolkit::addPointPair(const ofVec3f& pairKinect, const ofVec2f& pairProjector){
+    ofVec3f world = pairKinect/worldScale;
+    ofVec2f projector = pairProjector/projectorScale;
+    worldPoints.push_back(world);
+    projectorPoints.push_back(projector);
+    accumulate(normalMatrix, normalVector, world, projector);
+}
+
+void ofxKinectProjectorToolkit::accumulate(NormalMatrix& normalMatrix, Parameters& normalVector, const ofVec3f& world, const ofVec2f& projector){
+    // The two rows of the pair: (X Y Z 1 0 0 0 0 -Xu -Yu -Zu) = u and (0 0 0 0 X Y Z 1 -Xv -Yv -Zv) = v
+    double rows[2][11] = {
+        {world.x, world.y, world.z, 1, 0, 0, 0, 0, -world.x*projector.x, -world.y*projector.x, -world.z*projector.x},
+        {0, 0, 0, 0, world.x, world.y, world.z, 1, -world.x*projector.y, -world.y*projector.y, -world.z*projector.y}
+    };
+    double values[2] = {projector.x, projector.y};
+    for (int k = 0; k < 2; k++){
+        for (int i = 0; i < 11; i++){
+            if (rows[k][i] == 0)
+                continue;
+            for (int j = 0; j < 11; j++)
+                normalMatrix(i, j) += rows[k][i]*rows[k][j];
+            normalVector(i) += rows[k][i]*values[k];
+        }
+    }
+}
+
+bool ofxKinectProjectorToolkit::solveNormalEquations(const NormalMatrix& normalMatrix, const Parameters& normalVector, Parameters& solution){
+    dlib::lu_decomposition<NormalMatrix> lu(normalMatrix);
+    if (lu.is_singular())
+        return false;
+    solution = lu.solve(normalVector);
+    return true;
+}
+
+/**
+ * @fn	bool ofxKinectProjectorToolkit::solve()
+ *
+ * @brief	Solves the accumulated normal equations, all pairs are inliers.
+ *
+ * @return	False if the pairs do not determine the projection.
+ */
+
+bool ofxKinectProjectorToolkit::solve(){
+    Parameters solution;
+    if (!solveNormalEquations(normalMatrix, normalVector, solution))
+        return false;
+    inliers.assign(worldPoints.size(), true);
+    setParameters(solution);
+    updateResiduals();
+    return true;
+}
+
+/**
+ * @fn	bool ofxKinectProjectorToolkit::calibrate()
+ *
+ * @brief	Computes the projection from the pairs added since the last clear():
+ * 			RANSAC selection of the inliers, linear solve on the inliers and
+ * 			Levenberg-Marquardt refinement of their reprojection error.
+ *
+ * @return	False if the pairs do not determine the projection.
+ */
+
+bool ofxKinectProjectorToolkit::calibrate(){
+    vector<bool> bestInliers;
+    if (!ransac(bestInliers))
+        return solve(); // Too few pairs for RANSAC
+    NormalMatrix inlierMatrix;
+    Parameters inlierVector;
+    inlierMatrix = 0;
+    inlierVector = 0;
+    for (size_t i = 0; i < worldPoints.size(); i++){
+        if (bestInliers[i])
+            accumulate(inlierMatrix, inlierVector, worldPoints[i], projectorPoints[i]);
+    }
+    Parameters solution;
+    if (!solveNormalEquations(inlierMatrix, inlierVector, solution))
+        return solve();
+    inliers = bestInliers;
+    setParameters(solution);
+    refine();
+    updateResiduals();
+    int numInliers = static_cast<int>(std::count(inliers.begin(), inliers.end(), true));
+    ofLogVerbose("KinectProjector") << "calibrate(): " << numInliers << "/" << inliers.size() << " inliers, reprojection RMS error: " << rmsError << " pixels";
+    return true;
 }
 
 void ofxKinectProjectorToolkit::calibrate(vector<ofVec3f> pairsKinect,
                                           vector<ofVec2f> pairsProjector) {
-    int nPairs = pairsKinect.size();
-    A.set_size(nPairs*2, 11);
-    y.set_size(nPairs*2, 1);
-    
-    for (int i=0; i<nPairs; i++) {
-        A(2*i, 0) = pairsKinect[i].x;
-        A(2*i, 1) = pairsKinect[i].y;
-        A(2*i, 2) = pairsKinect[i].z;
-        A(2*i, 3) = 1;
-        A(2*i, 4) = 0;
-        A(2*i, 5) = 0;
-        A(2*i, 6) = 0;
-        A(2*i, 7) = 0;
-        A(2*i, 8) = -pairsKinect[i].x * pairsProjector[i].x;
-        A(2*i, 9) = -pairsKinect[i].y * pairsProjector[i].x;
-        A(2*i, 10) = -pairsKinect[i].z * pairsProjector[i].x;
-        
-        A(2*i+1, 0) = 0;
-        A(2*i+1, 1) = 0;
-        A(2*i+1, 2) = 0;
-        A(2*i+1, 3) = 0;
-        A(2*i+1, 4) = pairsKinect[i].x;
-        A(2*i+1, 5) = pairsKinect[i].y;
-        A(2*i+1, 6) = pairsKinect[i].z;
-        A(2*i+1, 7) = 1;
-        A(2*i+1, 8) = -pairsKinect[i].x * pairsProjector[i].y;
-        A(2*i+1, 9) = -pairsKinect[i].y * pairsProjector[i].y;
-        A(2*i+1, 10) = -pairsKinect[i].z * pairsProjector[i].y;
-        
-        y(2*i, 0) = pairsProjector[i].x;
-        y(2*i+1, 0) = pairsProjector[i].y;
+    clear();
+    for (size_t i = 0; i < pairsKinect.size() && i < pairsProjector.size(); i++)
+        addPointPair(pairsKinect[i], pairsProjector[i]);
+    calibrate();
+}
+
+ofVec2f ofxKinectProjectorToolkit::project(const Parameters& p, const ofVec3f& world){
+    double w = p(8)*world.x+p(9)*world.y+p(10)*world.z+1;
+    return ofVec2f((p(0)*world.x+p(1)*world.y+p(2)*world.z+p(3))/w, (p(4)*world.x+p(5)*world.y+p(6)*world.z+p(7))/w);
+}
+
+/**
+ * @fn	bool ofxKinectProjectorToolkit::ransac(vector<bool>& bestInliers)
+ *
+ * @brief	Finds the largest set of pairs agreeing with a projection solved on
+ * 			6 random pairs, the minimal number of pairs for 11 parameters.
+ *
+ * @param [out]	bestInliers	The inliers of the best projection.
+ *
+ * @return	False if there are too few pairs.
+ */
+
+bool ofxKinectProjectorToolkit::ransac(vector<bool>& bestInliers){
+    const int sampleSize = 6;
+    const int iterations = 200;
+    size_t numPairs = worldPoints.size();
+    if (numPairs < 2*sampleSize)
+        return false;
+    double threshold = inlierThreshold/projectorScale;
+    double threshold2 = threshold*threshold;
+    std::mt19937 generator(1); // Same pairs, same calibration
+    std::uniform_int_distribution<size_t> distribution(0, numPairs-1);
+    size_t bestCount = 0;
+    double bestError = 0;
+    vector<bool> current(numPairs);
+    for (int iteration = 0; iteration < iterations; iteration++){
+        NormalMatrix sampleMatrix;
+        Parameters sampleVector;
+        sampleMatrix = 0;
+        sampleVector = 0;
+        for (int k = 0; k < sampleSize; k++){
+            size_t i = distribution(generator);
+            accumulate(sampleMatrix, sampleVector, worldPoints[i], projectorPoints[i]);
+        }
+        Parameters sample;
+        if (!solveNormalEquations(sampleMatrix, sampleVector, sample))
+            continue;
+        size_t count = 0;
+        double error = 0;
+        for (size_t i = 0; i < numPairs; i++){
+            double e2 = (project(sample, worldPoints[i])-projectorPoints[i]).lengthSquared();
+            current[i] = e2 < threshold2; // NaN is an outlier
+            if (current[i]){
+                count++;
+                error += e2;
+            }
+        }
+        if (count > bestCount || (count == bestCount && error < bestError)){
+            bestCount = count;
+            bestError = error;
+            bestInliers = current;
+        }
+    }
+    return bestCount >= static_cast<size_t>(sampleSize);
+}
+
+/**
+ * @fn	void ofxKinectProjectorToolkit::refine()
+ *
+ * @brief	Minimizes the reprojection error of the inliers with Levenberg-Marquardt,
+ * 			starting from the linear solution.
+ *
+ */
+
+void ofxKinectProjectorToolkit::refine(){
+    const int maxIterations = 20;
+    double lambda = 1e-3;
+    Parameters p = xn;
+    auto cost = [this](const Parameters& q) {
+        double c = 0;
+        for (size_t i = 0; i < worldPoints.size(); i++){
+            if (inliers[i])
+                c += (project(q, worldPoints[i])-projectorPoints[i]).lengthSquared();
+        }
+        return c;
+    };
+    double currentCost = cost(p);
+    for (int iteration = 0; iteration < maxIterations; iteration++){
+        NormalMatrix jtj;
+        Parameters jtr;
+        jtj = 0;
+        jtr = 0;
+        for (size_t i = 0; i < worldPoints.size(); i++){
+            if (!inliers[i])
+                continue;
+            const ofVec3f& X = worldPoints[i];
+            double w = p(8)*X.x+p(9)*X.y+p(10)*X.z+1;
+            double u = (p(0)*X.x+p(1)*X.y+p(2)*X.z+p(3))/w;
+            double v = (p(4)*X.x+p(5)*X.y+p(6)*X.z+p(7))/w;
+            double ju[11] = {X.x/w, X.y/w, X.z/w, 1/w, 0, 0, 0, 0, -u*X.x/w, -u*X.y/w, -u*X.z/w};
+            double jv[11] = {0, 0, 0, 0, X.x/w, X.y/w, X.z/w, 1/w, -v*X.x/w, -v*X.y/w, -v*X.z/w};
+            double ru = u-projectorPoints[i].x;
+            double rv = v-projectorPoints[i].y;
+            for (int a = 0; a < 11; a++){
+                for (int b = 0; b < 11; b++)
+                    jtj(a, b) += ju[a]*ju[b]+jv[a]*jv[b];
+                jtr(a) += ju[a]*ru+jv[a]*rv;
+            }
+        }
+        bool improved = false;
+        while (!improved && lambda < 1e10){
+            NormalMatrix damped = jtj;
+            for (int a = 0; a < 11; a++)
+                damped(a, a) += lambda*jtj(a, a);
+            Parameters step;
+            if (solveNormalEquations(damped, -jtr, step)){
+                Parameters candidate = p+step;
+                double candidateCost = cost(candidate);
+                if (candidateCost < currentCost){
+                    improved = true;
+                    double decrease = currentCost-candidateCost;
+                    p = candidate;
+                    currentCost = candidateCost;
+                    lambda = std::max(lambda/10, 1e-12);
+                    if (decrease < 1e-12*currentCost)
+                        iteration = maxIterations; // Converged
+                }
+            }
+            if (!improved)
+                lambda *= 10;
+        }
+        if (!improved)
+            break;
+    }
+    setParameters(p);
+}
+
+void ofxKinectProjectorToolkit::updateResiduals(){
+    residuals.resize(worldPoints.size());
+    double sum = 0;
+    int count = 0;
+    for (size_t i = 0; i < worldPoints.size(); i++){
+        residuals[i] = static_cast<float>((project(xn, worldPoints[i])-projectorPoints[i]).length()*projectorScale);
+        if (inliers[i]){
+            sum += residuals[i]*residuals[i];
+            count++;
+        }
+    }
+    rmsError = count > 0 ? static_cast<float>(sqrt(sum/count)) : 0;
+}
+
+void ofxKinectProjectorToolkit::setParameters(const Parameters& normalizedParameters){
+    // Undo the scaling: u*s = (P'(X/w)*s, 1)/(Q'(X/w)+1)
+    xn = normalizedParameters;
+    double ratio = projectorScale/worldScale;
+    for (int i = 0; i < 3; i++){
+        x(i) = xn(i)*ratio;
+        x(4+i) = xn(4+i)*ratio;
+        x(8+i) = xn(8+i)/worldScale;
     }
-    
-    dlib::qr_decomposition<dlib::matrix<double, 0, 11> > qrd(A);
-    x = qrd.solve(y);
-    cout << "x: "<< x << endl;
+    x(3) = xn(3)*projectorScale;
+    x(7) = xn(7)*projectorScale;
+    ofLogVerbose("KinectProjector") << "setParameters(): x: " << x;
     projMatrice = ofMatrix4x4(x(0,0), x(1,0), x(2,0), x(3,0),
                               x(4,0), x(5,0), x(6,0), x(7,0),
                               x(8,0), x(9,0), x(10,0), 1,
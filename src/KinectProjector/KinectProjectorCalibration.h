@@ -28,19 +28,52 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #define __Magic_Sand__Calibration__
 
 #include <iostream>
+#include <algorithm>
+#include <random>
 #include "ofMain.h"
 #include "libs/dlib/matrix.h"
-#include "libs/dlib/matrix/matrix_qr.h"
+#include "libs/dlib/matrix/matrix_lu.h"
 
 
+// The projection is the 11 parameter DLT: projector = (P*(world, 1))/(Q*world+1).
+// Every point pair adds its two linear equations to the 11x11 normal
+// equations, so solving costs the same whatever the number of pairs. The
+// world coordinates (mm) and the projector coordinates (pixels) are
+// scaled to the same order of magnitude before they are accumulated.
+// calibrate() runs RANSAC on the pairs to reject the outliers, solves the
+// normal equations of the inliers and refines the reprojection error of
+// the inliers with Levenberg-Marquardt.
 class ofxKinectProjectorToolkit
 {
 public:
     ofxKinectProjectorToolkit(ofVec2f projRes, ofVec2f kinectRes);
     
+    // Streaming linear solver
+    void clear();
+    void addPointPair(const ofVec3f& pairKinect, const ofVec2f& pairProjector);
+    bool solve(); // Linear least squares on all the pairs added since the last clear()
+    
+    // Robust calibration on all the pairs added since the last clear()
+    bool calibrate();
     void calibrate(vector<ofVec3f> pairsKinect,
                    vector<ofVec2f> pairsProjector);
     
+    void setInlierThreshold(float sinlierThreshold){ // Reprojection error of the RANSAC inliers, projector pixels
+        inlierThreshold = sinlierThreshold;
+    }
+    size_t getNumPairs() const {
+        return worldPoints.size();
+    }
+    const vector<float>& getResiduals() const { // Reprojection error of each pair, projector pixels
+        return residuals;
+    }
+    const vector<bool>& getInliers() const {
+        return inliers;
+    }
+    float getRMSError() const { // Over the inliers, projector pixels
+        return rmsError;
+    }
+    
     ofVec2f getProjectedPoint(ofVec3f worldPoint);
     ofMatrix4x4 getProjectionMatrix();
     vector<ofVec2f> getProjectedContour(vector<ofVec3f> *worldPoints);
@@ -53,10 +86,29 @@ public:
     bool isCalibrated() {return calibrated;}
     
 private:
+    typedef dlib::matrix<double, 11, 11> NormalMatrix;
+    typedef dlib::matrix<double, 11, 1> Parameters;
+    
+    static void accumulate(NormalMatrix& normalMatrix, Parameters& normalVector, const ofVec3f& world, const ofVec2f& projector);
+    static bool solveNormalEquations(const NormalMatrix& normalMatrix, const Parameters& normalVector, Parameters& solution);
+    static ofVec2f project(const Parameters& parameters, const ofVec3f& world);
+    bool ransac(vector<bool>& bestInliers);
+    void refine(); // Levenberg-Marquardt on the inliers
+    void updateResiduals();
+    void setParameters(const Parameters& normalizedParameters);
+    
+    NormalMatrix normalMatrix;
+    Parameters normalVector;
+    vector<ofVec3f> worldPoints; // Scaled pairs
+    vector<ofVec2f> projectorPoints;
+    double worldScale, projectorScale;
     
-    dlib::matrix<double, 0, 11> A;
-    dlib::matrix<double, 0, 1> y;
+    Parameters xn; // Parameters of the scaled pairs
     dlib::matrix<double, 11, 1> x;
+    vector<float> residuals;
+    vector<bool> inliers;
+    float rmsError;
+    float inlierThreshold;
     
     ofMatrix4x4 projMatrice;
     
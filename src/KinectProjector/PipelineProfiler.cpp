@@ -0,0 +1,180 @@
+/***********************************************************************
+PipelineProfiler - PipelineProfiler measures the duration of the stages
+of the depth processing and rendering pipeline.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#include "PipelineProfiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+
+PipelineProfiler& PipelineProfiler::get(){
+    static PipelineProfiler profiler;
+    return profiler;
+}
+
+PipelineProfiler::PipelineProfiler()
+:traceIndex(0),
+numDropped(0)
+{
+    for (int i = 0; i < NUM_PIPELINE_STAGES; i++){
+        history[i].reserve(historySize);
+        historyIndex[i] = 0;
+    }
+    trace.reserve(traceSize);
+}
+
+uint64_t PipelineProfiler::now(){
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const char* PipelineProfiler::getStageName(int stage){
+    static const char* names[NUM_PIPELINE_STAGES] = {
+        "Kinect update",
+        "Filter",
+        "Spatial filter",
+        "Gradient field",
+        "Frame handoff",
+        "Projector update",
+        "Terrain analysis",
+        "Drift tracking",
+        "Contour lines",
+        "Draw sandbox",
+        "Model update",
+        "Model draw"
+    };
+    return stage >= 0 && stage < NUM_PIPELINE_STAGES ? names[stage] : "Unknown";
+}
+
+PipelineProfiler::ThreadRingHandle::~ThreadRingHandle(){
+    if (ring != 0)
+        PipelineProfiler::get().releaseThreadRing(ring);
+}
+
+PipelineProfiler::ThreadRing* PipelineProfiler::getThreadRing(){
+    static thread_local ThreadRingHandle threadRing;
+    if (threadRing.ring == 0){
+        std::lock_guard<std::mutex> guard(ringsMutex);
+        if (!freeRings.empty()){
+            // The pending events of the previous thread stay in front of the new ones
+            threadRing.ring = freeRings.back();
+            freeRings.pop_back();
+        } else {
+            rings.push_back(std::unique_ptr<ThreadRing>(new ThreadRing()));
+            threadRing.ring = rings.back().get();
+            threadRing.ring->id = static_cast<int>(rings.size());
+            threadRing.ring->head = 0;
+            threadRing.ring->tail = 0;
+            threadRing.ring->dropped = 0;
+        }
+        threadRing.ring->name = "Thread " + std::to_string(threadRing.ring->id);
+    }
+    return threadRing.ring;
+}
+
+void PipelineProfiler::releaseThreadRing(ThreadRing* ring){
+    std::lock_guard<std::mutex> guard(ringsMutex);
+    freeRings.push_back(ring);
+}
+
+void PipelineProfiler::setThreadName(const std::string& name){
+    ThreadRing* ring = getThreadRing();
+    std::lock_guard<std::mutex> guard(ringsMutex);
+    ring->name = name;
+}
+
+void PipelineProfiler::record(int stage, uint64_t start, uint64_t end){
+    ThreadRing* ring = getThreadRing();
+    unsigned int head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) >= static_cast<unsigned int>(ringSize)){
+        ring->dropped.fetch_add(1, std::memory_order_relaxed); // Not collected fast enough
+        return;
+    }
+    Event& event = ring->events[head % ringSize];
+    event.stage = stage;
+    event.thread = ring->id;
+    event.start = start;
+    event.duration = end > start ? end - start : 0;
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+void PipelineProfiler::collect(){
+    std::lock_guard<std::mutex> guard(ringsMutex);
+    for (auto & ring : rings){
+        unsigned int tail = ring->tail.load(std::memory_order_relaxed);
+        unsigned int head = ring->head.load(std::memory_order_acquire);
+        for (; tail != head; ++tail){
+            const Event& event = ring->events[tail % ringSize];
+            std::vector<float>& stageHistory = history[event.stage];
+            float ms = event.duration/1000.0f;
+            if (static_cast<int>(stageHistory.size()) < historySize){
+                stageHistory.push_back(ms);
+            } else {
+                stageHistory[historyIndex[event.stage]] = ms;
+            }
+            historyIndex[event.stage] = (historyIndex[event.stage]+1) % historySize;
+            if (static_cast<int>(trace.size()) < traceSize){
+                trace.push_back(event);
+            } else {
+                trace[traceIndex] = event;
+            }
+            traceIndex = (traceIndex+1) % traceSize;
+        }
+        ring->tail.store(tail, std::memory_order_release);
+        numDropped += ring->dropped.exchange(0, std::memory_order_relaxed);
+    }
+}
+
+PipelineProfiler::Percentiles PipelineProfiler::getPercentiles(int stage) const{
+    Percentiles percentiles = {0, 0, 0, 0};
+    if (stage < 0 || stage >= NUM_PIPELINE_STAGES || history[stage].empty())
+        return percentiles;
+    std::vector<float> sorted(history[stage]);
+    std::sort(sorted.begin(), sorted.end());
+    int n = static_cast<int>(sorted.size());
+    percentiles.p50 = sorted[(n-1)*50/100];
+    percentiles.p95 = sorted[(n-1)*95/100];
+    percentiles.p99 = sorted[(n-1)*99/100];
+    percentiles.numSamples = n;
+    return percentiles;
+}
+
+bool PipelineProfiler::exportChromeTrace(const std::string& path) const{
+    std::ofstream file(path.c_str());
+    if (!file)
+        return false;
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    {
+        std::lock_guard<std::mutex> guard(ringsMutex);
+        for (auto & ring : rings){
+            file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << ring->id << ",\"args\":{\"name\":\"" << ring->name << "\"}}";
+            first = false;
+        }
+    }
+    // Oldest events first
+    int n = static_cast<int>(trace.size());
+    int begin = n < traceSize ? 0 : traceIndex;
+    for (int i = 0; i < n; i++){
+        const Event& event = trace[(begin+i) % n];
+        file << (first ? "" : ",\n") << "{\"name\":\"" << getStageName(event.stage) << "\",\"cat\":\"pipeline\",\"ph\":\"X\",\"pid\":0,\"tid\":" << event.thread
+             << ",\"ts\":" << event.start << ",\"dur\":" << event.duration << "}";
+        first = false;
+    }
+    file << "\n],\"otherData\":{\"droppedEvents\":" << numDropped << "}}\n";
+    return file.good();
+}
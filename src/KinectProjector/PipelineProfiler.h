@@ -0,0 +1,132 @@
+/***********************************************************************
+PipelineProfiler - PipelineProfiler measures the duration of the stages
+of the depth processing and rendering pipeline.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+enum PipelineStage
+{
+    STAGE_KINECT_UPDATE,
+    STAGE_FILTER,
+    STAGE_SPATIAL_FILTER,
+    STAGE_GRADIENT_FIELD,
+    STAGE_FRAME_HANDOFF, // From the frame publication by the grabber to its reception by the main thread
+    STAGE_PROJECTOR_UPDATE,
+    STAGE_TERRAIN_ANALYSIS,
+    STAGE_DRIFT_TRACKING,
+    STAGE_CONTOUR_LINES,
+    STAGE_DRAW_SANDBOX,
+    STAGE_MODEL_UPDATE,
+    STAGE_MODEL_DRAW,
+    NUM_PIPELINE_STAGES
+};
+
+// Each thread records its measures in its own lock-free ring buffer,
+// the main thread collects them once per frame for the statistics and the trace.
+// The ring of an exiting thread is reused by the next new thread, so that
+// recreating a worker pool does not allocate new rings.
+class PipelineProfiler {
+public:
+    struct Event {
+        int stage;
+        int thread;
+        uint64_t start; // Microseconds
+        uint64_t duration;
+    };
+
+    struct Percentiles {
+        float p50, p95, p99; // Milliseconds
+        int numSamples;
+    };
+
+    static PipelineProfiler& get();
+
+    static uint64_t now(); // Microseconds, monotonic
+    static const char* getStageName(int stage);
+
+    void setThreadName(const std::string& name); // Name of the calling thread in the trace
+    void record(int stage, uint64_t start, uint64_t end); // Can be called from any thread
+
+    void collect(); // Gather the measures of all threads, to be called by the main thread
+    Percentiles getPercentiles(int stage) const; // Over the last collected measures of the stage
+    bool exportChromeTrace(const std::string& path) const; // chrome://tracing JSON file
+
+private:
+    static const int ringSize = 1024; // Events a thread can record between two collects
+    static const int historySize = 256; // Measures per stage used for the percentiles
+    static const int traceSize = 32768; // Events kept for the trace export
+
+    struct ThreadRing {
+        int id;
+        std::string name;
+        Event events[ringSize];
+        std::atomic<unsigned int> head; // Written by the recording thread
+        std::atomic<unsigned int> tail; // Written by the collecting thread
+        std::atomic<unsigned int> dropped;
+    };
+
+    // Gives the ring of a thread back to the profiler when the thread exits
+    struct ThreadRingHandle {
+        ThreadRing* ring;
+        ThreadRingHandle()
+        :ring(0)
+        {
+        }
+        ~ThreadRingHandle();
+    };
+
+    PipelineProfiler();
+    ThreadRing* getThreadRing();
+    void releaseThreadRing(ThreadRing* ring);
+
+    mutable std::mutex ringsMutex; // Protects the registration of the threads
+    std::vector<std::unique_ptr<ThreadRing> > rings;
+    std::vector<ThreadRing*> freeRings; // Rings of the exited threads, the events they hold are still collected
+
+    std::vector<float> history[NUM_PIPELINE_STAGES]; // Durations in ms
+    int historyIndex[NUM_PIPELINE_STAGES];
+    std::vector<Event> trace;
+    int traceIndex;
+    uint64_t numDropped;
+};
+
+// Measure the duration of a scope
+class ScopedStageTimer {
+public:
+    ScopedStageTimer(int sstage)
+    :stage(sstage),
+    start(PipelineProfiler::now())
+    {
+    }
+    ~ScopedStageTimer(){
+        PipelineProfiler::get().record(stage, start, PipelineProfiler::now());
+    }
+
+private:
+    int stage;
+    uint64_t start;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_STAGE(stage) ScopedStageTimer PROFILE_CONCAT(stageTimer, __LINE__)(stage)
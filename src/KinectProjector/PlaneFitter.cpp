@@ -0,0 +1,276 @@
+/***********************************************************************
+PlaneFitter - PlaneFitter fits a plane to the world coordinates of a
+rectangle of the filtered depth frame.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#include "PlaneFitter.h"
+
+PlaneFitter::PlaneFitter(WorkerPool& sworkerPool)
+:workerPool(sworkerPool),
+robust(true),
+huberThreshold(5),
+maxIterations(10),
+step(1),
+depth(NULL),
+mask(NULL),
+frameWidth(0),
+minX(0),
+maxX(0),
+minY(0),
+maxY(0),
+weighted(false),
+currentPlane(0),
+planeEq(0),
+centroid(0),
+rmsError(0),
+numPoints(0),
+numIterations(0)
+{
+}
+
+void PlaneFitter::setRobust(bool srobust){
+    robust = srobust;
+}
+
+void PlaneFitter::setHuberThreshold(float sthreshold){
+    huberThreshold = std::max(sthreshold, 0.01f);
+}
+
+void PlaneFitter::setMaxIterations(int smaxIterations){
+    maxIterations = std::max(smaxIterations, 0);
+}
+
+void PlaneFitter::setStep(int sstep){
+    step = std::max(sstep, 1);
+}
+
+bool PlaneFitter::fit(const float* sdepth, int sframeWidth, int frameHeight, const ofRectangle& area, const ofMatrix4x4& kinectWorldMatrix){
+    return fit(sdepth, NULL, sframeWidth, frameHeight, area, kinectWorldMatrix);
+}
+
+/**
+ * @fn	bool PlaneFitter::fit(const float* depth, const unsigned char* mask, int frameWidth, int frameHeight, const ofRectangle& area, const ofMatrix4x4& kinectWorldMatrix)
+ *
+ * @brief	Fits a plane to the valid pixels of a rectangle of a depth frame. Each
+ * 			iteration is one parallel pass over the rectangle.
+ *
+ * @param	depth			 	The filtered depth frame.
+ * @param	mask			 	Pixels to fit, NULL to fit all the pixels.
+ * @param	frameWidth		 	Width of the frame.
+ * @param	frameHeight		 	Height of the frame.
+ * @param	area			 	The rectangle in kinect pixel coordinates.
+ * @param	kinectWorldMatrix	The kinect to world matrix.
+ *
+ * @return	False if the pixels do not span a plane, the last plane is kept.
+ */
+
+bool PlaneFitter::fit(const float* sdepth, const unsigned char* smask, int sframeWidth, int frameHeight, const ofRectangle& area, const ofMatrix4x4& kinectWorldMatrix){
+    depth = sdepth;
+    mask = smask;
+    frameWidth = sframeWidth;
+    minX = std::max(static_cast<int>(area.getLeft()), 0);
+    minY = std::max(static_cast<int>(area.getTop()), 0);
+    maxX = std::min(static_cast<int>(area.getLeft())+static_cast<int>(area.width), frameWidth);
+    maxY = std::min(static_cast<int>(area.getTop())+static_cast<int>(area.height), frameHeight);
+    worldMatrix = kinectWorldMatrix;
+    numIterations = 0;
+    if (maxX <= minX || maxY <= minY){
+        ofLogVerbose("PlaneFitter") << "fit(): Empty area: " << area;
+        return false;
+    }
+
+    // Center the sums on the point at the middle of the area
+    int cx = (minX+maxX)/2;
+    int cy = (minY+maxY)/2;
+    float cz = depth[cy*frameWidth+cx];
+    reference = cz > 0 ? ofVec3f((worldMatrix(0, 0)*cx+worldMatrix(0, 1)*cy+worldMatrix(0, 2)*cz+worldMatrix(0, 3))*cz,
+                                 (worldMatrix(1, 0)*cx+worldMatrix(1, 1)*cy+worldMatrix(1, 2)*cz+worldMatrix(1, 3))*cz,
+                                 (worldMatrix(2, 0)*cx+worldMatrix(2, 1)*cy+worldMatrix(2, 2)*cz+worldMatrix(2, 3))*cz) : ofVec3f(0);
+
+    int numRows = (maxY-minY+step-1)/step;
+    int numTasks = (numRows+rowsPerTask-1)/rowsPerTask;
+    taskMoments.resize(numTasks);
+    weighted = false;
+    ofVec4f plane;
+    ofVec3f mean;
+    float rms;
+    bool found = false;
+    int iterations = robust ? maxIterations+1 : 1;
+    for (int iteration = 0; iteration < iterations; iteration++){
+        workerPool.run(numTasks, [this, numRows](int task) {
+            accumulateRows(taskMoments[task], task*rowsPerTask, std::min(numRows, (task+1)*rowsPerTask));
+        });
+        Moments moments = {};
+        for (int task = 0; task < numTasks; task++){
+            const Moments& m = taskMoments[task];
+            moments.w += m.w;
+            moments.x += m.x;
+            moments.y += m.y;
+            moments.z += m.z;
+            moments.xx += m.xx;
+            moments.xy += m.xy;
+            moments.xz += m.xz;
+            moments.yy += m.yy;
+            moments.yz += m.yz;
+            moments.zz += m.zz;
+            moments.n += m.n;
+        }
+        numIterations++;
+        if (!solve(moments, plane, mean, rms))
+            break;
+        // Converged when the plane turned by less than 0.01 degree and the new mean is within 0.01 mm of the previous plane
+        bool converged = found && ofVec3f(plane).getCrossed(ofVec3f(currentPlane)).length() < 1.7e-4f && std::abs(ofVec3f(currentPlane).dot(mean)+currentPlane.w) < 0.01f;
+        found = true;
+        currentPlane = plane;
+        centroid = mean;
+        rmsError = rms;
+        numPoints = moments.n;
+        weighted = true;
+        if (converged)
+            break;
+    }
+    if (!found){
+        ofLogVerbose("PlaneFitter") << "fit(): The points don't span a plane";
+        return false;
+    }
+    planeEq = currentPlane;
+    ofLogVerbose("PlaneFitter") << "fit(): plane: " << planeEq << " points: " << numPoints << " RMS error: " << rmsError << " mm, iterations: " << numIterations;
+    return true;
+}
+
+void PlaneFitter::accumulateRows(Moments& moments, int firstRow, int endRow) const {
+    const ofMatrix4x4& m = worldMatrix;
+    double w = 0, sx = 0, sy = 0, sz = 0, sxx = 0, sxy = 0, sxz = 0, syy = 0, syz = 0, szz = 0;
+    size_t n = 0;
+    for (int row = firstRow; row < endRow; row++){
+        int y = minY+row*step;
+        const float* depthRow = depth+static_cast<size_t>(y)*frameWidth;
+        const unsigned char* maskRow = mask != NULL ? mask+static_cast<size_t>(y)*frameWidth : NULL;
+        float ky = static_cast<float>(y);
+        float ox = m(0, 1)*ky+m(0, 3); // Terms constant along the row
+        float oy = m(1, 1)*ky+m(1, 3);
+        float oz = m(2, 1)*ky+m(2, 3);
+        for (int x = minX; x < maxX; x += step){
+            float z = depthRow[x];
+            if (!(z > 0) || (maskRow != NULL && maskRow[x] == 0)) // Also skips NaN
+                continue;
+            float kx = static_cast<float>(x);
+            float wx = (m(0, 0)*kx+ox+m(0, 2)*z)*z;
+            float wy = (m(1, 0)*kx+oy+m(1, 2)*z)*z;
+            float wz = (m(2, 0)*kx+oz+m(2, 2)*z)*z;
+            double weight = 1;
+            if (weighted){
+                float distance = std::abs(currentPlane.x*wx+currentPlane.y*wy+currentPlane.z*wz+currentPlane.w);
+                if (distance > huberThreshold)
+                    weight = huberThreshold/distance;
+            }
+            double dx = wx-reference.x;
+            double dy = wy-reference.y;
+            double dz = wz-reference.z;
+            double wdx = weight*dx, wdy = weight*dy, wdz = weight*dz;
+            w += weight;
+            sx += wdx;
+            sy += wdy;
+            sz += wdz;
+            sxx += wdx*dx;
+            sxy += wdx*dy;
+            sxz += wdx*dz;
+            syy += wdy*dy;
+            syz += wdy*dz;
+            szz += wdz*dz;
+            n++;
+        }
+    }
+    moments.w = w;
+    moments.x = sx;
+    moments.y = sy;
+    moments.z = sz;
+    moments.xx = sxx;
+    moments.xy = sxy;
+    moments.xz = sxz;
+    moments.yy = syy;
+    moments.yz = syz;
+    moments.zz = szz;
+    moments.n = n;
+}
+
+/**
+ * @fn	bool PlaneFitter::solve(const Moments& moments, ofVec4f& plane, ofVec3f& mean, float& rms) const
+ *
+ * @brief	Computes the plane through the weighted mean of the points normal to
+ * 			the smallest eigenvector of their covariance.
+ *
+ * @param 		  	moments	The weighted moments of the points.
+ * @param [out]	plane  	The plane equation, unit normal pointing away from the kinect.
+ * @param [out]	mean   	The weighted mean of the points.
+ * @param [out]	rms    	The weighted RMS distance of the points to the plane.
+ *
+ * @return	False if the points don't span a plane.
+ */
+
+bool PlaneFitter::solve(const Moments& moments, ofVec4f& plane, ofVec3f& mean, float& rms) const {
+    if (moments.n < 3 || moments.w <= 0)
+        return false;
+    double mx = moments.x/moments.w, my = moments.y/moments.w, mz = moments.z/moments.w;
+    double a00 = moments.xx/moments.w-mx*mx, a01 = moments.xy/moments.w-mx*my, a02 = moments.xz/moments.w-mx*mz;
+    double a11 = moments.yy/moments.w-my*my, a12 = moments.yz/moments.w-my*mz, a22 = moments.zz/moments.w-mz*mz;
+
+    // Smallest eigenvalue of the symmetric covariance (trigonometric solution of the characteristic polynomial)
+    double q = (a00+a11+a22)/3;
+    double p1 = a01*a01+a02*a02+a12*a12;
+    double p2 = (a00-q)*(a00-q)+(a11-q)*(a11-q)+(a22-q)*(a22-q)+2*p1;
+    if (!(p2 > 0)) // Isotropic or empty
+        return false;
+    double p = sqrt(p2/6);
+    double b00 = (a00-q)/p, b11 = (a11-q)/p, b22 = (a22-q)/p, b01 = a01/p, b02 = a02/p, b12 = a12/p;
+    double r = (b00*(b11*b22-b12*b12)-b01*(b01*b22-b12*b02)+b02*(b01*b12-b11*b02))/2;
+    r = std::min(std::max(r, -1.0), 1.0);
+    double lambda = q+2*p*cos(acos(r)/3+2*PI/3);
+
+    // The eigenvector is the largest cross product of two rows of the covariance minus lambda
+    double r0[3] = {a00-lambda, a01, a02};
+    double r1[3] = {a01, a11-lambda, a12};
+    double r2[3] = {a02, a12, a22-lambda};
+    double c[3][3] = {
+        {r0[1]*r1[2]-r0[2]*r1[1], r0[2]*r1[0]-r0[0]*r1[2], r0[0]*r1[1]-r0[1]*r1[0]},
+        {r0[1]*r2[2]-r0[2]*r2[1], r0[2]*r2[0]-r0[0]*r2[2], r0[0]*r2[1]-r0[1]*r2[0]},
+        {r1[1]*r2[2]-r1[2]*r2[1], r1[2]*r2[0]-r1[0]*r2[2], r1[0]*r2[1]-r1[1]*r2[0]}
+    };
+    int best = 0;
+    double bestNorm = 0;
+    for (int i = 0; i < 3; i++){
+        double norm = c[i][0]*c[i][0]+c[i][1]*c[i][1]+c[i][2]*c[i][2];
+        if (norm > bestNorm){
+            bestNorm = norm;
+            best = i;
+        }
+    }
+    double scale = (a00+a11+a22)*(a00+a11+a22);
+    if (!(bestNorm > 1e-24*scale*scale)) // Points on a line
+        return false;
+    double length = sqrt(bestNorm);
+    double nx = c[best][0]/length, ny = c[best][1]/length, nz = c[best][2]/length;
+    if (nz < 0){ // Away from the kinect
+        nx = -nx;
+        ny = -ny;
+        nz = -nz;
+    }
+    mean = ofVec3f(static_cast<float>(mx+reference.x), static_cast<float>(my+reference.y), static_cast<float>(mz+reference.z));
+    double offset = -(nx*(mx+reference.x)+ny*(my+reference.y)+nz*(mz+reference.z));
+    plane = ofVec4f(static_cast<float>(nx), static_cast<float>(ny), static_cast<float>(nz), static_cast<float>(offset));
+    rms = static_cast<float>(sqrt(std::max(lambda, 0.0)));
+    return true;
+}
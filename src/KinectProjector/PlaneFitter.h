@@ -0,0 +1,100 @@
+/***********************************************************************
+PlaneFitter - PlaneFitter fits a plane to the world coordinates of a
+rectangle of the filtered depth frame.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#pragma once
+#include "ofMain.h"
+
+#include "WorkerPool.h"
+
+// The world coordinates are computed on the fly from the depth frame, the
+// points are never stored: each pass over the rectangle only accumulates the
+// weighted moments of the points, in double precision, one partial sum per
+// band of rows summed in band order so that a fit does not depend on the
+// number of threads. The plane is the total least squares plane of the
+// points (smallest eigenvector of their covariance).
+// With the robust fit, the points are then reweighted with the Huber weight
+// of their distance to the plane (1 below the threshold, threshold/distance
+// above) and the plane is fitted again, so that hands or heaps of sand
+// only have a bounded influence on the plane.
+class PlaneFitter {
+public:
+    PlaneFitter(WorkerPool& sworkerPool); // The pool runs the bands of rows of the fit
+
+    void setRobust(bool srobust);
+    void setHuberThreshold(float sthreshold); // Distance to the plane in mm
+    void setMaxIterations(int smaxIterations); // Reweighting iterations of the robust fit
+    void setStep(int sstep); // Use one pixel out of step in each direction
+
+    // Fit the valid pixels of area (kinect pixel coordinates, clipped to the frame)
+    // with world = kinectWorldMatrix*(x, y, z, 1)*z, return false and keep the last
+    // plane if the pixels do not span a plane
+    bool fit(const float* depth, int frameWidth, int frameHeight, const ofRectangle& area, const ofMatrix4x4& kinectWorldMatrix);
+    // Same with a mask of the frame, only the pixels with a non zero mask are fitted
+    bool fit(const float* depth, const unsigned char* mask, int frameWidth, int frameHeight, const ofRectangle& area, const ofMatrix4x4& kinectWorldMatrix);
+
+    const ofVec4f& getPlaneEq() const { // Unit normal pointing away from the kinect and offset
+        return planeEq;
+    }
+    const ofVec3f& getCentroid() const {
+        return centroid;
+    }
+    float getRMSError() const { // Weighted distance of the points to the plane, mm
+        return rmsError;
+    }
+    size_t getNumPoints() const { // Valid points of the last fit
+        return numPoints;
+    }
+    int getNumIterations() const {
+        return numIterations;
+    }
+
+private:
+    struct Moments {
+        double w, x, y, z, xx, xy, xz, yy, yz, zz;
+        size_t n;
+    };
+
+    void accumulateRows(Moments& moments, int firstRow, int endRow) const;
+    bool solve(const Moments& moments, ofVec4f& plane, ofVec3f& mean, float& rms) const;
+
+    static const int rowsPerTask = 16;
+
+    WorkerPool& workerPool;
+    vector<Moments> taskMoments; // One partial sum per band of rows
+
+    bool robust;
+    float huberThreshold;
+    int maxIterations;
+    int step;
+
+    // Input of the current fit
+    const float* depth;
+    const unsigned char* mask;
+    int frameWidth;
+    int minX, maxX, minY, maxY;
+    ofMatrix4x4 worldMatrix;
+    ofVec3f reference; // Subtracted from the points before accumulation
+    bool weighted; // Huber weights from currentPlane
+    ofVec4f currentPlane;
+
+    ofVec4f planeEq;
+    ofVec3f centroid;
+    float rmsError;
+    size_t numPoints;
+    int numIterations;
+};
@@ -0,0 +1,75 @@
+/***********************************************************************
+ProjectorMap - ProjectorMap caches the projector coordinates of a grid
+of kinect points covering the kinect ROI.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#include "ProjectorMap.h"
+
+ProjectorMap::ProjectorMap()
+:step(2),
+nextStep(2),
+invStep(0.5f),
+minX(0),
+minY(0),
+maxX(0),
+maxY(0),
+cols(0),
+rows(0)
+{
+}
+
+void ProjectorMap::setStep(int sstep){
+    nextStep = std::max(sstep, 1);
+}
+
+void ProjectorMap::update(const float* depth, int frameWidth, const ofRectangle& ROI, const ofMatrix4x4& kinectWorldMatrix, const ofMatrix4x4& kinectProjMatrix){
+    step = nextStep;
+    invStep = 1.0f/step;
+    int roiMinX = static_cast<int>(ROI.getMinX());
+    int roiMinY = static_cast<int>(ROI.getMinY());
+    int roiMaxX = std::max(static_cast<int>(ROI.getMaxX()), roiMinX+1);
+    int roiMaxY = std::max(static_cast<int>(ROI.getMaxY()), roiMinY+1);
+    minX = static_cast<float>(roiMinX);
+    minY = static_cast<float>(roiMinY);
+    maxX = static_cast<float>(roiMaxX);
+    maxY = static_cast<float>(roiMaxY);
+    // Enough nodes for the last node to reach the far border of the ROI
+    cols = std::max((roiMaxX-roiMinX+step-1)/step+1, 2);
+    rows = std::max((roiMaxY-roiMinY+step-1)/step+1, 2);
+    projX.resize(static_cast<size_t>(cols)*rows);
+    projY.resize(static_cast<size_t>(cols)*rows);
+
+    // Same computation as KinectProjector::kinectCoordToProjCoord(). The nodes past the ROI
+    // take the depth of the nearest pixel of the ROI so that the last cells extrapolate smoothly.
+    const ofMatrix4x4& w = kinectWorldMatrix;
+    const ofMatrix4x4& p = kinectProjMatrix;
+    for (int j = 0; j < rows; j++){
+        int ky = roiMinY+j*step;
+        const float* depthRow = depth+static_cast<size_t>(std::min(ky, roiMaxY-1))*frameWidth;
+        for (int i = 0; i < cols; i++){
+            int kx = roiMinX+i*step;
+            float z = depthRow[std::min(kx, roiMaxX-1)];
+            float wx = (w(0, 0)*kx+w(0, 1)*ky+w(0, 2)*z+w(0, 3))*z;
+            float wy = (w(1, 0)*kx+w(1, 1)*ky+w(1, 2)*z+w(1, 3))*z;
+            float wz = (w(2, 0)*kx+w(2, 1)*ky+w(2, 2)*z+w(2, 3))*z;
+            float sx = p(0, 0)*wx+p(0, 1)*wy+p(0, 2)*wz+p(0, 3);
+            float sy = p(1, 0)*wx+p(1, 1)*wy+p(1, 2)*wz+p(1, 3);
+            float sz = p(2, 0)*wx+p(2, 1)*wy+p(2, 2)*wz+p(2, 3);
+            projX[j*cols+i] = sx/sz;
+            projY[j*cols+i] = sy/sz;
+        }
+    }
+}
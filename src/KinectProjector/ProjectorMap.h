@@ -0,0 +1,61 @@
+/***********************************************************************
+ProjectorMap - ProjectorMap caches the projector coordinates of a grid
+of kinect points covering the kinect ROI.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#pragma once
+#include "ofMain.h"
+
+// The grid nodes are spaced by step kinect pixels and the points between
+// them are bilinearly interpolated. With a step of 1, the integer kinect
+// coordinates of the ROI map exactly as KinectProjector::kinectCoordToProjCoord().
+class ProjectorMap {
+public:
+    ProjectorMap();
+
+    void setStep(int sstep); // Takes effect at the next update()
+    int getStep() const {
+        return step;
+    }
+
+    // Project the grid nodes of the ROI of a filtered depth frame
+    void update(const float* depth, int frameWidth, const ofRectangle& ROI, const ofMatrix4x4& kinectWorldMatrix, const ofMatrix4x4& kinectProjMatrix);
+
+    bool isInside(float x, float y) const { // x, y in kinect pixel coordinate
+        return x >= minX && y >= minY && x < maxX && y < maxY;
+    }
+    ofVec2f getProjCoord(float x, float y) const { // x, y inside the ROI
+        float fx = (x-minX)*invStep;
+        float fy = (y-minY)*invStep;
+        int i = std::min(static_cast<int>(fx), cols-2);
+        int j = std::min(static_cast<int>(fy), rows-2);
+        float tx = fx-i;
+        float ty = fy-j;
+        int ind = j*cols+i;
+        float x0 = projX[ind]+(projX[ind+1]-projX[ind])*tx;
+        float x1 = projX[ind+cols]+(projX[ind+cols+1]-projX[ind+cols])*tx;
+        float y0 = projY[ind]+(projY[ind+1]-projY[ind])*tx;
+        float y1 = projY[ind+cols]+(projY[ind+cols+1]-projY[ind+cols])*tx;
+        return ofVec2f(x0+(x1-x0)*ty, y0+(y1-y0)*ty);
+    }
+
+private:
+    int step, nextStep;
+    float invStep;
+    float minX, minY, maxX, maxY;
+    int cols, rows; // Grid nodes, at least 2 in each direction
+    std::vector<float> projX, projY;
+};
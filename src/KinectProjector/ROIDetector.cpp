@@ -0,0 +1,189 @@
+/***********************************************************************
+ROIDetector - ROIDetector finds the sandbox walls in a quantized depth
+image with one union-find sweep over the depth levels.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#include "ROIDetector.h"
+#include "ofxCv.h"
+
+ROIDetector::ROIDetector()
+:width(0),
+height(0),
+minArea(12),
+levels(0),
+level(-1)
+{
+}
+
+/**
+ * @fn	bool ROIDetector::detect(const unsigned char* slevels, int swidth, int sheight)
+ *
+ * @brief	Finds the largest hole holding the image center over all levels,
+ * 			as the former sweep of 255 thresholds and contour searches did.
+ *
+ * @param	slevels	The quantized depth image.
+ * @param	swidth 	The image width.
+ * @param	sheight	The image height.
+ *
+ * @return	True if a hole was found.
+ */
+
+bool ROIDetector::detect(const unsigned char* slevels, int swidth, int sheight){
+    levels = slevels;
+    width = swidth;
+    height = sheight;
+    level = -1;
+    wallPolygon.clear();
+    int size = width*height;
+    if (size == 0)
+        return false;
+
+    parent.resize(size);
+    area.assign(size, 1);
+    border.resize(size);
+    active.assign(size, 0);
+    for (int i = 0; i < size; i++){
+        parent[i] = i;
+        int x = i%width;
+        int y = i/width;
+        border[i] = x == 0 || y == 0 || x == width-1 || y == height-1;
+    }
+
+    // Counting sort of the pixels by level
+    vector<int> start(257, 0);
+    for (int i = 0; i < size; i++)
+        start[levels[i]+1]++;
+    for (int l = 0; l < 256; l++)
+        start[l+1] += start[l];
+    vector<int> sorted(size);
+    vector<int> next(start.begin(), start.end()-1);
+    for (int i = 0; i < size; i++)
+        sorted[next[levels[i]]++] = i;
+
+    // The pixels without depth belong to the regions at all levels
+    for (int k = start[0]; k < start[1]; k++)
+        activate(sorted[k]);
+
+    int center = (height/2)*width+width/2;
+    int bestArea = 0;
+    for (int l = 255; l >= 1; l--){
+        // Regions at level l: pixels deeper than l
+        if (l < 255){
+            for (int k = start[l+1]; k < start[l+2]; k++)
+                activate(sorted[k]);
+        }
+        if (!active[center])
+            continue;
+        int root = find(center);
+        if (border[root])
+            break; // The region around the center reached the border: no hole at the levels above
+        if (area[root] >= minArea && area[root] > bestArea){
+            bestArea = area[root];
+            level = l;
+        }
+    }
+    if (level < 0)
+        return false;
+    traceWalls();
+    return wallPolygon.size() > 0;
+}
+
+int ROIDetector::find(int i){
+    while (parent[i] != i){
+        parent[i] = parent[parent[i]]; // Path halving
+        i = parent[i];
+    }
+    return i;
+}
+
+void ROIDetector::merge(int i, int j){
+    int ri = find(i);
+    int rj = find(j);
+    if (ri == rj)
+        return;
+    if (area[ri] < area[rj])
+        std::swap(ri, rj);
+    parent[rj] = ri;
+    area[ri] += area[rj];
+    border[ri] |= border[rj];
+}
+
+void ROIDetector::activate(int i){
+    // 4-connected regions, the walls around them are 8-connected as for the contour finder
+    active[i] = 1;
+    int x = i%width;
+    int y = i/width;
+    if (x > 0 && active[i-1])
+        merge(i, i-1);
+    if (x+1 < width && active[i+1])
+        merge(i, i+1);
+    if (y > 0 && active[i-width])
+        merge(i, i-width);
+    if (y+1 < height && active[i+width])
+        merge(i, i+width);
+}
+
+/**
+ * @fn	void ROIDetector::traceWalls()
+ *
+ * @brief	Rebuilds the hole of the best level and traces the wall pixels
+ * 			bordering it, which the contour finder returned as hole contour.
+ *
+ */
+
+void ROIDetector::traceWalls(){
+    int size = width*height;
+    vector<unsigned char> hole(size, 0);
+    vector<int> stack;
+    int center = (height/2)*width+width/2;
+    hole[center] = 1;
+    stack.push_back(center);
+    while (!stack.empty()){
+        int i = stack.back();
+        stack.pop_back();
+        int x = i%width;
+        int y = i/width;
+        int neighbours[4] = {x > 0 ? i-1 : -1, x+1 < width ? i+1 : -1, y > 0 ? i-width : -1, y+1 < height ? i+width : -1};
+        for (int n : neighbours){
+            if (n >= 0 && !hole[n] && (levels[n] == 0 || levels[n] > level)){
+                hole[n] = 1;
+                stack.push_back(n);
+            }
+        }
+    }
+
+    // Grow the hole by one pixel over the walls and take its outer contour
+    cv::Mat mask(height, width, CV_8UC1);
+    for (int y = 0; y < height; y++){
+        unsigned char* row = mask.ptr<unsigned char>(y);
+        for (int x = 0; x < width; x++){
+            unsigned char inside = 0;
+            for (int ny = std::max(y-1, 0); ny <= std::min(y+1, height-1) && !inside; ny++)
+                for (int nx = std::max(x-1, 0); nx <= std::min(x+1, width-1) && !inside; nx++)
+                    inside = hole[ny*width+nx];
+            row[x] = inside ? 255 : 0;
+        }
+    }
+    vector<vector<cv::Point> > contours;
+    cv::findContours(mask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_NONE);
+    size_t largest = 0;
+    for (size_t c = 1; c < contours.size(); c++){
+        if (contours[c].size() > contours[largest].size())
+            largest = c;
+    }
+    if (!contours.empty())
+        wallPolygon = ofxCv::toOf(contours[largest]);
+}
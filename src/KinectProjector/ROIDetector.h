@@ -0,0 +1,67 @@
+/***********************************************************************
+ROIDetector - ROIDetector finds the sandbox walls in a quantized depth
+image with one union-find sweep over the depth levels.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#pragma once
+#include "ofMain.h"
+
+// The depth image is quantized on 256 levels, 0 for the pixels without
+// depth and higher levels farther from the kinect. At a level, the pixels
+// deeper than the level (and the pixels without depth) form regions, the
+// region holding the image center is a hole when it does not reach the
+// image border: it is surrounded by the walls. Going up from the deepest
+// level, regions only grow and merge, so one sweep merging the pixels of
+// each level into a union-find gives the hole of every level. The largest
+// of these holes is the sand area.
+class ROIDetector {
+public:
+    ROIDetector();
+
+    // Return false if no hole holds the image center
+    bool detect(const unsigned char* levels, int width, int height);
+
+    void setMinArea(int sminArea){ // Smaller holes are ignored (pixels)
+        minArea = sminArea;
+    }
+    ofRectangle getROI() const { // Bounding box of the walls around the hole
+        return wallPolygon.getBoundingBox();
+    }
+    const ofPolyline& getWallPolygon() const { // Inner side of the walls, kinect coordinates
+        return wallPolygon;
+    }
+    int getLevel() const { // Highest level the hole holds at
+        return level;
+    }
+
+private:
+    int find(int i);
+    void merge(int i, int j);
+    void activate(int i);
+    void traceWalls();
+
+    int width, height;
+    int minArea;
+    const unsigned char* levels;
+    int level;
+    ofPolyline wallPolygon;
+
+    // Union-find over the pixels, the region data is valid at the roots
+    vector<int> parent;
+    vector<int> area;
+    vector<unsigned char> border; // The region touches the image border
+    vector<unsigned char> active; // The pixel belongs to a region at the current level
+};
@@ -0,0 +1,288 @@
+/***********************************************************************
+SpatialFilter - SpatialFilter smoothes the filtered depth frame inside
+the kinect ROI with a separable convolution.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#include "SpatialFilter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SPATIALFILTER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    const int maxRadius = 3;
+
+    // destination[x] = sum over the taps of weights[k]*sources[k][x]
+    void weightedSum(const float* const* sources, const float* weights, int numTaps, float* destination, int begin, int end)
+    {
+        int x = begin;
+#ifdef SPATIALFILTER_SSE2
+        for(; x + 4 <= end; x += 4)
+        {
+            __m128 acc = _mm_mul_ps(_mm_set1_ps(weights[0]), _mm_loadu_ps(sources[0] + x));
+            for (int k = 1; k < numTaps; k++)
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(sources[k] + x)));
+            _mm_storeu_ps(destination + x, acc);
+        }
+#endif
+        for(; x < end; ++x)
+        {
+            float acc = weights[0]*sources[0][x];
+            for (int k = 1; k < numTaps; k++)
+                acc += weights[k]*sources[k][x];
+            destination[x] = acc;
+        }
+    }
+
+    // Same as weightedSum but each tap is also weighted by the Tukey biweight
+    // (1-(rangeScale*difference)^2)^2 of its difference to the center value,
+    // and the result is normalized by the sum of the weights
+    void bilateralSum(const float* const* sources, const float* center, const float* weights, int numTaps, float rangeScale, float* destination, int begin, int end)
+    {
+        int x = begin;
+#ifdef SPATIALFILTER_SSE2
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 scale = _mm_set1_ps(rangeScale);
+        for(; x + 4 <= end; x += 4)
+        {
+            __m128 c = _mm_loadu_ps(center + x);
+            __m128 acc = zero;
+            __m128 norm = zero;
+            for (int k = 0; k < numTaps; k++)
+            {
+                __m128 value = _mm_loadu_ps(sources[k] + x);
+                __m128 d = _mm_mul_ps(_mm_sub_ps(value, c), scale);
+                __m128 t = _mm_max_ps(_mm_sub_ps(one, _mm_mul_ps(d, d)), zero);
+                __m128 w = _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_mul_ps(t, t));
+                acc = _mm_add_ps(acc, _mm_mul_ps(w, value));
+                norm = _mm_add_ps(norm, w);
+            }
+            _mm_storeu_ps(destination + x, _mm_div_ps(acc, norm)); // The center tap always has a positive weight
+        }
+#endif
+        for(; x < end; ++x)
+        {
+            float acc = 0, norm = 0;
+            for (int k = 0; k < numTaps; k++)
+            {
+                float value = sources[k][x];
+                float d = (value-center[x])*rangeScale;
+                float t = std::max(1.0f-d*d, 0.0f);
+                float w = weights[k]*t*t;
+                acc += w*value;
+                norm += w;
+            }
+            destination[x] = acc/norm;
+        }
+    }
+}
+
+SpatialFilter::SpatialFilter()
+:numPasses(2)
+{
+    setKernel(KERNEL_BINOMIAL3);
+    setBilateralRange(30.0f);
+}
+
+void SpatialFilter::setKernel(Kernel skernel){
+    kernel = skernel;
+    switch (kernel){
+        case KERNEL_BINOMIAL5:
+        case KERNEL_BILATERAL:
+            weights = {1, 4, 6, 4, 1};
+            break;
+        case KERNEL_BINOMIAL7:
+            weights = {1, 6, 15, 20, 15, 6, 1};
+            break;
+        case KERNEL_BOX5:
+            weights = {1, 1, 1, 1, 1};
+            break;
+        default:
+            kernel = KERNEL_BINOMIAL3;
+            weights = {1, 2, 1};
+            break;
+    }
+    radius = static_cast<int>(weights.size())/2;
+    float sum = 0;
+    for (auto w : weights)
+        sum += w;
+    for (auto & w : weights)
+        w /= sum;
+}
+
+void SpatialFilter::setNumPasses(int snumPasses){
+    numPasses = std::max(1, std::min(snumPasses, maxNumPasses));
+}
+
+void SpatialFilter::setBilateralRange(float sbilateralRange){
+    bilateralRange = std::max(sbilateralRange, 0.01f);
+    rangeScale = 1.0f/bilateralRange;
+}
+
+const char* SpatialFilter::getKernelName(Kernel skernel){
+    static const char* names[NUM_KERNELS] = {
+        "Binomial 3",
+        "Binomial 5",
+        "Binomial 7",
+        "Box 5",
+        "Bilateral"
+    };
+    return skernel >= 0 && skernel < NUM_KERNELS ? names[skernel] : "Unknown";
+}
+
+SpatialFilter::Kernel SpatialFilter::getKernelFromName(const std::string& name){
+    for (int i = 0; i < NUM_KERNELS; i++){
+        if (name == getKernelName(static_cast<Kernel>(i)))
+            return static_cast<Kernel>(i);
+    }
+    return KERNEL_BINOMIAL3;
+}
+
+double SpatialFilter::benchmark(Kernel skernel, int numPasses, int width, int height, int numFrames){
+    if (width <= 0 || height <= 0 || numFrames <= 0)
+        return 0;
+    SpatialFilter spatialFilter;
+    spatialFilter.setKernel(skernel);
+    spatialFilter.setNumPasses(numPasses);
+
+    // A sloped sand surface with sensor noise and a moving hand, regenerated before each frame as the filter works in place
+    size_t size = static_cast<size_t>(width)*height;
+    std::vector<float> frame(size);
+    unsigned int seed = 12345;
+    double elapsed = 0;
+    for (int f = 0; f < numFrames; f++){
+        for (size_t i = 0; i < size; i++){
+            seed = seed*1664525u + 1013904223u;
+            int x = static_cast<int>(i % width);
+            int y = static_cast<int>(i / width);
+            float depth = 800.0f + y/8.0f + static_cast<float>((seed >> 16) % 5) - 2.0f;
+            if ((x - f*4) % width < width/8 && y > height/3 && y < 2*height/3)
+                depth = 650.0f; // Hand
+            frame[i] = depth;
+        }
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        spatialFilter.apply(frame.data(), width, 0, 0, width, height);
+        elapsed += std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+    return elapsed/(static_cast<double>(size)*numFrames);
+}
+
+void SpatialFilter::apply(float* frame, int width, int minX, int minY, int maxX, int maxY){
+    int roiWidth = maxX-minX;
+    int roiHeight = maxY-minY;
+    if (roiWidth <= 0 || roiHeight <= 0)
+        return;
+    buffer.resize(static_cast<size_t>(roiWidth)*roiHeight);
+    float* roi = frame+static_cast<size_t>(minY)*width+minX;
+    for (int pass = 0; pass < numPasses; pass++){
+        if (kernel == KERNEL_BILATERAL){
+            filterRowsBilateral(roi, width, buffer.data(), roiWidth, roiWidth, roiHeight);
+            filterColumnsBilateral(buffer.data(), roiWidth, roi, width, roiWidth, roiHeight);
+        } else {
+            filterRows(roi, width, buffer.data(), roiWidth, roiWidth, roiHeight);
+            filterColumns(buffer.data(), roiWidth, roi, width, roiWidth, roiHeight);
+        }
+    }
+}
+
+void SpatialFilter::filterRows(const float* source, int sourceStride, float* destination, int destinationStride, int roiWidth, int roiHeight){
+    int numTaps = 2*radius+1;
+    // Interior pixels use all the taps, the border ones only those inside the ROI
+    int interiorBegin = std::min(radius, roiWidth);
+    int interiorEnd = std::max(interiorBegin, roiWidth-radius);
+    for (int y = 0; y < roiHeight; y++){
+        const float* src = source+static_cast<size_t>(y)*sourceStride;
+        float* dst = destination+static_cast<size_t>(y)*destinationStride;
+        const float* sources[2*maxRadius+1];
+        for (int k = 0; k < numTaps; k++)
+            sources[k] = src+k-radius;
+        weightedSum(sources, weights.data(), numTaps, dst, interiorBegin, interiorEnd);
+        for (int x = 0; x < roiWidth; x++){
+            if (x == interiorBegin)
+                x = interiorEnd;
+            if (x >= roiWidth)
+                break;
+            float acc = 0, norm = 0;
+            for (int k = std::max(0, radius-x); k < numTaps && x+k-radius < roiWidth; k++){
+                acc += weights[k]*src[x+k-radius];
+                norm += weights[k];
+            }
+            dst[x] = acc/norm;
+        }
+    }
+}
+
+void SpatialFilter::filterColumns(const float* source, int sourceStride, float* destination, int destinationStride, int roiWidth, int roiHeight){
+    int numTaps = 2*radius+1;
+    for (int y = 0; y < roiHeight; y++){
+        // Every output row is a weighted sum of the input rows inside the ROI
+        int kBegin = std::max(0, radius-y);
+        int kEnd = std::min(numTaps, roiHeight-y+radius);
+        const float* sources[2*maxRadius+1];
+        float rowWeights[2*maxRadius+1];
+        float norm = 0;
+        for (int k = kBegin; k < kEnd; k++)
+            norm += weights[k];
+        for (int k = kBegin; k < kEnd; k++){
+            sources[k-kBegin] = source+static_cast<size_t>(y+k-radius)*sourceStride;
+            rowWeights[k-kBegin] = weights[k]/norm;
+        }
+        weightedSum(sources, rowWeights, kEnd-kBegin, destination+static_cast<size_t>(y)*destinationStride, 0, roiWidth);
+    }
+}
+
+void SpatialFilter::filterRowsBilateral(const float* source, int sourceStride, float* destination, int destinationStride, int roiWidth, int roiHeight){
+    int numTaps = 2*radius+1;
+    int interiorBegin = std::min(radius, roiWidth);
+    int interiorEnd = std::max(interiorBegin, roiWidth-radius);
+    for (int y = 0; y < roiHeight; y++){
+        const float* src = source+static_cast<size_t>(y)*sourceStride;
+        float* dst = destination+static_cast<size_t>(y)*destinationStride;
+        const float* sources[2*maxRadius+1];
+        for (int k = 0; k < numTaps; k++)
+            sources[k] = src+k-radius;
+        bilateralSum(sources, src, weights.data(), numTaps, rangeScale, dst, interiorBegin, interiorEnd);
+        for (int x = 0; x < roiWidth; x++){
+            if (x == interiorBegin)
+                x = interiorEnd;
+            if (x >= roiWidth)
+                break;
+            int kBegin = std::max(0, radius-x);
+            int kEnd = std::min(numTaps, roiWidth-x+radius);
+            bilateralSum(sources+kBegin, src, weights.data()+kBegin, kEnd-kBegin, rangeScale, dst, x, x+1);
+        }
+    }
+}
+
+void SpatialFilter::filterColumnsBilateral(const float* source, int sourceStride, float* destination, int destinationStride, int roiWidth, int roiHeight){
+    int numTaps = 2*radius+1;
+    for (int y = 0; y < roiHeight; y++){
+        int kBegin = std::max(0, radius-y);
+        int kEnd = std::min(numTaps, roiHeight-y+radius);
+        const float* sources[2*maxRadius+1];
+        for (int k = kBegin; k < kEnd; k++)
+            sources[k-kBegin] = source+static_cast<size_t>(y+k-radius)*sourceStride;
+        bilateralSum(sources, source+static_cast<size_t>(y)*sourceStride, weights.data()+kBegin, kEnd-kBegin, rangeScale, destination+static_cast<size_t>(y)*destinationStride, 0, roiWidth);
+    }
+}
@@ -0,0 +1,75 @@
+/***********************************************************************
+SpatialFilter - SpatialFilter smoothes the filtered depth frame inside
+the kinect ROI with a separable convolution.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#pragma once
+#include <string>
+#include <vector>
+
+// Each pass filters the rows then the columns of the ROI. The columns are
+// filtered row by row (every output row is a weighted sum of whole input rows)
+// so that both passes read and write memory contiguously. Pixels outside the ROI
+// are never read: the weights are renormalized near the ROI borders.
+class SpatialFilter {
+public:
+    enum Kernel
+    {
+        KERNEL_BINOMIAL3, // [1 2 1]/4
+        KERNEL_BINOMIAL5, // [1 4 6 4 1]/16
+        KERNEL_BINOMIAL7, // [1 6 15 20 15 6 1]/64
+        KERNEL_BOX5, // [1 1 1 1 1]/5
+        KERNEL_BILATERAL, // Binomial 5 weighted by the depth difference to preserve edges
+        NUM_KERNELS
+    };
+
+    static const int maxNumPasses = 4;
+
+    SpatialFilter();
+
+    void setKernel(Kernel skernel);
+    Kernel getKernel() const {
+        return kernel;
+    }
+    void setNumPasses(int snumPasses); // Clamped to [1, maxNumPasses]
+    int getNumPasses() const {
+        return numPasses;
+    }
+    void setBilateralRange(float sbilateralRange); // Depth difference (in depth units) beyond which the bilateral filter ignores a neighbour
+
+    // Filter in place the [minX, maxX[ x [minY, maxY[ region of a frame of the given width
+    void apply(float* frame, int width, int minX, int minY, int maxX, int maxY);
+
+    static const char* getKernelName(Kernel skernel);
+    static Kernel getKernelFromName(const std::string& name); // Return KERNEL_BINOMIAL3 if unknown
+
+    // Micro-benchmark on a synthetic sand frame filtered as a whole, return the filtering time in ns per pixel
+    static double benchmark(Kernel skernel, int numPasses, int width, int height, int numFrames);
+
+private:
+    void filterRows(const float* source, int sourceStride, float* destination, int destinationStride, int roiWidth, int roiHeight);
+    void filterColumns(const float* source, int sourceStride, float* destination, int destinationStride, int roiWidth, int roiHeight);
+    void filterRowsBilateral(const float* source, int sourceStride, float* destination, int destinationStride, int roiWidth, int roiHeight);
+    void filterColumnsBilateral(const float* source, int sourceStride, float* destination, int destinationStride, int roiWidth, int roiHeight);
+
+    Kernel kernel;
+    int numPasses;
+    int radius;
+    std::vector<float> weights; // 2*radius+1 normalized weights
+    float bilateralRange;
+    float rangeScale; // 1/bilateralRange
+    std::vector<float> buffer; // Result of the row filtering
+};
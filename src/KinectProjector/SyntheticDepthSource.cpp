@@ -0,0 +1,203 @@
+/***********************************************************************
+SyntheticDepthSource - SyntheticDepthSource generates procedural sand
+terrain depth frames to run and benchmark the application without a
+kinect.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#include "SyntheticDepthSource.h"
+
+SyntheticDepthSource::SyntheticDepthSource(const CaptureSettings::Synthetic& sparams)
+:params(sparams),
+randomState(1),
+focalLength(1),
+opened(false),
+frameNew(false),
+startTime(0),
+lastFrameTime(0),
+frameNumber(0)
+{
+}
+
+bool SyntheticDepthSource::setup(){
+    if (params.width <= 0 || params.height <= 0)
+        return false;
+    randomState = params.seed != 0 ? params.seed : 1;
+    focalLength = params.width*580.0f/640.0f; // Kinect depth camera: 580 pixels at 640x480
+
+    depthPixels.allocate(params.width, params.height, 1);
+    colorPixels.allocate(params.width, params.height, OF_IMAGE_COLOR);
+    generateTerrain();
+
+    /* Gaussian noise table (Box-Muller), looked up at random during the frame generation: */
+    noiseTable.resize(65536);
+    for (size_t i = 0; i < noiseTable.size(); i += 2){
+        float u1 = (nextRandom()+1.0f)/4294967296.0f;
+        float u2 = nextRandom()/4294967296.0f;
+        float r = sqrt(-2.0f*log(u1))*params.noise;
+        noiseTable[i] = r*cos(TWO_PI*u2);
+        noiseTable[i+1] = r*sin(TWO_PI*u2);
+    }
+
+    hands.resize(std::max(0, params.numHands));
+    for (auto & hand : hands){
+        hand.center = ofVec2f(params.width, params.height)*0.5f;
+        hand.amplitude = ofVec2f(params.width*(0.2f+0.2f*(nextRandom()%1000)/1000.0f), params.height*(0.2f+0.2f*(nextRandom()%1000)/1000.0f));
+        hand.frequency = ofVec2f(0.1f+0.2f*(nextRandom()%1000)/1000.0f, 0.1f+0.2f*(nextRandom()%1000)/1000.0f);
+        hand.phase = ofVec2f(TWO_PI*(nextRandom()%1000)/1000.0f, TWO_PI*(nextRandom()%1000)/1000.0f);
+        hand.radius = params.width/16.0f;
+        hand.height = params.hillHeight + 150.0f;
+    }
+    ofLogVerbose("SyntheticDepthSource") << "setup(): " << params.width << "x" << params.height << " at " << params.fps << " fps";
+    return true;
+}
+
+void SyntheticDepthSource::generateTerrain(){
+    int width = params.width;
+    int height = params.height;
+    terrain.resize(width*height);
+    float seedOffset = static_cast<float>(randomState % 1000);
+
+    /* Lakes: gaussian depressions at random places */
+    vector<ofVec3f> lakes; // x, y, radius
+    for (int i = 0; i < params.numLakes; i++)
+        lakes.push_back(ofVec3f(width*(0.1f+0.8f*(nextRandom()%1000)/1000.0f), height*(0.1f+0.8f*(nextRandom()%1000)/1000.0f), params.hillSize*(0.3f+0.4f*(nextRandom()%1000)/1000.0f)));
+
+    for (int y = 0; y < height; y++){
+        for (int x = 0; x < width; x++){
+            /* Fractal brownian motion hills: */
+            float elevation = 0;
+            float amplitude = 0.5f;
+            float frequency = 1.0f/params.hillSize;
+            for (int octave = 0; octave < 5; octave++){
+                elevation += amplitude*ofNoise(x*frequency + seedOffset, y*frequency + seedOffset, octave*10.0f);
+                amplitude *= 0.5f;
+                frequency *= 2.0f;
+            }
+            elevation *= params.hillHeight;
+            for (auto & lake : lakes){
+                float d2 = (x-lake.x)*(x-lake.x) + (y-lake.y)*(y-lake.y);
+                elevation -= params.hillHeight*0.6f*exp(-d2/(lake.z*lake.z));
+            }
+            terrain[y*width+x] = params.baseDepth - elevation;
+        }
+    }
+
+    /* Color frame: sand shaded by elevation */
+    for (int i = 0; i < width*height; i++){
+        float shade = ofClamp((params.baseDepth - terrain[i])/params.hillHeight, -0.5f, 1.0f)*0.3f + 0.6f;
+        colorPixels[3*i] = static_cast<unsigned char>(230*shade);
+        colorPixels[3*i+1] = static_cast<unsigned char>(200*shade);
+        colorPixels[3*i+2] = static_cast<unsigned char>(150*shade);
+    }
+}
+
+uint32_t SyntheticDepthSource::nextRandom(){
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+bool SyntheticDepthSource::open(){
+    opened = !terrain.empty();
+    startTime = lastFrameTime = ofGetElapsedTimeMicros();
+    frameNumber = 0;
+    return opened;
+}
+
+void SyntheticDepthSource::close(){
+    opened = false;
+}
+
+void SyntheticDepthSource::update(){
+    frameNew = false;
+    if (!opened)
+        return;
+    if (params.fps > 0){
+        uint64_t now = ofGetElapsedTimeMicros();
+        uint64_t period = static_cast<uint64_t>(1000000.0f/params.fps);
+        if (now - lastFrameTime < period){
+            ofSleepMillis(std::max(1, static_cast<int>((period - (now - lastFrameTime))/2000))); // Do not spin the grabber thread
+            return;
+        }
+        lastFrameTime += period;
+        if (now - lastFrameTime > period) // Too late, do not try to catch up
+            lastFrameTime = now;
+    }
+    generateFrame();
+    frameNumber++;
+    frameNew = true;
+}
+
+void SyntheticDepthSource::generateFrame(){
+    int width = params.width;
+    int height = params.height;
+    unsigned short* depth = depthPixels.getData();
+    uint32_t dropoutThreshold = static_cast<uint32_t>(ofClamp(params.dropouts, 0, 1)*65535.0f);
+
+    /* Sand surface with sensor noise and invalid pixels: */
+    for (int i = 0; i < width*height; i++){
+        uint32_t random = nextRandom();
+        if ((random & 0xffff) < dropoutThreshold){
+            depth[i] = (random & 0x10000) ? invalidDepth : 0;
+        } else {
+            float value = terrain[i] + noiseTable[random >> 16];
+            depth[i] = static_cast<unsigned short>(ofClamp(value + 0.5f, 1, 65535));
+        }
+    }
+
+    /* Hands: discs above the sand following their path, the time is the frame number for reproducible frames */
+    float time = params.fps > 0 ? frameNumber/params.fps : frameNumber/30.0f;
+    for (auto & hand : hands){
+        ofVec2f position = hand.center + ofVec2f(hand.amplitude.x*sin(TWO_PI*hand.frequency.x*time + hand.phase.x), hand.amplitude.y*sin(TWO_PI*hand.frequency.y*time + hand.phase.y));
+        int minX = std::max(0, static_cast<int>(position.x - hand.radius));
+        int maxX = std::min(width-1, static_cast<int>(position.x + hand.radius));
+        int minY = std::max(0, static_cast<int>(position.y - hand.radius));
+        int maxY = std::min(height-1, static_cast<int>(position.y + hand.radius));
+        float radius2 = hand.radius*hand.radius;
+        for (int y = minY; y <= maxY; y++){
+            for (int x = minX; x <= maxX; x++){
+                float d2 = (x-position.x)*(x-position.x) + (y-position.y)*(y-position.y);
+                if (d2 <= radius2)
+                    depth[y*width+x] = static_cast<unsigned short>(params.baseDepth - hand.height - 20.0f*(1.0f - d2/radius2));
+            }
+        }
+    }
+}
+
+bool SyntheticDepthSource::isFrameNew(){
+    return frameNew;
+}
+
+int SyntheticDepthSource::getWidth() const{
+    return params.width;
+}
+
+int SyntheticDepthSource::getHeight() const{
+    return params.height;
+}
+
+const ofShortPixels& SyntheticDepthSource::getRawDepthPixels(){
+    return depthPixels;
+}
+
+const ofPixels& SyntheticDepthSource::getPixels(){
+    return colorPixels;
+}
+
+ofVec3f SyntheticDepthSource::getWorldCoordinateAt(int x, int y, float z){
+    return ofVec3f((x - params.width*0.5f)*z/focalLength, (y - params.height*0.5f)*z/focalLength, z);
+}
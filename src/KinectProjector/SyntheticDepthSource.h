@@ -0,0 +1,71 @@
+/***********************************************************************
+SyntheticDepthSource - SyntheticDepthSource generates procedural sand
+terrain depth frames to run and benchmark the application without a
+kinect.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#pragma once
+#include "DepthSource.h"
+#include <stdint.h>
+
+// Fractal hills and lakes seen from above, with hands moving over the sand,
+// gaussian sensor noise and invalid pixels
+class SyntheticDepthSource: public DepthSource {
+public:
+    SyntheticDepthSource(const CaptureSettings::Synthetic& sparams);
+
+    bool setup() override;
+    bool open() override;
+    void close() override;
+    void update() override;
+    bool isFrameNew() override;
+
+    int getWidth() const override;
+    int getHeight() const override;
+    const ofShortPixels& getRawDepthPixels() override;
+    const ofPixels& getPixels() override;
+    ofVec3f getWorldCoordinateAt(int x, int y, float z) override;
+    string getName() const override {
+        return "synthetic";
+    }
+
+    static const unsigned short invalidDepth = 2047; // Kinect value for pixels without depth
+
+private:
+    struct Hand {
+        ofVec2f center, amplitude, frequency, phase; // Lissajous path
+        float radius;
+        float height; // Height above the sand floor in mm
+    };
+
+    void generateTerrain();
+    void generateFrame();
+    uint32_t nextRandom(); // xorshift32
+
+    CaptureSettings::Synthetic params;
+    vector<float> terrain; // Depth of the sand surface in mm
+    vector<Hand> hands;
+    vector<float> noiseTable; // Gaussian noise samples
+    uint32_t randomState;
+    float focalLength; // Fake intrinsics, in pixels
+    bool opened;
+    bool frameNew;
+    uint64_t startTime;
+    uint64_t lastFrameTime;
+    unsigned int frameNumber;
+    ofShortPixels depthPixels;
+    ofPixels colorPixels;
+};
@@ -0,0 +1,412 @@
+/***********************************************************************
+TemporalFilter - TemporalFilter computes the running mean and variance
+of each depth pixel and keeps the stable values of the depth frame.
+Copyright (c) 2016 Thomas Wolf
+
+--- Adapted from FrameFilter of the Augmented Reality Sandbox
+Copyright (c) 2012-2015 Oliver Kreylos
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#include "TemporalFilter.h"
+#include "FilterBuffers.h"
+
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+// The vector implementations compute exactly the same floating point operations,
+// in the same order, as the scalar one so that all of them give bit-identical frames.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEMPORALFILTER_SSE2
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#define TEMPORALFILTER_AVX2
+#define TEMPORALFILTER_AVX2_TARGET
+#include <immintrin.h>
+#include <intrin.h>
+#elif defined(__GNUC__)
+#define TEMPORALFILTER_AVX2
+#define TEMPORALFILTER_AVX2_TARGET __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+#endif
+
+namespace
+{
+    bool filterSpanScalar(const TemporalFilter::Parameters& params, const TemporalFilter::Planes& planes, size_t begin, size_t end)
+    {
+        float* averagingSlot = planes.averagingSlots[planes.averagingSlotIndex];
+        bool changed = false;
+        for(size_t i = begin ; i < end ; ++i)
+        {
+            float newVal = static_cast<float>(planes.input[i]);
+            float oldVal = averagingSlot[i];
+
+            if(newVal > params.maxOffset)//we are under the ceiling plane
+            {
+                averagingSlot[i] = newVal; // Store the value
+                if (params.followBigChange && planes.count[i] > 0){ // Follow big changes
+                    float oldFiltered = planes.sum[i]/planes.count[i]; // Compare newVal with average
+                    if(oldFiltered-newVal >= params.bigChange || newVal-oldFiltered >= params.bigChange)
+                    {
+                        for (int s = 0; s < params.numAveragingSlots; s++){ // update all averaging slots
+                            planes.averagingSlots[s][i] = newVal;
+                        }
+                        planes.count[i] = params.numAveragingSlots; //Update statistics
+                        planes.sum[i] = newVal*params.numAveragingSlots;
+                        planes.sumSq[i] = newVal*newVal*params.numAveragingSlots;
+                    }
+                }
+                /* Update the pixel's statistics: */
+                ++planes.count[i]; // Number of valid samples
+                planes.sum[i] += newVal; // Sum of valid samples
+                planes.sumSq[i] += newVal*newVal; // Sum of squares of valid samples
+
+                /* Check if the previous value in the averaging buffer was not initiated */
+                if(oldVal != params.initialValue)
+                {
+                    --planes.count[i]; // Number of valid samples
+                    planes.sum[i] -= oldVal; // Sum of valid samples
+                    planes.sumSq[i] -= oldVal * oldVal; // Sum of squares of valid samples
+                }
+            }
+            // Check if the pixel is "stable": */
+            float count = planes.count[i];
+            if(count >= params.minNumSamples &&
+               planes.sumSq[i]*count <= params.maxVariance*count*count + planes.sum[i]*planes.sum[i])
+            {
+                /* Check if the new running mean is outside the previous value's envelope: */
+                float newFiltered = planes.sum[i]/count;
+                if(std::fabs(newFiltered-planes.valid[i]) >= params.hysteresis)
+                {
+                    /* Set the output pixel value to the depth-corrected running mean: */
+                    planes.valid[i] = newFiltered;
+                    changed = true;
+                }
+            }
+            planes.output[i] = planes.valid[i];
+        }
+        return changed;
+    }
+
+#ifdef TEMPORALFILTER_SSE2
+    inline __m128 blendSSE2(__m128 mask, __m128 a, __m128 b) // mask ? a : b
+    {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    // Filter 4 pixels starting at i, return true if a valid value changed
+    inline bool filterBlockSSE2(const TemporalFilter::Parameters& params, const TemporalFilter::Planes& planes, size_t i)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+        __m128i raw = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(planes.input + i));
+        __m128 newVal = _mm_cvtepi32_ps(_mm_unpacklo_epi16(raw, _mm_setzero_si128()));
+        float* averagingSlot = planes.averagingSlots[planes.averagingSlotIndex] + i;
+        __m128 oldVal = _mm_loadu_ps(averagingSlot);
+        __m128 count = _mm_loadu_ps(planes.count + i);
+        __m128 sum = _mm_loadu_ps(planes.sum + i);
+        __m128 sumSq = _mm_loadu_ps(planes.sumSq + i);
+
+        __m128 underCeiling = _mm_cmpgt_ps(newVal, _mm_set1_ps(params.maxOffset));
+        _mm_storeu_ps(averagingSlot, blendSSE2(underCeiling, newVal, oldVal));
+
+        if (params.followBigChange){
+            __m128 oldFiltered = _mm_div_ps(sum, count);
+            __m128 change = _mm_and_ps(_mm_sub_ps(oldFiltered, newVal), absMask);
+            __m128 bigChange = _mm_and_ps(_mm_and_ps(underCeiling, _mm_cmpgt_ps(count, zero)),
+                                          _mm_cmpge_ps(change, _mm_set1_ps(params.bigChange)));
+            if (_mm_movemask_ps(bigChange)){
+                __m128 n = _mm_set1_ps(static_cast<float>(params.numAveragingSlots));
+                for (int s = 0; s < params.numAveragingSlots; s++){
+                    float* slot = planes.averagingSlots[s] + i;
+                    _mm_storeu_ps(slot, blendSSE2(bigChange, newVal, _mm_loadu_ps(slot)));
+                }
+                count = blendSSE2(bigChange, n, count);
+                sum = blendSSE2(bigChange, _mm_mul_ps(newVal, n), sum);
+                sumSq = blendSSE2(bigChange, _mm_mul_ps(_mm_mul_ps(newVal, newVal), n), sumSq);
+            }
+        }
+
+        count = blendSSE2(underCeiling, _mm_add_ps(count, one), count);
+        sum = blendSSE2(underCeiling, _mm_add_ps(sum, newVal), sum);
+        sumSq = blendSSE2(underCeiling, _mm_add_ps(sumSq, _mm_mul_ps(newVal, newVal)), sumSq);
+
+        __m128 removeOld = _mm_and_ps(underCeiling, _mm_cmpneq_ps(oldVal, _mm_set1_ps(params.initialValue)));
+        count = blendSSE2(removeOld, _mm_sub_ps(count, one), count);
+        sum = blendSSE2(removeOld, _mm_sub_ps(sum, oldVal), sum);
+        sumSq = blendSSE2(removeOld, _mm_sub_ps(sumSq, _mm_mul_ps(oldVal, oldVal)), sumSq);
+
+        _mm_storeu_ps(planes.count + i, count);
+        _mm_storeu_ps(planes.sum + i, sum);
+        _mm_storeu_ps(planes.sumSq + i, sumSq);
+
+        __m128 variance = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(params.maxVariance), count), count), _mm_mul_ps(sum, sum));
+        __m128 stable = _mm_and_ps(_mm_cmpge_ps(count, _mm_set1_ps(params.minNumSamples)),
+                                   _mm_cmple_ps(_mm_mul_ps(sumSq, count), variance));
+        __m128 newFiltered = _mm_div_ps(sum, count);
+        __m128 valid = _mm_loadu_ps(planes.valid + i);
+        __m128 update = _mm_and_ps(stable, _mm_cmpge_ps(_mm_and_ps(_mm_sub_ps(newFiltered, valid), absMask),
+                                                        _mm_set1_ps(params.hysteresis)));
+        valid = blendSSE2(update, newFiltered, valid);
+        _mm_storeu_ps(planes.valid + i, valid);
+        _mm_storeu_ps(planes.output + i, valid);
+        return _mm_movemask_ps(update) != 0;
+    }
+
+    bool filterSpanSSE2(const TemporalFilter::Parameters& params, const TemporalFilter::Planes& planes, size_t begin, size_t end)
+    {
+        size_t i = begin;
+        bool changed = false;
+        for(; i + 8 <= end ; i += 8)
+        {
+            changed |= filterBlockSSE2(params, planes, i);
+            changed |= filterBlockSSE2(params, planes, i+4);
+        }
+        for(; i + 4 <= end ; i += 4)
+            changed |= filterBlockSSE2(params, planes, i);
+        changed |= filterSpanScalar(params, planes, i, end);
+        return changed;
+    }
+#endif
+
+#ifdef TEMPORALFILTER_AVX2
+    // Filter 8 pixels starting at i, return true if a valid value changed
+    TEMPORALFILTER_AVX2_TARGET inline bool filterBlockAVX2(const TemporalFilter::Parameters& params, const TemporalFilter::Planes& planes, size_t i)
+    {
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+        __m128i raw = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes.input + i));
+        __m256 newVal = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(raw));
+        float* averagingSlot = planes.averagingSlots[planes.averagingSlotIndex] + i;
+        __m256 oldVal = _mm256_loadu_ps(averagingSlot);
+        __m256 count = _mm256_loadu_ps(planes.count + i);
+        __m256 sum = _mm256_loadu_ps(planes.sum + i);
+        __m256 sumSq = _mm256_loadu_ps(planes.sumSq + i);
+
+        __m256 underCeiling = _mm256_cmp_ps(newVal, _mm256_set1_ps(params.maxOffset), _CMP_GT_OQ);
+        _mm256_storeu_ps(averagingSlot, _mm256_blendv_ps(oldVal, newVal, underCeiling));
+
+        if (params.followBigChange){
+            __m256 oldFiltered = _mm256_div_ps(sum, count);
+            __m256 change = _mm256_and_ps(_mm256_sub_ps(oldFiltered, newVal), absMask);
+            __m256 bigChange = _mm256_and_ps(_mm256_and_ps(underCeiling, _mm256_cmp_ps(count, zero, _CMP_GT_OQ)),
+                                             _mm256_cmp_ps(change, _mm256_set1_ps(params.bigChange), _CMP_GE_OQ));
+            if (_mm256_movemask_ps(bigChange)){
+                __m256 n = _mm256_set1_ps(static_cast<float>(params.numAveragingSlots));
+                for (int s = 0; s < params.numAveragingSlots; s++){
+                    float* slot = planes.averagingSlots[s] + i;
+                    _mm256_storeu_ps(slot, _mm256_blendv_ps(_mm256_loadu_ps(slot), newVal, bigChange));
+                }
+                count = _mm256_blendv_ps(count, n, bigChange);
+                sum = _mm256_blendv_ps(sum, _mm256_mul_ps(newVal, n), bigChange);
+                sumSq = _mm256_blendv_ps(sumSq, _mm256_mul_ps(_mm256_mul_ps(newVal, newVal), n), bigChange);
+            }
+        }
+
+        count = _mm256_blendv_ps(count, _mm256_add_ps(count, one), underCeiling);
+        sum = _mm256_blendv_ps(sum, _mm256_add_ps(sum, newVal), underCeiling);
+        sumSq = _mm256_blendv_ps(sumSq, _mm256_add_ps(sumSq, _mm256_mul_ps(newVal, newVal)), underCeiling);
+
+        __m256 removeOld = _mm256_and_ps(underCeiling, _mm256_cmp_ps(oldVal, _mm256_set1_ps(params.initialValue), _CMP_NEQ_UQ));
+        count = _mm256_blendv_ps(count, _mm256_sub_ps(count, one), removeOld);
+        sum = _mm256_blendv_ps(sum, _mm256_sub_ps(sum, oldVal), removeOld);
+        sumSq = _mm256_blendv_ps(sumSq, _mm256_sub_ps(sumSq, _mm256_mul_ps(oldVal, oldVal)), removeOld);
+
+        _mm256_storeu_ps(planes.count + i, count);
+        _mm256_storeu_ps(planes.sum + i, sum);
+        _mm256_storeu_ps(planes.sumSq + i, sumSq);
+
+        __m256 variance = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(params.maxVariance), count), count), _mm256_mul_ps(sum, sum));
+        __m256 stable = _mm256_and_ps(_mm256_cmp_ps(count, _mm256_set1_ps(params.minNumSamples), _CMP_GE_OQ),
+                                      _mm256_cmp_ps(_mm256_mul_ps(sumSq, count), variance, _CMP_LE_OQ));
+        __m256 newFiltered = _mm256_div_ps(sum, count);
+        __m256 valid = _mm256_loadu_ps(planes.valid + i);
+        __m256 update = _mm256_and_ps(stable, _mm256_cmp_ps(_mm256_and_ps(_mm256_sub_ps(newFiltered, valid), absMask),
+                                                            _mm256_set1_ps(params.hysteresis), _CMP_GE_OQ));
+        valid = _mm256_blendv_ps(valid, newFiltered, update);
+        _mm256_storeu_ps(planes.valid + i, valid);
+        _mm256_storeu_ps(planes.output + i, valid);
+        return _mm256_movemask_ps(update) != 0;
+    }
+
+    TEMPORALFILTER_AVX2_TARGET bool filterSpanAVX2(const TemporalFilter::Parameters& params, const TemporalFilter::Planes& planes, size_t begin, size_t end)
+    {
+        size_t i = begin;
+        bool changed = false;
+        for(; i + 16 <= end ; i += 16)
+        {
+            changed |= filterBlockAVX2(params, planes, i);
+            changed |= filterBlockAVX2(params, planes, i+8);
+        }
+        for(; i + 8 <= end ; i += 8)
+            changed |= filterBlockAVX2(params, planes, i);
+        changed |= filterSpanSSE2(params, planes, i, end);
+        return changed;
+    }
+
+    bool cpuSupportsAVX2()
+    {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) // The OS must save the ymm registers
+            return false;
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+#endif
+    }
+#endif
+}
+
+TemporalFilter::TemporalFilter()
+{
+    setImplementation(getBestImplementation());
+}
+
+bool TemporalFilter::filterSpan(const Parameters& params, const Planes& planes, size_t begin, size_t end) const
+{
+    return spanFunction(params, planes, begin, end);
+}
+
+bool TemporalFilter::setImplementation(Implementation simplementation)
+{
+    if (!isSupported(simplementation))
+        return false;
+    implementation = simplementation;
+    spanFunction = filterSpanScalar;
+#ifdef TEMPORALFILTER_SSE2
+    if (implementation == IMPLEMENTATION_SSE2)
+        spanFunction = filterSpanSSE2;
+#endif
+#ifdef TEMPORALFILTER_AVX2
+    if (implementation == IMPLEMENTATION_AVX2)
+        spanFunction = filterSpanAVX2;
+#endif
+    return true;
+}
+
+TemporalFilter::Implementation TemporalFilter::getBestImplementation()
+{
+    if (isSupported(IMPLEMENTATION_AVX2))
+        return IMPLEMENTATION_AVX2;
+    if (isSupported(IMPLEMENTATION_SSE2))
+        return IMPLEMENTATION_SSE2;
+    return IMPLEMENTATION_SCALAR;
+}
+
+bool TemporalFilter::isSupported(Implementation simplementation)
+{
+    switch (simplementation){
+        case IMPLEMENTATION_SCALAR:
+            return true;
+        case IMPLEMENTATION_SSE2:
+#ifdef TEMPORALFILTER_SSE2
+            return true;
+#else
+            return false;
+#endif
+        case IMPLEMENTATION_AVX2:
+#ifdef TEMPORALFILTER_AVX2
+        {
+            static const bool avx2 = cpuSupportsAVX2();
+            return avx2;
+        }
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+const char* TemporalFilter::getImplementationName(Implementation simplementation)
+{
+    switch (simplementation){
+        case IMPLEMENTATION_SCALAR:
+            return "scalar";
+        case IMPLEMENTATION_SSE2:
+            return "SSE2";
+        case IMPLEMENTATION_AVX2:
+            return "AVX2";
+    }
+    return "unknown";
+}
+
+double TemporalFilter::benchmark(Implementation simplementation, int width, int height, int numAveragingSlots, int numFrames)
+{
+    TemporalFilter temporalFilter;
+    if (!temporalFilter.setImplementation(simplementation) || width*height == 0 || numFrames <= 0)
+        return 0;
+
+    Parameters params;
+    params.maxOffset = 500;
+    params.followBigChange = true;
+    params.bigChange = 10.0f;
+    params.numAveragingSlots = numAveragingSlots;
+    params.minNumSamples = (numAveragingSlots+1)/2;
+    params.maxVariance = 4;
+    params.hysteresis = 0.5f;
+    params.initialValue = 4000;
+
+    size_t size = static_cast<size_t>(width)*height;
+    std::vector<RawDepth> input(size);
+    FilterBuffers buffers;
+    buffers.allocate(width, height, numAveragingSlots, params.initialValue);
+    std::vector<float> output(size, 0);
+
+    Planes planes;
+    planes.input = &input[0];
+    planes.averagingSlots = buffers.getAveragingSlots();
+    planes.count = buffers.getCount();
+    planes.sum = buffers.getSum();
+    planes.sumSq = buffers.getSumSq();
+    planes.valid = buffers.getValid();
+    planes.output = &output[0];
+
+    // A sloped sand surface with sensor noise, ceiling pixels and a moving hand
+    unsigned int seed = 12345;
+    double elapsed = 0;
+    for (int frame = 0; frame < numFrames; frame++){
+        for (size_t i = 0; i < size; i++){
+            seed = seed*1664525u + 1013904223u;
+            int x = static_cast<int>(i % width);
+            int y = static_cast<int>(i / width);
+            int noise = static_cast<int>((seed >> 16) % 5) - 2;
+            RawDepth depth = static_cast<RawDepth>(800 + y/8 + noise);
+            if ((x - frame*4) % width < width/8 && y > height/3 && y < 2*height/3)
+                depth = 650; // Hand
+            if ((seed >> 8) % 97 == 0)
+                depth = 0; // Invalid kinect pixel
+            input[i] = depth;
+        }
+        planes.averagingSlotIndex = frame % numAveragingSlots;
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        temporalFilter.filterSpan(params, planes, 0, size);
+        elapsed += std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+    return elapsed/(static_cast<double>(size)*numFrames);
+}
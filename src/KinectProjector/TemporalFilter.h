@@ -0,0 +1,84 @@
+/***********************************************************************
+TemporalFilter - TemporalFilter computes the running mean and variance
+of each depth pixel and keeps the stable values of the depth frame.
+Copyright (c) 2016 Thomas Wolf
+
+--- Adapted from FrameFilter of the Augmented Reality Sandbox
+Copyright (c) 2012-2015 Oliver Kreylos
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#pragma once
+#include <cstddef>
+
+class TemporalFilter {
+public:
+    typedef unsigned short RawDepth; // Data type for raw depth values
+
+    enum Implementation
+    {
+        IMPLEMENTATION_SCALAR,
+        IMPLEMENTATION_SSE2,
+        IMPLEMENTATION_AVX2
+    };
+
+    // Frame filter parameters
+    struct Parameters
+    {
+        float maxOffset; // Raw depth values below this value (above the ceiling) are ignored
+        bool followBigChange;
+        float bigChange; // Amount of change over which the averaging slots are reset to the new value
+        int numAveragingSlots;
+        float minNumSamples; // Minimum number of valid samples needed to consider a pixel stable
+        float maxVariance; // Maximum variance to consider a pixel stable
+        float hysteresis; // Amount by which a new filtered value has to differ from the current value to update the display
+        float initialValue; // Value of the averaging slots which have not received a sample yet
+    };
+
+    // Buffers of a frame, all indexed by the same pixel index (y*width+x)
+    struct Planes
+    {
+        const RawDepth* input; // Raw depth frame
+        float* const* averagingSlots; // numAveragingSlots planes of past samples
+        int averagingSlotIndex; // Slot receiving the current frame
+        float* count; // Number of valid samples
+        float* sum; // Sum of valid samples
+        float* sumSq; // Sum of squares of valid samples
+        float* valid; // Most recent stable value
+        float* output; // Filtered frame
+    };
+
+    TemporalFilter();
+
+    // Filter the pixels [begin, end) of the planes, return true if the valid value of a pixel changed
+    bool filterSpan(const Parameters& params, const Planes& planes, size_t begin, size_t end) const;
+
+    Implementation getImplementation() const {
+        return implementation;
+    }
+    bool setImplementation(Implementation simplementation); // Return false if not supported by the cpu
+
+    static Implementation getBestImplementation();
+    static bool isSupported(Implementation simplementation);
+    static const char* getImplementationName(Implementation simplementation);
+
+    // Micro-benchmark on a synthetic sand frame stored in FilterBuffers, return the filtering time in ns per pixel
+    static double benchmark(Implementation simplementation, int width, int height, int numAveragingSlots, int numFrames);
+
+private:
+    typedef bool (*SpanFunction)(const Parameters& params, const Planes& planes, size_t begin, size_t end);
+
+    Implementation implementation;
+    SpanFunction spanFunction;
+};
@@ -0,0 +1,223 @@
+/***********************************************************************
+TerrainAnalysis - TerrainAnalysis derives the slope, aspect and
+curvature of each pixel of the elevation map.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#include "TerrainAnalysis.h"
+#include "PipelineProfiler.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TERRAINANALYSIS_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    const float halfPi = 1.57079633f;
+    const float pi = 3.14159265f;
+    const float radToDeg = 57.2957795f;
+
+    // Minimax polynomial of atan on [0, 1], error below 1e-5 radian
+    inline float atanUnit(float t)
+    {
+        float t2 = t*t;
+        return t*(0.99997726f+t2*(-0.33262347f+t2*(0.19354346f+t2*(-0.11643287f+t2*(0.05265332f+t2*-0.01172120f)))));
+    }
+
+    // Same operations as the SSE2 version so that all pixels get the same rounding
+    inline float fastAtan2(float y, float x)
+    {
+        float ax = std::abs(x);
+        float ay = std::abs(y);
+        float mx = std::max(ax, ay);
+        float t = mx > 0 ? std::min(ax, ay)/mx : 0;
+        float r = atanUnit(t);
+        if (ay > ax)
+            r = halfPi-r;
+        if (x < 0)
+            r = pi-r;
+        return y < 0 ? -r : r;
+    }
+
+#ifdef TERRAINANALYSIS_SSE2
+    inline __m128 atanUnit(__m128 t)
+    {
+        __m128 t2 = _mm_mul_ps(t, t);
+        __m128 p = _mm_set1_ps(-0.01172120f);
+        p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(0.05265332f));
+        p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(-0.11643287f));
+        p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(0.19354346f));
+        p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(-0.33262347f));
+        p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(0.99997726f));
+        return _mm_mul_ps(p, t);
+    }
+
+    inline __m128 select(__m128 mask, __m128 a, __m128 b) // mask ? a : b
+    {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    inline __m128 fastAtan2(__m128 y, __m128 x)
+    {
+        const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        const __m128 zero = _mm_setzero_ps();
+        __m128 ax = _mm_and_ps(x, absMask);
+        __m128 ay = _mm_and_ps(y, absMask);
+        __m128 mx = _mm_max_ps(ax, ay);
+        __m128 t = _mm_and_ps(_mm_cmpgt_ps(mx, zero), _mm_div_ps(_mm_min_ps(ax, ay), mx)); // 0/0 is masked out
+        __m128 r = atanUnit(t);
+        r = select(_mm_cmpgt_ps(ay, ax), _mm_sub_ps(_mm_set1_ps(halfPi), r), r);
+        r = select(_mm_cmplt_ps(x, zero), _mm_sub_ps(_mm_set1_ps(pi), r), r);
+        return select(_mm_cmplt_ps(y, zero), _mm_sub_ps(zero, r), r);
+    }
+#endif
+}
+
+TerrainAnalysis::TerrainAnalysis(WorkerPool& sworkerPool)
+:workerPool(sworkerPool),
+curvature(false),
+minX(0),
+minY(0),
+width(0),
+height(0)
+{
+}
+
+/**
+ * @fn	void TerrainAnalysis::setCurvature(bool scurvature)
+ *
+ * @brief	Enables the curvature raster, applies from the next update.
+ *
+ * @param	scurvature	True to compute the curvature.
+ */
+
+void TerrainAnalysis::setCurvature(bool scurvature){
+    curvature = scurvature;
+    if (!curvature)
+        std::vector<float>().swap(curvatureRaster);
+}
+
+/**
+ * @fn	void TerrainAnalysis::update(const ElevationMap& elevationMap)
+ *
+ * @brief	Computes all the rasters of an elevation map, bands of rows are
+ * 			analyzed on the worker pool.
+ *
+ * @param	elevationMap	The elevation map.
+ */
+
+void TerrainAnalysis::update(const ElevationMap& elevationMap){
+    PROFILE_STAGE(STAGE_TERRAIN_ANALYSIS);
+    minX = elevationMap.getMinX();
+    minY = elevationMap.getMinY();
+    width = elevationMap.getWidth();
+    height = elevationMap.getHeight();
+    size_t size = static_cast<size_t>(width)*height;
+    gradientX.resize(size);
+    gradientY.resize(size);
+    slope.resize(size);
+    aspect.resize(size);
+    if (curvature)
+        curvatureRaster.resize(size);
+    if (size == 0)
+        return;
+
+    const float* elevation = elevationMap.getElevationData();
+    int numTasks = (height+rowsPerTask-1)/rowsPerTask;
+    workerPool.run(numTasks, [this, elevation](int task) {
+        int end = std::min(height, (task+1)*rowsPerTask);
+        for (int y = task*rowsPerTask; y < end; y++)
+            analyzeRow(elevation, y);
+    });
+}
+
+void TerrainAnalysis::analyzeRow(const float* elevation, int y){
+    size_t row = static_cast<size_t>(y)*width;
+    const float* mid = elevation+row;
+    const float* up = y > 0 ? mid-width : mid;
+    const float* down = y+1 < height ? mid+width : mid;
+
+    // The first and last columns use the clamped neighbours
+    analyzePixel(up, mid, down, 0, 0, std::min(1, width-1), row);
+    if (width > 1)
+        analyzePixel(up, mid, down, width-1, width-2, width-1, row+width-1);
+
+    int x = 1;
+#ifdef TERRAINANALYSIS_SSE2
+    const __m128 two = _mm_set1_ps(2.0f), four = _mm_set1_ps(4.0f), eighth = _mm_set1_ps(0.125f);
+    const __m128 one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+    const __m128 vhalfPi = _mm_set1_ps(halfPi), vradToDeg = _mm_set1_ps(radToDeg);
+    const __m128 ninety = _mm_set1_ps(90.0f), fullTurn = _mm_set1_ps(360.0f);
+    for (; x+4 <= width-1; x += 4){
+        __m128 a = _mm_loadu_ps(up+x-1), b = _mm_loadu_ps(up+x), c = _mm_loadu_ps(up+x+1);
+        __m128 d = _mm_loadu_ps(mid+x-1), e = _mm_loadu_ps(mid+x), f = _mm_loadu_ps(mid+x+1);
+        __m128 g = _mm_loadu_ps(down+x-1), h = _mm_loadu_ps(down+x), i = _mm_loadu_ps(down+x+1);
+        __m128 gx = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_add_ps(c, _mm_mul_ps(two, f)), i), _mm_add_ps(_mm_add_ps(a, _mm_mul_ps(two, d)), g)), eighth);
+        __m128 gy = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_add_ps(g, _mm_mul_ps(two, h)), i), _mm_add_ps(_mm_add_ps(a, _mm_mul_ps(two, b)), c)), eighth);
+        _mm_storeu_ps(&gradientX[row+x], gx);
+        _mm_storeu_ps(&gradientY[row+x], gy);
+
+        // atan(m) = pi/2-atan(1/m) above 1
+        __m128 m = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(gx, gx), _mm_mul_ps(gy, gy)));
+        __m128 steep = _mm_cmpgt_ps(m, one);
+        __m128 s = atanUnit(select(steep, _mm_div_ps(one, m), m));
+        s = select(steep, _mm_sub_ps(vhalfPi, s), s);
+        _mm_storeu_ps(&slope[row+x], _mm_mul_ps(s, vradToDeg));
+
+        __m128 asp = _mm_sub_ps(ninety, _mm_mul_ps(fastAtan2(gy, _mm_sub_ps(zero, gx)), vradToDeg));
+        asp = _mm_add_ps(asp, _mm_and_ps(_mm_cmplt_ps(asp, zero), fullTurn));
+        _mm_storeu_ps(&aspect[row+x], asp);
+
+        if (curvature)
+            _mm_storeu_ps(&curvatureRaster[row+x], _mm_sub_ps(_mm_add_ps(_mm_add_ps(b, h), _mm_add_ps(d, f)), _mm_mul_ps(four, e)));
+    }
+#endif
+    for (; x < width-1; x++)
+        analyzePixel(up, mid, down, x, x-1, x+1, row+x);
+}
+
+/**
+ * @fn	void TerrainAnalysis::analyzePixel(const float* up, const float* mid, const float* down, int x, int left, int right, size_t ind)
+ *
+ * @brief	Computes the rasters of one pixel.
+ *
+ * @param	up   	The row above the pixel.
+ * @param	mid  	The row of the pixel.
+ * @param	down 	The row below the pixel.
+ * @param	x	 	The column of the pixel.
+ * @param	left 	The column of the left neighbours.
+ * @param	right	The column of the right neighbours.
+ * @param	ind  	The index of the pixel in the rasters.
+ */
+
+void TerrainAnalysis::analyzePixel(const float* up, const float* mid, const float* down, int x, int left, int right, size_t ind){
+    float a = up[left], b = up[x], c = up[right];
+    float d = mid[left], e = mid[x], f = mid[right];
+    float g = down[left], h = down[x], i = down[right];
+    float gx = ((c+2.0f*f+i)-(a+2.0f*d+g))*0.125f;
+    float gy = ((g+2.0f*h+i)-(a+2.0f*b+c))*0.125f;
+    gradientX[ind] = gx;
+    gradientY[ind] = gy;
+
+    float m = std::sqrt(gx*gx+gy*gy);
+    slope[ind] = (m > 1.0f ? halfPi-atanUnit(1.0f/m) : atanUnit(m))*radToDeg;
+
+    float asp = 90.0f-fastAtan2(gy, 0.0f-gx)*radToDeg;
+    aspect[ind] = asp < 0 ? asp+360.0f : asp;
+
+    if (curvature)
+        curvatureRaster[ind] = ((b+h)+(d+f))-4.0f*e;
+}
@@ -0,0 +1,102 @@
+/***********************************************************************
+TerrainAnalysis - TerrainAnalysis derives the slope, aspect and
+curvature of each pixel of the elevation map.
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#pragma once
+#include "ofMain.h"
+
+#include "ElevationMap.h"
+#include "WorkerPool.h"
+
+// Rebuilt with the elevation map so that the simulation reads the terrain
+// derivatives instead of scanning the neighbourhoods itself. All rasters
+// cover the ROI of the elevation map and are computed in one pass on the
+// 3x3 neighbourhood of each pixel (Horn), the pixels of the ROI border
+// reuse their own row or column for the missing neighbours.
+// Gradients are in elevation units per kinect pixel, slopes in degrees and
+// aspects in degrees clockwise from the top of the kinect image (180 for a
+// slope facing the bottom of the image). The curvature is the laplacian of
+// the elevation, positive in hollows and negative on crests, it is only
+// computed when enabled.
+class TerrainAnalysis {
+public:
+    TerrainAnalysis(WorkerPool& sworkerPool); // The pool runs the bands of rows of the update
+
+    void setCurvature(bool scurvature);
+    bool hasCurvature() const {
+        return curvature;
+    }
+
+    void update(const ElevationMap& elevationMap);
+
+    bool isInside(int x, int y) const { // x, y in kinect pixel coordinate
+        return static_cast<unsigned int>(x-minX) < static_cast<unsigned int>(width) && static_cast<unsigned int>(y-minY) < static_cast<unsigned int>(height);
+    }
+    ofVec2f getGradient(int x, int y) const { // x, y inside the ROI
+        int ind = (y-minY)*width+x-minX;
+        return ofVec2f(gradientX[ind], gradientY[ind]);
+    }
+    float getSlope(int x, int y) const { // x, y inside the ROI
+        return slope[(y-minY)*width+x-minX];
+    }
+    float getAspect(int x, int y) const { // x, y inside the ROI
+        return aspect[(y-minY)*width+x-minX];
+    }
+    float getCurvature(int x, int y) const { // x, y inside the ROI, 0 if the curvature is disabled
+        return curvature ? curvatureRaster[(y-minY)*width+x-minX] : 0;
+    }
+
+    // Rows of getWidth() values starting at getMinX(), getMinY()
+    const float* getGradientXData() const {
+        return gradientX.data();
+    }
+    const float* getGradientYData() const {
+        return gradientY.data();
+    }
+    const float* getSlopeData() const {
+        return slope.data();
+    }
+    const float* getAspectData() const {
+        return aspect.data();
+    }
+    const float* getCurvatureData() const { // Empty if the curvature is disabled
+        return curvatureRaster.data();
+    }
+    int getMinX() const {
+        return minX;
+    }
+    int getMinY() const {
+        return minY;
+    }
+    int getWidth() const {
+        return width;
+    }
+    int getHeight() const {
+        return height;
+    }
+
+private:
+    void analyzeRow(const float* elevation, int y);
+    void analyzePixel(const float* up, const float* mid, const float* down, int x, int left, int right, size_t ind);
+
+    static const int rowsPerTask = 16;
+
+    WorkerPool& workerPool;
+    bool curvature;
+    int minX, minY, width, height;
+    std::vector<float> gradientX, gradientY, slope, aspect, curvatureRaster;
+};
@@ -0,0 +1,118 @@
+/***********************************************************************
+WorkerPool - WorkerPool runs the tasks of a parallel loop on a small
+pool of threads and waits for their completion (fork/join).
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool()
+:task(0),
+numTasks(0),
+nextTask(0),
+completedTasks(0),
+activeWorkers(0),
+generation(0),
+stopping(false)
+{
+}
+
+WorkerPool::~WorkerPool(){
+    release();
+}
+
+void WorkerPool::setup(int numThreads){
+    release();
+    stopping = false;
+    for (int i = 0; i < numThreads; i++)
+        threads.push_back(std::thread(&WorkerPool::workerFunction, this));
+}
+
+void WorkerPool::release(){
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        stopping = true;
+    }
+    startCondition.notify_all();
+    for (auto & thread : threads)
+        thread.join();
+    threads.clear();
+}
+
+int WorkerPool::getHardwareConcurrency(){
+    int concurrency = static_cast<int>(std::thread::hardware_concurrency());
+    return concurrency > 0 ? concurrency : 1;
+}
+
+void WorkerPool::run(int snumTasks, const std::function<void(int)>& stask){
+    if (snumTasks <= 0)
+        return;
+    if (threads.empty() || snumTasks == 1){
+        for (int i = 0; i < snumTasks; i++)
+            stask(i);
+        return;
+    }
+    {
+        // Wait for the workers that woke up too late for the previous loop to leave it
+        std::unique_lock<std::mutex> lock(mutex);
+        doneCondition.wait(lock, [this]{ return activeWorkers == 0; });
+        task = &stask;
+        numTasks = snumTasks;
+        nextTask = 0;
+        completedTasks = 0;
+        ++generation;
+    }
+    startCondition.notify_all();
+
+    runTasks(stask, snumTasks);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    doneCondition.wait(lock, [this]{ return completedTasks == numTasks && activeWorkers == 0; });
+    task = 0;
+}
+
+void WorkerPool::runTasks(const std::function<void(int)>& stask, int snumTasks){
+    int done = 0;
+    for (int i = nextTask++; i < snumTasks; i = nextTask++){
+        stask(i);
+        done++;
+    }
+    if (done > 0){
+        std::lock_guard<std::mutex> guard(mutex);
+        completedTasks += done;
+    }
+    doneCondition.notify_all();
+}
+
+void WorkerPool::workerFunction(){
+    unsigned int seenGeneration = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true){
+        startCondition.wait(lock, [this, &seenGeneration]{ return stopping || (generation != seenGeneration && task != 0); });
+        if (stopping)
+            return;
+        seenGeneration = generation;
+        const std::function<void(int)>* stask = task;
+        int snumTasks = numTasks;
+        ++activeWorkers;
+        lock.unlock();
+
+        runTasks(*stask, snumTasks);
+
+        lock.lock();
+        --activeWorkers;
+        doneCondition.notify_all();
+    }
+}
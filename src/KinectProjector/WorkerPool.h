@@ -0,0 +1,65 @@
+/***********************************************************************
+WorkerPool - WorkerPool runs the tasks of a parallel loop on a small
+pool of threads and waits for their completion (fork/join).
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+***********************************************************************/
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkerPool {
+public:
+    WorkerPool();
+    ~WorkerPool();
+
+    // Start numThreads worker threads, the thread calling run() is used as an additional worker
+    void setup(int numThreads);
+    void release();
+
+    int getNumThreads() const {
+        return static_cast<int>(threads.size());
+    }
+
+    // Call task(0) ... task(numTasks-1) on the pool and return when all of them are done
+    void run(int numTasks, const std::function<void(int)>& task);
+
+    // Number of concurrent threads of the computer, at least 1
+    static int getHardwareConcurrency();
+
+private:
+    WorkerPool(const WorkerPool&);
+    WorkerPool& operator=(const WorkerPool&);
+
+    void workerFunction();
+    void runTasks(const std::function<void(int)>& stask, int snumTasks);
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable startCondition; // Signaled when a new loop is started or the pool is released
+    std::condition_variable doneCondition; // Signaled when a task or a worker is done
+
+    const std::function<void(int)>* task; // Task of the current loop
+    int numTasks;
+    std::atomic<int> nextTask; // Index of the next task to run
+    int completedTasks;
+    int activeWorkers; // Number of workers currently working on the loop
+    unsigned int generation; // Incremented at each new loop
+    bool stopping;
+};
@@ -6,15 +6,35 @@
 
 #include "Model.h"
 
-Model::Model(std::shared_ptr<KinectProjector> const& k){
+Model::Model(std::shared_ptr<KinectProjector> const& k)
+:fires(k),
+riskZoneMap(k),
+fireGrid(k)
+{
     kinectProjector = k;
     timestep = 0;
-    
+    numDraws = 0;
+    engine = ENGINE_AGENTS;
     
     // Retrieve variables
     kinectROI = kinectProjector->getKinectROI();
     resetBurnedArea();
+    fires.setBorders(kinectROI);
+    fireGrid.reset(kinectROI, 1);
+    flames.setup();
+}
+
+/**
+ * @fn	void Model::setEngine(SimulationEngine sengine)
+ *
+ * @brief	Selects the fire simulation engine, clears the current simulation.
+ *
+ * @param	sengine	The simulation engine.
+ */
 
+void Model::setEngine(SimulationEngine sengine){
+    engine = sengine;
+    clear();
 }
 
 /**
@@ -26,6 +46,8 @@ Model::Model(std::shared_ptr<KinectProjector> const& k){
  */
 
 bool Model::isRunning() {
+    if (engine == ENGINE_GRID)
+        return fireGrid.getNumBurningCells() > 0;
 	return fires.size() > 0 || embers.size() > 0;
 }
 
@@ -38,6 +60,10 @@ bool Model::isRunning() {
  */
 
 void Model::addNewFire(ofVec2f fireSpawnPos) {
+    if (engine == ENGINE_GRID){
+        fireGrid.ignite(fireSpawnPos);
+        return;
+    }
     addNewFire(fireSpawnPos, windDirection);
 }
 
@@ -54,9 +80,7 @@ void Model::addNewFire(ofVec2f fireSpawnPos, float angle){
     if (kinectProjector->elevationAtKinectCoord(fireSpawnPos.x, fireSpawnPos.y) < 0){
         return;
     }
-    auto f = Fire(kinectProjector, fireSpawnPos, kinectROI, angle);
-    f.setup();
-    fires.push_back(f);
+    fires.add(fireSpawnPos, angle);
 }
 
 /**
@@ -67,22 +91,40 @@ void Model::addNewFire(ofVec2f fireSpawnPos, float angle){
  */
 
 void Model::addNewFireInRiskZone(){
-    if (riskZones.size() == 0){
+    if (riskZoneMap.getNumRiskZones() == 0){
         calculateRiskZones();
     }
+    vector<ofVec2f> riskZones = riskZoneMap.getRiskZones();
+    if (riskZones.size() == 0){
+        return;
+    }
     ofVec2f spawnPosition;
     ofRectangle borders = kinectProjector->getKinectROI();
     borders.scaleFromCenter((borders.width-50)/borders.width, (borders.height-50)/borders.height);
     int counter = 0;
     do {
-        int index = std::rand() % riskZones.size();
-        ofVec2f spawnPosition = riskZones[index];
+        int index = rng.below(Philox::DOMAIN_MODEL, 0, timestep, numDraws++, riskZones.size());
+        spawnPosition = riskZones[index];
         counter++;
     } while (!borders.inside(spawnPosition)&& counter <= 100);
     
     addNewFire(spawnPosition);
 }
 
+/**
+ * @fn	void Model::setSeed(uint32_t sseed)
+ *
+ * @brief	Sets the seed of the random numbers. Two runs with the same seed and
+ * 			the same inputs are identical.
+ *
+ * @param	sseed	The seed.
+ */
+
+void Model::setSeed(uint32_t sseed){
+    rng.setSeed(sseed);
+    fires.setSeed(sseed);
+}
+
 /**
  * @fn	void Model::setWindSpeed(float v)
  *
@@ -115,39 +157,53 @@ void Model::setWindDirection(float d) {
  */
 
 void Model::update(){
+    PROFILE_STAGE(STAGE_MODEL_UPDATE);
+
     // kinectROI updated
     if (kinectProjector->getKinectROI() != kinectROI){
         kinectROI = kinectProjector->getKinectROI();
         resetBurnedArea();
+        fires.setBorders(kinectROI);
+        fireGrid.reset(kinectROI, 1);
+    }
+    
+    if (engine == ENGINE_GRID){
+        fireGrid.setWind(windSpeed, windDirection);
+        fireGrid.update();
+        timestep++;
+        return;
     }
     
-    //spread fires
-    int size = fires.size();
-    int i = 0;
-    while(i < size){
-        embers.push_back(fires[i]);
-        ofPoint location = fires[i].getLocation();
-        if (burnedArea[floor(location.x)][floor(location.y)] || !fires[i].isAlive()){
-            fires.erase(fires.begin() + i);
-            size--;
+    //spread fires, the new fires join after the sweep so that removals can swap the last fire in
+    vector<ofVec2f> spawnLocations;
+    vector<float> spawnAngles;
+    size_t i = 0;
+    while(i < fires.size()){
+        embers.add(fires.getProjectorCoord(i), fires.getAngle(i), fires.getIntensity(i));
+        ofVec2f location = fires.getLocation(i);
+        int x = static_cast<int>(floor(location.x));
+        int y = static_cast<int>(floor(location.y));
+        if (burnedArea.isBurned(x, y) || !fires.isAlive(i)){
+            fires.remove(i);
         } else {
-            burnedArea[floor(location.x)][floor(location.y)] = true;
-			burnedAreaCounter += 1;
-            int rand = std::rand() % 100;
+            burnedArea.burn(x, y);
+            int rand = fires.random(i, timestep, FireAgents::DRAW_SPREAD, 100);
             int spreadFactor = timestep < 10 ? 70 : 10;
-            if (fires[i].isAlive() && rand < spreadFactor){
-                int angle = fires[i].getAngle();
-                addNewFire(location, (angle + 90)%360);
-                addNewFire(location, (angle + 270)%360);
+            if (rand < spreadFactor){
+                int angle = fires.getAngle(i);
+                spawnLocations.push_back(location);
+                spawnAngles.push_back((angle + 90)%360);
+                spawnLocations.push_back(location);
+                spawnAngles.push_back((angle + 270)%360);
             }
             i++;
         }
     }
-    
-    for (auto & f : fires){
-        f.applyBehaviours(windSpeed, windDirection);
-        f.update();
+    for (size_t j = 0; j < spawnLocations.size(); j++){
+        addNewFire(spawnLocations[j], spawnAngles[j]);
     }
+    
+    fires.update(windSpeed, windDirection, timestep);
     timestep++;
 }
 
@@ -158,10 +214,16 @@ void Model::update(){
  */
 
 void Model::draw(){
-    drawEmbers();
-    for (auto & f : fires){
-        f.draw();
+    PROFILE_STAGE(STAGE_MODEL_DRAW);
+    if (engine == ENGINE_GRID){
+        fireGrid.draw();
+        return;
     }
+    // One draw call for all the flames, the embers below the fires
+    flames.clear();
+    embers.draw(flames);
+    fires.draw(flames);
+    flames.draw();
 }
 
 /**
@@ -175,86 +237,25 @@ void Model::clear(){
     fires.clear();
 	embers.clear();
     timestep = 0;
+    numDraws = 0;
     resetBurnedArea();
+    fireGrid.clear();
 }
 
 void Model::resetBurnedArea(){
-    burnedArea.clear();
-	burnedAreaCounter = 0;
-	completeArea = 0;
-    for(int x = 0; x <= kinectROI.getRight(); x++ ){
-        vector<bool> row;
-        for (int y = 0; y <= kinectROI.getBottom(); y++ ){
-            row.push_back(false);
-			completeArea += 1;
-        }
-        burnedArea.push_back(row);
-    }
+    burnedArea.reset(kinectROI);
 }
 
 /**
  * @fn	void Model::calculateRiskZones()
  *
- * @brief	Calculates the risk zones.
+ * @brief	Updates the risk zones, only the parts of the sandbox which changed
+ * 			since the last call are recomputed.
  *
  */
 
 void Model::calculateRiskZones() {
-    riskZones.clear();
-	for (int x = kinectROI.getLeft() + 1; x < kinectROI.getRight(); x++) {
-		for (int y = kinectROI.getTop() + 1; y < kinectROI.getBottom(); y++) {
-			float cell_aspect;
-			float cell_slope;
-			//assignment of the neighborhood
-			float a = kinectProjector->elevationAtKinectCoord(x - 1, y - 1);
-			float b = kinectProjector->elevationAtKinectCoord(x, y - 1);
-			float c = kinectProjector->elevationAtKinectCoord(x + 1, y - 1);
-			float d = kinectProjector->elevationAtKinectCoord(x - 1, y);
-			float e = kinectProjector->elevationAtKinectCoord(x, y);
-			float f = kinectProjector->elevationAtKinectCoord(x + 1, y);
-			float g = kinectProjector->elevationAtKinectCoord(x - 1, y + 1);
-			float h = kinectProjector->elevationAtKinectCoord(x, y + 1);
-			float i = kinectProjector->elevationAtKinectCoord(x + 1, y + 1);
-			float changeRateInXDirection = ((c + 2 * f + i) - (a + 2 * d + g)) / 8;
-			float changeRateInYDirection = ((g + 2 * h + i) - (a + 2 * b + c)) / 8;
-			//calculation of south aspects
-			float aspect = 180 / PI * atan2(changeRateInYDirection, -changeRateInXDirection);
-			if (aspect < 0) {
-				cell_aspect = 90.0 - aspect;
-			}
-			else if (aspect > 90.0) {
-				cell_aspect = 360.0 - aspect + 90.0;
-			}
-			else {
-				cell_aspect = 90.0 - aspect;
-			}
-			//calculation of slopes >= 10 degrees
-			cell_slope = atan(sqrt(pow(changeRateInXDirection, 2) + pow(changeRateInYDirection, 2))) * (180 / PI);
-
-
-			//identification of risk zones
-			if (cell_aspect >= 157.5 && cell_aspect <= 202.5 && cell_slope >= 10 && e > 0) {
-				riskZones.push_back(ofVec2f(x, y));
-			}
-		}
-	}
-}
-
-void Model::drawEmbers(){
-    int i = 0;
-    int size = embers.size();
-    while(i < size){
-        if(embers[i].isAlive()){
-            embers[i].kill();
-        }
-        embers[i].draw();
-        if(embers[i].getIntensity() <= 0){
-            embers.erase(embers.begin() + i);
-            size--;
-        } else {
-            i++;
-        }
-    }
+    riskZoneMap.update();
 }
 
 /**
@@ -265,18 +266,7 @@ void Model::drawEmbers(){
  */
 
 void Model::drawRiskZones() {
-    for (auto & r : riskZones){
-        ofPoint coord = kinectProjector->kinectCoordToProjCoord(r.x, r.y);
-        ofFill();
-        
-        ofPath riskZone;
-        riskZone.rectangle(coord.x - 2, coord.y - 2, 4, 4);
-        riskZone.setFillColor(ofColor(255, 0, 0, 200));
-        riskZone.setStrokeWidth(0);
-        riskZone.draw();
-        
-        ofNoFill();
-    }
+    riskZoneMap.draw();
 }
 
 /**
@@ -288,7 +278,7 @@ void Model::drawRiskZones() {
  */
 
 string Model::getPercentageOfBurnedArea(){
-	float percentage = (burnedAreaCounter / (completeArea/7)) * 100;
+	float percentage = engine == ENGINE_GRID ? fireGrid.getBurnedFraction() * 100 : burnedArea.getBurnedFraction() * 100;
   percentage = percentage > 100 ? 100 : percentage;
 	string percentStr = "Burned area: ";
 	percentStr += std::to_string(percentage);
@@ -301,11 +291,13 @@ string Model::getPercentageOfBurnedArea(){
  *
  * @brief	Gets number of alive agents in the model.
  *
- * @return	The number of alive agents.
+ * @return	The number of alive agents, or of burning cells with the grid engine.
  */
 
 int Model::getNumberOfAgents(){
-	return fires.size();
+    if (engine == ENGINE_GRID)
+        return fireGrid.getNumBurningCells();
+	return static_cast<int>(fires.size());
 }
 
 /**
@@ -2,15 +2,34 @@
 
 #include "ofMain.h"
 #include "KinectProjector/KinectProjector.h"
-#include "vehicle.h"
+#include "FireAgents.h"
+#include "FireGrid.h"
+#include "BurnedAreaMap.h"
+#include "RiskZoneMap.h"
 
 
 class Model{
 public:
+    enum SimulationEngine
+    {
+        ENGINE_AGENTS, // Fire vehicles
+        ENGINE_GRID // Cellular automaton over the ROI
+    };
+
     Model(std::shared_ptr<KinectProjector> const& k);
 
+    void setEngine(SimulationEngine sengine);
+    SimulationEngine getEngine(){
+        return engine;
+    }
+
 	bool isRunning();
 
+    void setSeed(uint32_t sseed);
+    uint32_t getSeed() const {
+        return rng.getSeed();
+    }
+
     void setWindSpeed(float v);
     void setWindDirection(float d);
 
@@ -33,19 +52,22 @@ private:
     std::shared_ptr<KinectProjector> kinectProjector;
     ofRectangle kinectROI;
     
-    vector<Fire> fires;
-    vector<Fire> embers;
-	vector<ofVec2f> riskZones;
-    vector< vector<bool> > burnedArea;
+    FireAgents fires;
+    FireEmbers embers;
+    FlameRenderer flames;
+    RiskZoneMap riskZoneMap;
+    BurnedAreaMap burnedArea;
+    
+    SimulationEngine engine;
+    FireGrid fireGrid;
     
     float windSpeed;
     float windDirection;
     
     int timestep;
-
-	int burnedAreaCounter;
-	float completeArea;
+    
+    Philox rng; // Draws of the model, the agents draw from their own streams
+    uint32_t numDraws; // Draws of the model since the last clear
 
 	void resetBurnedArea();
-    void drawEmbers();
 };
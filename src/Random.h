@@ -0,0 +1,86 @@
+/***********************************************************************
+Random.h - random number streams of the simulation
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#pragma once
+#include <stdint.h>
+
+// Philox4x32-10 counter-based generator (Salmon et al., "Parallel random
+// numbers: as easy as 1, 2, 3", SC11). A number is a pure function of the
+// seed, a stream, a step and a draw index: there is no state to carry, so
+// agents can be updated in any order or on any thread and a run is replayed
+// exactly from its seed.
+class Philox {
+public:
+    enum Domain
+    {
+        DOMAIN_AGENTS, // Streams are the agent ids
+        DOMAIN_MODEL // Draws of the model itself
+    };
+
+    Philox()
+    :seed(0)
+    {
+    }
+
+    void setSeed(uint32_t sseed){
+        seed = sseed;
+    }
+    uint32_t getSeed() const {
+        return seed;
+    }
+
+    uint32_t get(Domain domain, uint32_t stream, uint32_t step, uint32_t draw) const {
+        uint32_t counter[4] = {step, draw >> 2, static_cast<uint32_t>(domain), 0};
+        uint32_t key[2] = {stream, seed};
+        generate(counter, key);
+        return counter[draw & 3];
+    }
+    float uniform(Domain domain, uint32_t stream, uint32_t step, uint32_t draw) const { // In [0, 1[
+        return (get(domain, stream, step, draw) >> 8)*(1.0f/16777216.0f);
+    }
+    float uniform(Domain domain, uint32_t stream, uint32_t step, uint32_t draw, float min, float max) const {
+        return min+(max-min)*uniform(domain, stream, step, draw);
+    }
+    uint32_t below(Domain domain, uint32_t stream, uint32_t step, uint32_t draw, uint32_t bound) const { // In [0, bound[
+        return static_cast<uint32_t>((static_cast<uint64_t>(get(domain, stream, step, draw))*bound) >> 32);
+    }
+
+    // Encrypt the counter in place with the key
+    static void generate(uint32_t counter[4], uint32_t key[2]){
+        for (int round = 0; round < 10; round++){
+            if (round > 0){
+                key[0] += 0x9E3779B9;
+                key[1] += 0xBB67AE85;
+            }
+            uint64_t product0 = static_cast<uint64_t>(0xD2511F53)*counter[0];
+            uint64_t product1 = static_cast<uint64_t>(0xCD9E8D57)*counter[2];
+            uint32_t c1 = counter[1];
+            uint32_t c3 = counter[3];
+            counter[0] = static_cast<uint32_t>(product1 >> 32)^c1^key[0];
+            counter[1] = static_cast<uint32_t>(product1);
+            counter[2] = static_cast<uint32_t>(product0 >> 32)^c3^key[1];
+            counter[3] = static_cast<uint32_t>(product0);
+        }
+    }
+
+private:
+    uint32_t seed;
+};
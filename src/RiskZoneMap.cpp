@@ -0,0 +1,220 @@
+/***********************************************************************
+RiskZoneMap.cpp - fire risk zones of the sandbox, updated incrementally
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "RiskZoneMap.h"
+
+RiskZoneMap::RiskZoneMap(std::shared_ptr<KinectProjector> const& k)
+:kinectProjector(k),
+minX(0),
+minY(0),
+width(0),
+height(0),
+tileCols(0),
+tileRows(0),
+frameSequence(0),
+basePlaneEq(0),
+numRiskZones(0),
+numUpdatedTiles(0),
+allDirty(true),
+textureUpdated(false),
+meshStep(8)
+{
+}
+
+void RiskZoneMap::invalidate(){
+    allDirty = true;
+}
+
+/**
+ * @fn	void RiskZoneMap::update()
+ *
+ * @brief	Recomputes the tiles whose depths changed since the last update,
+ * 			and their neighbours.
+ *
+ */
+
+void RiskZoneMap::update(){
+    const ElevationMap& elevationMap = kinectProjector->getElevationMap();
+    if (elevationMap.getMinX() != minX || elevationMap.getMinY() != minY || elevationMap.getWidth() != width || elevationMap.getHeight() != height)
+        reset(elevationMap.getMinX(), elevationMap.getMinY(), elevationMap.getWidth(), elevationMap.getHeight());
+    if (elevationMap.getBasePlaneEq() != basePlaneEq){ // All the elevations moved
+        basePlaneEq = elevationMap.getBasePlaneEq();
+        allDirty = true;
+    }
+    if (!allDirty && kinectProjector->getFrameSequence() == frameSequence){ // No new frame
+        numUpdatedTiles = 0;
+        return;
+    }
+    const float* elevation = elevationMap.getElevationData();
+    const TerrainAnalysis& terrainAnalysis = kinectProjector->getTerrainAnalysis();
+
+    // The gradient of a border pixel reads the neighbour tile and the spatial filter spreads
+    // a change by a few pixels: dilate the changed tiles by one
+    std::fill(dirty.begin(), dirty.end(), 0);
+    for (int ty = 0; ty < tileRows; ty++){
+        for (int tx = 0; tx < tileCols; tx++){
+            if (!allDirty && !hasTileChanged(tx, ty))
+                continue;
+            for (int ny = std::max(ty-1, 0); ny <= std::min(ty+1, tileRows-1); ny++)
+                for (int nx = std::max(tx-1, 0); nx <= std::min(tx+1, tileCols-1); nx++)
+                    dirty[ny*tileCols+nx] = 1;
+        }
+    }
+    allDirty = false;
+    frameSequence = kinectProjector->getFrameSequence();
+
+    numUpdatedTiles = 0;
+    for (int ty = 0; ty < tileRows; ty++){
+        for (int tx = 0; tx < tileCols; tx++){
+            if (dirty[ty*tileCols+tx]){
+                computeTile(elevation, terrainAnalysis, tx, ty);
+                numUpdatedTiles++;
+            }
+        }
+    }
+    if (numUpdatedTiles > 0){
+        numRiskZones = 0;
+        for (auto count : tileCounts)
+            numRiskZones += count;
+        textureUpdated = true;
+    }
+}
+
+void RiskZoneMap::reset(int sminX, int sminY, int swidth, int sheight){
+    minX = sminX;
+    minY = sminY;
+    width = swidth;
+    height = sheight;
+    tileCols = (width+tileSize-1)/tileSize;
+    tileRows = (height+tileSize-1)/tileSize;
+    size_t size = static_cast<size_t>(width)*height;
+    mask.assign(size, 0);
+    tileCounts.assign(tileCols*tileRows, 0);
+    dirty.assign(tileCols*tileRows, 0);
+    numRiskZones = 0;
+    allDirty = true;
+
+    if (size == 0)
+        return;
+    colors.allocate(width, height, OF_IMAGE_COLOR_ALPHA);
+    colors.set(0);
+    texture.allocate(width, height, GL_RGBA);
+    texture.setTextureMinMagFilter(GL_NEAREST, GL_NEAREST);
+
+    mesh.setup(ofVec2f(minX, minY), width, height, 1, meshStep, texture);
+}
+
+bool RiskZoneMap::hasTileChanged(int tx, int ty) const{
+    int x0 = tx*tileSize;
+    int y0 = ty*tileSize;
+    return kinectProjector->hasAreaChanged(minX+x0, minY+y0, minX+std::min(x0+tileSize, width), minY+std::min(y0+tileSize, height), frameSequence);
+}
+
+/**
+ * @fn	void RiskZoneMap::computeTile(const float* elevation, const TerrainAnalysis& terrainAnalysis, int tx, int ty)
+ *
+ * @brief	Computes the risk mask of a tile.
+ *
+ * @param	elevation	   	The elevations of the ROI.
+ * @param	terrainAnalysis	The slopes and aspects of the ROI.
+ * @param	tx			   	The tile column.
+ * @param	ty			   	The tile row.
+ */
+
+void RiskZoneMap::computeTile(const float* elevation, const TerrainAnalysis& terrainAnalysis, int tx, int ty){
+    int x0 = tx*tileSize;
+    int x1 = std::min(x0+tileSize, width);
+    int y0 = ty*tileSize;
+    int y1 = std::min(y0+tileSize, height);
+    const float* slope = terrainAnalysis.getSlopeData();
+    const float* aspect = terrainAnalysis.getAspectData();
+    int count = 0;
+    for (int y = y0; y < y1; y++){
+        size_t row = static_cast<size_t>(y)*width;
+        unsigned char* maskRow = mask.data()+row;
+        std::fill(maskRow+x0, maskRow+x1, 0);
+        // The pixels on the ROI border have no complete neighbourhood
+        if (y == 0 || y == height-1)
+            continue;
+        int xEnd = std::min(x1, width-1);
+        for (int x = std::max(x0, 1); x < xEnd; x++){
+            // South facing slopes of 10 degrees or more above the water
+            bool risk = elevation[row+x] > 0 && slope[row+x] >= 10 && aspect[row+x] >= 157.5f && aspect[row+x] <= 202.5f;
+            maskRow[x] = risk;
+            count += risk;
+        }
+    }
+    tileCounts[ty*tileCols+tx] = count;
+
+    // Same color as the former risk zone squares
+    for (int y = y0; y < y1; y++){
+        const unsigned char* maskRow = mask.data()+static_cast<size_t>(y)*width;
+        unsigned char* pixels = colors.getData()+(static_cast<size_t>(y)*width+x0)*4;
+        for (int x = x0; x < x1; x++, pixels += 4){
+            pixels[0] = 255;
+            pixels[1] = 0;
+            pixels[2] = 0;
+            pixels[3] = maskRow[x] ? 200 : 0;
+        }
+    }
+}
+
+/**
+ * @fn	vector<ofVec2f> RiskZoneMap::getRiskZones() const
+ *
+ * @brief	Lists the risk pixels.
+ *
+ * @return	The kinect coordinates of the risk pixels.
+ */
+
+vector<ofVec2f> RiskZoneMap::getRiskZones() const{
+    vector<ofVec2f> riskZones;
+    riskZones.reserve(numRiskZones);
+    for (int ty = 0; ty < tileRows; ty++){
+        for (int tx = 0; tx < tileCols; tx++){
+            if (tileCounts[ty*tileCols+tx] == 0)
+                continue;
+            for (int y = ty*tileSize; y < std::min((ty+1)*tileSize, height); y++)
+                for (int x = tx*tileSize; x < std::min((tx+1)*tileSize, width); x++)
+                    if (mask[static_cast<size_t>(y)*width+x])
+                        riskZones.push_back(ofVec2f(x+minX, y+minY));
+        }
+    }
+    return riskZones;
+}
+
+/**
+ * @fn	void RiskZoneMap::draw()
+ *
+ * @brief	Draws the risk mask as one texture following the sand surface.
+ *
+ */
+
+void RiskZoneMap::draw(){
+    if (width*height == 0)
+        return;
+    if (textureUpdated){
+        texture.loadData(colors);
+        textureUpdated = false;
+    }
+    ofSetColor(255);
+    mesh.draw(*kinectProjector, texture);
+}
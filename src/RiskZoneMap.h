@@ -0,0 +1,83 @@
+/***********************************************************************
+RiskZoneMap.h - fire risk zones of the sandbox, updated incrementally
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#pragma once
+#include "ofMain.h"
+
+#include "KinectProjector/KinectProjector.h"
+#include "SurfaceMesh.h"
+
+// Risk zones are the pixels of the ROI above the water level on a south
+// facing slope of 10 degrees or more, read from the terrain analysis.
+// The ROI is split in tiles: a tile is recomputed, with its neighbours which
+// share its border pixels, only when the grabber reports a change of the
+// stable depths under it since the last update, or when the base plane
+// changed. The result is a mask of the ROI, drawn as one texture.
+class RiskZoneMap {
+public:
+    RiskZoneMap(std::shared_ptr<KinectProjector> const& k);
+
+    void update(); // Recompute the tiles where the sand changed
+    void invalidate(); // Recompute all the tiles at the next update
+    void draw(); // In projector coordinates
+
+    bool isRiskZone(int x, int y) const { // x, y in kinect pixel coordinate
+        int bx = x-minX;
+        int by = y-minY;
+        if (static_cast<unsigned int>(bx) >= static_cast<unsigned int>(width) || static_cast<unsigned int>(by) >= static_cast<unsigned int>(height))
+            return false;
+        return mask[by*width+bx] != 0;
+    }
+    int getNumRiskZones() const {
+        return numRiskZones;
+    }
+    vector<ofVec2f> getRiskZones() const; // Kinect coordinates of the risk pixels
+    int getNumUpdatedTiles() const { // Tiles recomputed by the last update
+        return numUpdatedTiles;
+    }
+
+private:
+    void reset(int sminX, int sminY, int swidth, int sheight);
+    bool hasTileChanged(int tx, int ty) const;
+    void computeTile(const float* elevation, const TerrainAnalysis& terrainAnalysis, int tx, int ty);
+
+    static const int tileSize = 32;
+
+    std::shared_ptr<KinectProjector> kinectProjector;
+    int minX, minY, width, height; // ROI of the elevation map
+    int tileCols, tileRows;
+    unsigned long long frameSequence; // Frame of the last update
+    ofVec4f basePlaneEq; // Base plane of the elevations of the last update
+
+    vector<unsigned char> mask; // 1 for risk zones
+    vector<int> tileCounts; // Risk pixels per tile
+    vector<unsigned char> dirty; // Tiles to recompute
+    int numRiskZones;
+    int numUpdatedTiles;
+    bool allDirty;
+
+    // Drawing
+    ofPixels colors;
+    ofTexture texture;
+    bool textureUpdated;
+    SurfaceMesh mesh;
+    int meshStep; // Pixels between two mesh vertices
+};
@@ -163,12 +163,12 @@ void SandSurfaceRenderer::updateRangesAndBasePlane(){
     basePlaneNormal = kinectProjector->getBasePlaneNormal();
     basePlaneOffset = kinectProjector->getBasePlaneOffset();
 
-    // Set the FilteredDepthImage native scale - converted to 0..1 when send to the shader
+    // Set the FilteredDepthImage native scale - used by the kinect view
     kinectProjector->updateNativeScale(basePlaneOffset.z+elevationMax, basePlaneOffset.z+elevationMin);
     
-    // Calculate the  FilteredDepthImage scaling and offset coefficients
-	FilteredDepthScale = elevationMin-elevationMax;
-	FilteredDepthOffset = basePlaneOffset.z+elevationMax;
+    // The depth texture holds the filtered depths in mm, no conversion in the shaders
+	FilteredDepthScale = 1;
+	FilteredDepthOffset = 0;
     
     ofLogVerbose("SandSurfaceRenderer") << "setRangesAndBasePlaneEquation(): basePlaneOffset: " << basePlaneOffset ;
     ofLogVerbose("SandSurfaceRenderer") << "setRangesAndBasePlaneEquation(): basePlaneNormal: " << basePlaneNormal ;
@@ -245,6 +245,7 @@ void SandSurfaceRenderer::drawProjectorWindow(){
 }
 
 void SandSurfaceRenderer::drawSandbox() {
+    PROFILE_STAGE(STAGE_DRAW_SANDBOX);
     fboProjWindow.begin();
     ofBackground(0);
     kinectProjector->bind();
@@ -266,6 +267,7 @@ void SandSurfaceRenderer::drawSandbox() {
 
 void SandSurfaceRenderer::prepareContourLinesFbo()
 {
+    PROFILE_STAGE(STAGE_CONTOUR_LINES);
     contourLineFramebufferObject.begin();
     ofClear(255,255,255, 0);
     kinectProjector->bind();
@@ -0,0 +1,132 @@
+/***********************************************************************
+SimulationLog.cpp - inputs of a simulation run, for exact replays
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "SimulationLog.h"
+#include <fstream>
+
+SimulationLog::SimulationLog()
+:nextEvent(0)
+{
+}
+
+void SimulationLog::clear(){
+    events.clear();
+    nextEvent = 0;
+}
+
+/**
+ * @fn	void SimulationLog::record(unsigned long long frame, EventType type, double x, double y)
+ *
+ * @brief	Appends an event to the log.
+ *
+ * @param	frame	The number of the current kinect frame.
+ * @param	type 	The event type.
+ * @param	x	 	The first value of the event.
+ * @param	y	 	The second value of the event.
+ */
+
+void SimulationLog::record(unsigned long long frame, EventType type, double x, double y){
+    Event event = {frame, type, x, y};
+    events.push_back(event);
+}
+
+/**
+ * @fn	bool SimulationLog::save(const string& path) const
+ *
+ * @brief	Writes the log to a file.
+ *
+ * @param	path	The file path.
+ *
+ * @return	True if the file was written.
+ */
+
+bool SimulationLog::save(const string& path) const{
+    ofFilePath::createEnclosingDirectory(path, false);
+    std::ofstream file(path.c_str());
+    if (!file)
+        return false;
+    file.precision(17); // Doubles are written back exactly
+    for (auto & event : events)
+        file << event.frame << " " << getEventName(event.type) << " " << event.x << " " << event.y << "\n";
+    return static_cast<bool>(file);
+}
+
+/**
+ * @fn	bool SimulationLog::load(const string& path)
+ *
+ * @brief	Reads a log written by save(), the replay starts at its first event.
+ *
+ * @param	path	The file path.
+ *
+ * @return	True if the file could be read.
+ */
+
+bool SimulationLog::load(const string& path){
+    clear();
+    std::ifstream file(path.c_str());
+    if (!file)
+        return false;
+    Event event;
+    string name;
+    while (file >> event.frame >> name >> event.x >> event.y){
+        int type = 0;
+        while (type < NUM_EVENT_TYPES && name != getEventName(static_cast<EventType>(type)))
+            type++;
+        if (type == NUM_EVENT_TYPES){
+            ofLogWarning("SimulationLog") << "load(): Unknown event " << name << " in " << path;
+            continue;
+        }
+        event.type = static_cast<EventType>(type);
+        events.push_back(event);
+    }
+    return true;
+}
+
+/**
+ * @fn	bool SimulationLog::next(unsigned long long frame, Event& event)
+ *
+ * @brief	Gets the next event to replay if it was recorded at or before a frame.
+ *
+ * @param	frame	The number of the current kinect frame.
+ * @param	event	The event.
+ *
+ * @return	False if all the events up to the frame were replayed.
+ */
+
+bool SimulationLog::next(unsigned long long frame, Event& event){
+    if (nextEvent >= events.size() || events[nextEvent].frame > frame)
+        return false;
+    event = events[nextEvent++];
+    return true;
+}
+
+const char* SimulationLog::getEventName(EventType type){
+    switch (type){
+        case EVENT_SEED: return "seed";
+        case EVENT_ENGINE: return "engine";
+        case EVENT_WIND_SPEED: return "windSpeed";
+        case EVENT_WIND_DIRECTION: return "windDirection";
+        case EVENT_FIRE: return "fire";
+        case EVENT_CLEAR: return "clear";
+        case EVENT_STEP: return "step";
+        default: return "unknown";
+    }
+}
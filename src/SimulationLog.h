@@ -0,0 +1,70 @@
+/***********************************************************************
+SimulationLog.h - inputs of a simulation run, for exact replays
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#pragma once
+#include "ofMain.h"
+
+// The inputs given to the model during a run, each with the number of the
+// kinect frame which was current at that time. Recorded along a depth
+// recording and applied again at the same frames while the recording is
+// replayed in lockstep, they reproduce the run exactly: the model draws
+// its random numbers from the recorded seed and steps on the same frames.
+//
+// File layout: one event per line, "frame type x y".
+class SimulationLog {
+public:
+    enum EventType
+    {
+        EVENT_SEED, // x: seed
+        EVENT_ENGINE, // x: Model::SimulationEngine
+        EVENT_WIND_SPEED, // x: speed
+        EVENT_WIND_DIRECTION, // x: direction
+        EVENT_FIRE, // x, y: kinect coordinates
+        EVENT_CLEAR,
+        EVENT_STEP, // One model update
+        NUM_EVENT_TYPES
+    };
+
+    struct Event {
+        unsigned long long frame;
+        EventType type;
+        double x, y;
+    };
+
+    SimulationLog();
+
+    void clear();
+    void record(unsigned long long frame, EventType type, double x = 0, double y = 0);
+    bool save(const string& path) const;
+    bool load(const string& path);
+
+    bool next(unsigned long long frame, Event& event); // Get the next event recorded up to a frame, return false if there is none
+
+    size_t size() const {
+        return events.size();
+    }
+
+    static const char* getEventName(EventType type);
+
+private:
+    vector<Event> events;
+    size_t nextEvent; // Next event to replay
+};
@@ -0,0 +1,88 @@
+/***********************************************************************
+SurfaceMesh.cpp - textured grid following the sand surface
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "SurfaceMesh.h"
+
+/**
+ * @fn	void SurfaceMesh::setup(const ofVec2f& origin, int cols, int rows, int cellSize, int step, const ofTexture& texture)
+ *
+ * @brief	Builds the triangles and the texture coordinates of the grid.
+ *
+ * @param	origin  	The kinect point of the top left corner.
+ * @param	cols		The number of cells in a row.
+ * @param	rows		The number of cells in a column.
+ * @param	cellSize	Kinect pixels per cell side.
+ * @param	step		Cells between two vertices.
+ * @param	texture 	The texture, one texel per cell.
+ */
+
+void SurfaceMesh::setup(const ofVec2f& origin, int cols, int rows, int cellSize, int step, const ofTexture& texture){
+    step = std::max(step, 1);
+    int meshCols = (cols+step-1)/step+1;
+    int meshRows = (rows+step-1)/step+1;
+    mesh.clear();
+    mesh.setMode(OF_PRIMITIVE_TRIANGLES);
+    kinectPoints.resize(meshCols*meshRows);
+    projectedPoints.resize(kinectPoints.size());
+    for (int j = 0; j < meshRows; j++){
+        for (int i = 0; i < meshCols; i++){
+            int cx = std::min(i*step, cols);
+            int cy = std::min(j*step, rows);
+            kinectPoints[j*meshCols+i] = ofVec2f(origin.x+cx*cellSize, origin.y+cy*cellSize);
+            mesh.addVertex(ofVec3f(0));
+            mesh.addTexCoord(texture.getCoordFromPoint(cx, cy));
+        }
+    }
+    for (int j = 0; j+1 < meshRows; j++){
+        for (int i = 0; i+1 < meshCols; i++){
+            unsigned int ind = j*meshCols+i;
+            mesh.addIndex(ind);
+            mesh.addIndex(ind+1);
+            mesh.addIndex(ind+meshCols);
+            mesh.addIndex(ind+1);
+            mesh.addIndex(ind+meshCols+1);
+            mesh.addIndex(ind+meshCols);
+        }
+    }
+}
+
+/**
+ * @fn	void SurfaceMesh::draw(KinectProjector& kinectProjector, ofTexture& texture)
+ *
+ * @brief	Projects the vertices on the current sand surface and draws the
+ * 			texture on the grid.
+ *
+ * @param	kinectProjector	The kinect projector.
+ * @param	texture		   	The texture given to setup().
+ */
+
+void SurfaceMesh::draw(KinectProjector& kinectProjector, ofTexture& texture){
+    if (kinectPoints.empty())
+        return;
+    kinectProjector.kinectCoordsToProjCoords(kinectPoints.data(), projectedPoints.data(), kinectPoints.size());
+    vector<ofVec3f>& vertices = mesh.getVertices();
+    for (size_t v = 0; v < projectedPoints.size(); v++){
+        vertices[v] = ofVec3f(projectedPoints[v].x, projectedPoints[v].y, 0);
+    }
+    texture.bind();
+    mesh.draw();
+    texture.unbind();
+}
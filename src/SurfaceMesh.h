@@ -0,0 +1,41 @@
+/***********************************************************************
+SurfaceMesh.h - textured grid following the sand surface
+Copyright (c) 2016 Thomas Wolf
+
+This file is part of the Magic Sand.
+
+The Magic Sand is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Magic Sand is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#pragma once
+#include "ofMain.h"
+
+#include "KinectProjector/KinectProjector.h"
+
+// Triangles over a rectangle of kinect pixels split in cells, the texture has
+// one texel per cell. There is a vertex every few cells, the vertices are the
+// projections of their kinect points, recomputed at each draw so that the
+// texture follows the sand surface.
+class SurfaceMesh {
+public:
+    // Cells of cellSize kinect pixels from the kinect point origin, a vertex every step cells
+    void setup(const ofVec2f& origin, int cols, int rows, int cellSize, int step, const ofTexture& texture);
+    void draw(KinectProjector& kinectProjector, ofTexture& texture); // In projector coordinates
+
+private:
+    ofMesh mesh;
+    vector<ofVec2f> kinectPoints; // Kinect points of the vertices
+    vector<ofVec2f> projectedPoints;
+};
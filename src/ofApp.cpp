@@ -73,13 +73,70 @@ void ofApp::setup() {
 	firePos.set(kinectROI.width / 2, kinectROI.height / 2);
     windSpeed = 5;
     windDirection = 180;
+    seed = 0;
+    if (loadSettings())
+        ofLogVerbose("ofApp") << "setup(): Settings loaded";
 
 	model->setWindSpeed(windSpeed);
 	model->setWindDirection(windDirection);
+	model->setSeed(seed);
+
+	// Record the simulation inputs along a depth recording, or replay them with it
+	const CaptureSettings& captureSettings = kinectProjector->getCaptureSettings();
+	simulationLogPath = ofToDataPath(captureSettings.file + ".simlog");
+	recordingSimulation = captureSettings.mode == CaptureSettings::MODE_RECORD;
+	replayingSimulation = false;
+	if (recordingSimulation) {
+		recordEvent(SimulationLog::EVENT_SEED, seed);
+		recordEvent(SimulationLog::EVENT_ENGINE, model->getEngine());
+		recordEvent(SimulationLog::EVENT_WIND_SPEED, windSpeed);
+		recordEvent(SimulationLog::EVENT_WIND_DIRECTION, windDirection);
+	} else if (captureSettings.mode == CaptureSettings::MODE_REPLAY && captureSettings.lockstep) {
+		replayingSimulation = simulationLog.load(simulationLogPath);
+		if (replayingSimulation)
+			ofLogVerbose("ofApp") << "setup(): Replaying " << simulationLog.size() << " simulation events from " << simulationLogPath;
+	}
 
 	setupGui();
 }
 
+/**
+ * @fn	void ofApp::exit()
+ *
+ * @brief	Saves the settings and the recorded simulation inputs.
+ *
+ */
+
+void ofApp::exit() {
+	if (saveSettings())
+		ofLogVerbose("ofApp") << "exit(): Settings saved";
+	if (recordingSimulation) {
+		if (simulationLog.save(simulationLogPath))
+			ofLogVerbose("ofApp") << "exit(): Simulation events saved to " << simulationLogPath;
+		else
+			ofLogError("ofApp") << "exit(): Cannot save the simulation events to " << simulationLogPath;
+	}
+}
+
+bool ofApp::loadSettings() {
+	ofXml xml;
+	if (!xml.load("settings/simulationSettings.xml"))
+		return false;
+	xml.setTo("SIMULATIONSETTINGS");
+	if (xml.exists("seed"))
+		seed = static_cast<uint32_t>(xml.getValue<unsigned int>("seed"));
+	return true;
+}
+
+bool ofApp::saveSettings() {
+	ofXml xml;
+	xml.addChild("SIMULATIONSETTINGS");
+	xml.setTo("SIMULATIONSETTINGS");
+	xml.addValue("seed", static_cast<unsigned int>(seed));
+	xml.setToParent();
+	return xml.save("settings/simulationSettings.xml");
+}
+
 /**
  * @fn	void ofApp::update()
  *
@@ -103,11 +160,20 @@ void ofApp::update() {
         runstate = false;
     }
 
+	// In replay the recorded inputs drive the model, whether the image is stabilized or not
+	if (replayingSimulation && kinectProjector->isFrameNew())
+		replaySimulation(kinectProjector->getFrameSequence());
+
+	// Keep the risk zones live while the sand is reshaped
+	if (gui->getToggle("Calculate Risk Zones")->getChecked() && kinectProjector->isFrameNew())
+		drawRiskZones();
+
 	if (kinectProjector->isImageStabilized()) {
 		drawWindArrow();
 
-        if(runstate){
+        if(runstate && !replayingSimulation){
 			model->update();
+			recordEvent(SimulationLog::EVENT_STEP);
 			drawVehicles();
 			setStatistics();
 		}
@@ -211,6 +277,70 @@ void ofApp::setStatistics() {
 	gui2->getLabel("Timestep: Model not running")->setLabel(time);
 }
 
+/**
+ * @fn	void ofApp::recordEvent(SimulationLog::EventType type, double x, double y)
+ *
+ * @brief	Logs a simulation input with the current kinect frame while recording.
+ *
+ * @param	type	The event type.
+ * @param	x   	The first value of the event.
+ * @param	y   	The second value of the event.
+ */
+
+void ofApp::recordEvent(SimulationLog::EventType type, double x, double y) {
+	if (recordingSimulation)
+		simulationLog.record(kinectProjector->getFrameSequence(), type, x, y);
+}
+
+/**
+ * @fn	void ofApp::replaySimulation(unsigned long long frame)
+ *
+ * @brief	Applies the simulation inputs recorded up to a kinect frame.
+ *
+ * @param	frame	The number of the current kinect frame.
+ */
+
+void ofApp::replaySimulation(unsigned long long frame) {
+	SimulationLog::Event event;
+	bool stepped = false;
+	while (simulationLog.next(frame, event)) {
+		switch (event.type) {
+			case SimulationLog::EVENT_SEED:
+				seed = static_cast<uint32_t>(event.x);
+				model->setSeed(seed);
+				break;
+			case SimulationLog::EVENT_ENGINE:
+				model->setEngine(static_cast<Model::SimulationEngine>(static_cast<int>(event.x)));
+				gui->getDropdown("Simulation engine")->select(model->getEngine());
+				break;
+			case SimulationLog::EVENT_WIND_SPEED:
+				windSpeed = event.x;
+				model->setWindSpeed(windSpeed);
+				break;
+			case SimulationLog::EVENT_WIND_DIRECTION:
+				windDirection = event.x;
+				model->setWindDirection(windDirection);
+				break;
+			case SimulationLog::EVENT_FIRE:
+				model->addNewFire(ofVec2f(event.x, event.y));
+				break;
+			case SimulationLog::EVENT_CLEAR:
+				model->clear();
+				break;
+			case SimulationLog::EVENT_STEP:
+				model->update();
+				stepped = true;
+				break;
+			default:
+				break;
+		}
+	}
+	if (stepped) {
+		drawVehicles();
+		setStatistics();
+	}
+}
+
 void ofApp::keyPressed(int key) {
 
 }
@@ -273,6 +403,9 @@ void ofApp::setupGui(){
 	windSpeedSlider->bind(windSpeed);
 	ofxDatGuiSlider* windDirectionSlider = gui->addSlider("Wind direction", 0, 360, windDirection);
 	windDirectionSlider->bind(windDirection);
+	gui->addDropdown("Simulation engine", {"Fire agents", "Cellular automaton"})->setName("Simulation engine");
+	gui->getDropdown("Simulation engine")->select(model->getEngine());
+	gui->addTextInput("Seed", ofToString(seed));
 	gui->addButton("Start fire");
 	gui->addButton("Reset");
 	gui->addHeader(":: Fire simulation ::", false);
@@ -282,6 +415,8 @@ void ofApp::setupGui(){
 	gui->on2dPadEvent(this, &ofApp::on2dPadEvent);
 	gui->onSliderEvent(this, &ofApp::onSliderEvent);
 	gui->onToggleEvent(this, &ofApp::onToggleEvent);
+	gui->onDropdownEvent(this, &ofApp::onDropdownEvent);
+	gui->onTextInputEvent(this, &ofApp::onTextInputEvent);
     gui->setLabelAlignment(ofxDatGuiAlignment::CENTER);
     gui->setPosition(ofxDatGuiAnchor::TOP_RIGHT);
 	// Fire statistics GUI
@@ -309,6 +444,7 @@ void ofApp::onButtonEvent(ofxDatGuiButtonEvent e) {
 
 			// Start fire
 			model->addNewFire(firePos);
+			recordEvent(SimulationLog::EVENT_FIRE, firePos.x, firePos.y);
 			gui->getButton("Start fire")->setLabel("Pause");
 
 			//Toggle Calc Risk Zones
@@ -330,28 +466,38 @@ void ofApp::onButtonEvent(ofxDatGuiButtonEvent e) {
 
 	if (e.target->is("Reset")) {
 		model->clear();
-		fboVehicles.begin();
-		ofClear(0, 0, 0, 0);
-		fboVehicles.end();
-		gui->getButton("Start fire")->setLabel("Start fire");
-		gui->get2dPad("Fire position")->reset();
-		gui2->getLabel("Timestep: Model not running")->setLabel("Timestep: Model not running");
-		gui2->getLabel("Burned area:")->setLabel("Burned area:");
-		firePos.set(kinectROI.width / 2, kinectROI.height / 2);
-		gui2->getValuePlotter("Fire intensity")->setValue(0);
-		runstate = false;
-		
+		recordEvent(SimulationLog::EVENT_CLEAR);
+		resetInterface();
+	}
+}
+
+void ofApp::resetInterface() {
+	fboVehicles.begin();
+	ofClear(0, 0, 0, 0);
+	fboVehicles.end();
+	gui->getButton("Start fire")->setLabel("Start fire");
+	gui->get2dPad("Fire position")->reset();
+	gui2->getLabel("Timestep: Model not running")->setLabel("Timestep: Model not running");
+	gui2->getLabel("Burned area:")->setLabel("Burned area:");
+	firePos.set(kinectROI.width / 2, kinectROI.height / 2);
+	gui2->getValuePlotter("Fire intensity")->setValue(0);
+	runstate = false;
+}
+
+void ofApp::onDropdownEvent(ofxDatGuiDropdownEvent e) {
+	if (e.target->is("Simulation engine")) {
+		model->setEngine(e.child == 1 ? Model::ENGINE_GRID : Model::ENGINE_AGENTS);
+		recordEvent(SimulationLog::EVENT_ENGINE, model->getEngine());
+		// Burning cells are far more numerous than fire agents
+		gui2->getValuePlotter("Fire intensity")->setRange(0, model->getEngine() == Model::ENGINE_GRID ? 5000 : 150);
+		resetInterface();
 	}
 }
 
 void ofApp::onToggleEvent(ofxDatGuiToggleEvent e) {
 	if (e.target->is("Calculate Risk Zones")) {
 		if (e.checked) {
-			model->calculateRiskZones();
-			fboRiskZone.begin();
-			ofClear(0, 0, 0, 0);
-			model->drawRiskZones();
-			fboRiskZone.end();
+			drawRiskZones();
 		} else {
 			fboRiskZone.begin();
 			ofClear(0, 0, 0, 0);
@@ -360,6 +506,21 @@ void ofApp::onToggleEvent(ofxDatGuiToggleEvent e) {
 	}
 }
 
+/**
+ * @fn	void ofApp::drawRiskZones()
+ *
+ * @brief	Updates the risk zones where the sand changed and redraws them.
+ *
+ */
+
+void ofApp::drawRiskZones() {
+	model->calculateRiskZones();
+	fboRiskZone.begin();
+	ofClear(0, 0, 0, 0);
+	model->drawRiskZones();
+	fboRiskZone.end();
+}
+
 void ofApp::on2dPadEvent(ofxDatGui2dPadEvent e) {
 	if (e.target->is("Fire position")) {
 		firePos.set(e.x, e.y);
@@ -372,9 +533,20 @@ void ofApp::on2dPadEvent(ofxDatGui2dPadEvent e) {
 void ofApp::onSliderEvent(ofxDatGuiSliderEvent e) {
 	if (e.target->is("Wind speed")) {
 		model->setWindSpeed(e.value);
+		recordEvent(SimulationLog::EVENT_WIND_SPEED, e.value);
 	}
 
 	if (e.target->is("Wind direction")) {
-		model->setWindDirection(e.value);		
+		model->setWindDirection(e.value);
+		recordEvent(SimulationLog::EVENT_WIND_DIRECTION, e.value);
+	}
+}
+
+void ofApp::onTextInputEvent(ofxDatGuiTextInputEvent e) {
+	if (e.target->is("Seed")) {
+		seed = static_cast<uint32_t>(std::strtoul(e.text.c_str(), 0, 10));
+		e.target->setText(ofToString(seed));
+		model->setSeed(seed);
+		recordEvent(SimulationLog::EVENT_SEED, seed);
 	}
 }
@@ -25,13 +25,14 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include "ofxDatGui.h"
 #include "KinectProjector/KinectProjector.h"
 #include "SandSurfaceRenderer/SandSurfaceRenderer.h"
-#include "vehicle.h"
 #include "Model.h"
+#include "SimulationLog.h"
 
 class ofApp : public ofBaseApp {
 
 public:
 	void setup();
+	void exit();
 
 	void update();
 
@@ -56,6 +57,8 @@ public:
 	void onToggleEvent(ofxDatGuiToggleEvent e);
 	void on2dPadEvent(ofxDatGui2dPadEvent e);
     void onSliderEvent(ofxDatGuiSliderEvent e);
+	void onDropdownEvent(ofxDatGuiDropdownEvent e);
+	void onTextInputEvent(ofxDatGuiTextInputEvent e);
 
 	std::shared_ptr<ofAppBaseWindow> projWindow;
 
@@ -80,6 +83,13 @@ private:
     float windDirection;
 	double duration;
 	std::clock_t startTime;
+	uint32_t seed;
+
+	// Recording and replay of the simulation inputs along the depth recording
+	SimulationLog simulationLog;
+	string simulationLogPath;
+	bool recordingSimulation;
+	bool replayingSimulation;
 
 	// GUI
 	ofxDatGui* gui;
@@ -89,5 +99,11 @@ private:
     void drawMainWindow(float x, float y, float width, float height);
     void drawWindArrow();
     void drawPositioningTarget(ofVec2f firePos);
+    void drawRiskZones();
+	void resetInterface();
 	void setStatistics();
+	void recordEvent(SimulationLog::EventType type, double x = 0, double y = 0);
+	void replaySimulation(unsigned long long frame);
+	bool loadSettings();
+	bool saveSettings();
 };